@@ -0,0 +1,94 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "configgen.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace configgen
+{
+void generate(const Params& params, std::ostream& os)
+{
+    const auto n = params.numPeople;
+    const auto groupSize = std::max(params.groupSize, 1U);
+
+    std::mt19937 gen(params.seed);
+    std::uniform_real_distribution<double> udist(0.0, 1.0);
+
+    // the bottleneck donors are the first ones, their allowed giftees the
+    // ones right after them
+    const auto numTight = static_cast<unsigned int>(params.tightness * n);
+    const auto numTightGiftees =
+        (params.infeasible && numTight > 0) ? numTight - 1 : numTight;
+
+    std::vector<unsigned int> blocked;
+    for (unsigned int d = 0; d < n; ++d) {
+        blocked.clear();
+
+        // nobody within the group
+        const auto groupBegin = d / groupSize * groupSize;
+        for (auto g = groupBegin; g < std::min(groupBegin + groupSize, n);
+             ++g) {
+            if (g != d) {
+                blocked.push_back(g);
+            }
+        }
+
+        if (d < numTight) {
+            // everybody except the bottleneck giftees
+            for (unsigned int g = 0; g < n; ++g) {
+                if (g != d && (g < numTight || g >= numTight + numTightGiftees)) {
+                    blocked.push_back(g);
+                }
+            }
+        } else if (params.density >= 1.0) {
+            for (unsigned int g = 0; g < n; ++g) {
+                if (g != d) {
+                    blocked.push_back(g);
+                }
+            }
+        } else if (params.density > 0.0) {
+            // skip geometrically distributed gaps, such that this is
+            // O(blocked) instead of O(people)
+            const double logq = std::log(1.0 - params.density);
+            double pos{-1.0};
+            while (true) {
+                pos += 1.0 + std::floor(std::log(1.0 - udist(gen)) / logq);
+                if (pos >= n) {
+                    break;
+                }
+                const auto g = static_cast<unsigned int>(pos);
+                if (g != d) {
+                    blocked.push_back(g);
+                }
+            }
+        }
+
+        std::sort(blocked.begin(), blocked.end());
+        blocked.erase(std::unique(blocked.begin(), blocked.end()),
+                      blocked.end());
+
+        os << "P" << d;
+        for (auto it = blocked.cbegin(); it != blocked.cend(); ++it) {
+            os << (it == blocked.cbegin() ? " P" : ",P") << *it;
+        }
+        os << '\n';
+    }
+}
+}  // namespace configgen
@@ -0,0 +1,44 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+// generator for synthetic configuration files (for benchmarking)
+namespace configgen
+{
+struct Params {
+    // number of participants
+    unsigned int numPeople{100};
+    // probability that a donor has a certain other person blocked
+    double density{0.1};
+    // participants are split into groups of this size (e.g. households),
+    // within a group nobody may give gifts to each other
+    unsigned int groupSize{1};
+    // fraction of the participants forming a bottleneck: these donors may
+    // only give gifts to as many other people as there are donors in the
+    // bottleneck (i.e. Hall's condition is just fulfilled)
+    double tightness{0.0};
+    // makes the bottleneck one giftee short, i.e. the config infeasible
+    bool infeasible{false};
+    std::uint32_t seed{1};
+};
+
+// writes a configuration file (participant names P0, P1, ...)
+void generate(const Params& params, std::ostream& os);
+}  // namespace configgen
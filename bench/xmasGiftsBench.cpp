@@ -0,0 +1,361 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "configgen.h"
+#include "constraints.h"
+#include "parser.h"
+#include "solver.h"
+#include "stats.h"
+
+namespace
+{
+// the algorithms which can be benchmarked (see solver::Options::algorithm)
+const std::set<std::string> algorithmNames{
+    "auto",   "exact",    "recursive", "random", "pruned",
+    "anneal", "optimize", "derange",   "uniform"};
+
+struct BenchCfg {
+    std::vector<unsigned int> numPeople{10, 100, 1000};
+    std::vector<double> densities{0.1, 0.5, 0.8};
+    std::vector<unsigned int> groupSizes{1, 4};
+    std::vector<double> tightness{0.0, 0.2};
+    std::vector<std::string> algorithms{"recursive", "random", "pruned",
+                                        "anneal"};
+    bool infeasible{false};
+    std::uint32_t seed{1};
+    unsigned int timeoutSec{10};
+    std::string outFilename{};
+};
+
+// prints a little help text to the command line
+void printHelp();
+
+// parse the command line
+bool parseCmdLine(int argc, char **argv, BenchCfg &cfg);
+
+// splits a comma separated list of values
+template <typename T>
+std::vector<T> parseList(const std::string &s);
+
+// the status of a run in the results
+const char *outcomeName(solver::Outcome outcome);
+
+// parses, compiles and solves the config in a child process (such that the
+// peak memory is measured per run and runs can be aborted after the timeout)
+// and prints the results as one JSON object per line
+void runCase(const configgen::Params &params, const std::string &algorithm,
+             const std::string &cfgFilename, unsigned int timeoutSec);
+
+// body of the child process: writes "<key> <value>" lines to fd
+void runChild(const std::string &algorithm, const std::string &cfgFilename,
+              int fd);
+
+void printHelp()
+{
+    std::cout << R"(
+Usage: xmasGiftsBench [-n <people>] [-d <density>] [-g <groupsize>]
+                      [-t <tightness>] [-i] [-a <algorithms>] [-s <seed>]
+                      [-T <timeout>] [-o <config file>]
+
+    -n <people> comma separated list of numbers of participants
+    -d <density> comma separated list of probabilities of a blocked giftee
+    -g <groupsize> comma separated list of group (household) sizes
+    -t <tightness> comma separated list of fractions of participants in a
+       bottleneck (donors which may only give gifts to as many giftees)
+    -i make the bottleneck one giftee short (infeasible configs)
+    -a <algorithms> comma separated list of algorithms to run
+    -s <seed> seed for the config generator
+    -T <timeout> time limit per run in seconds
+    -o <config file> only write a config (with the first value of each list)
+
+Every combination of the parameters is run with every algorithm, the results
+are printed as one JSON object per line.
+)";
+}
+
+template <typename T>
+std::vector<T> parseList(const std::string &s)
+{
+    std::vector<T> values;
+    std::istringstream is(s);
+    std::string item;
+    while (std::getline(is, item, ',')) {
+        std::istringstream iss(item);
+        T v{};
+        if (iss >> v) {
+            values.push_back(v);
+        }
+    }
+    return values;
+}
+
+bool parseCmdLine(int argc, char **argv, BenchCfg &cfg)
+{
+    for (int n = 1; n < argc; ++n) {
+        const std::string arg{argv[n]};
+        if (arg == "-i") {
+            cfg.infeasible = true;
+        } else if (n + 1 >= argc) {
+            return false;
+        } else if (arg == "-n") {
+            cfg.numPeople = parseList<unsigned int>(argv[++n]);
+        } else if (arg == "-d") {
+            cfg.densities = parseList<double>(argv[++n]);
+        } else if (arg == "-g") {
+            cfg.groupSizes = parseList<unsigned int>(argv[++n]);
+        } else if (arg == "-t") {
+            cfg.tightness = parseList<double>(argv[++n]);
+        } else if (arg == "-a") {
+            cfg.algorithms = parseList<std::string>(argv[++n]);
+        } else if (arg == "-s") {
+            cfg.seed = static_cast<std::uint32_t>(
+                std::strtoul(argv[++n], nullptr, 10));
+        } else if (arg == "-T") {
+            cfg.timeoutSec = static_cast<unsigned int>(
+                std::strtoul(argv[++n], nullptr, 10));
+        } else if (arg == "-o") {
+            cfg.outFilename = argv[++n];
+        } else {
+            return false;
+        }
+    }
+
+    return !cfg.numPeople.empty() && !cfg.densities.empty() &&
+           !cfg.groupSizes.empty() && !cfg.tightness.empty();
+}
+
+const char *outcomeName(solver::Outcome outcome)
+{
+    switch (outcome) {
+        case solver::Outcome::found:
+            return "solved";
+        case solver::Outcome::infeasible:
+            return "no_solution";
+        case solver::Outcome::notFound:
+            return "not_found";
+        case solver::Outcome::invalidOptions:
+            return "not_applicable";
+    }
+    return "unknown";
+}
+
+void runChild(const std::string &algorithm, const std::string &cfgFilename,
+              int fd)
+{
+    auto report = [fd](const std::string &key, auto value) {
+        std::ostringstream ss;
+        ss << key << " " << value << "\n";
+        const auto s = ss.str();
+        (void)!write(fd, s.data(), s.size());
+    };
+
+    using Clock = std::chrono::steady_clock;
+    auto seconds = [](Clock::time_point t0) {
+        return std::chrono::duration<double>(Clock::now() - t0).count();
+    };
+
+    auto t0 = Clock::now();
+    auto people = parseFile(cfgFilename, false);
+    report("parseSeconds", seconds(t0));
+
+    t0 = Clock::now();
+    constraints::ConstraintModel model(people);
+    report("modelSeconds", seconds(t0));
+
+    // the quick checks are run by the constructor
+    t0 = Clock::now();
+    const solver::Problem problem(std::move(model));
+    const bool feasible = problem.findings().empty();
+    report("analysisSeconds", seconds(t0));
+    report("feasible", feasible ? 1 : 0);
+
+    if (feasible) {
+        solver::Options options;
+        options.algorithm = algorithm;
+        // the runs are limited by the timeout instead
+        options.timeBudgetSec = 0.0;
+
+        t0 = Clock::now();
+        stats::SolverStats solverStats(problem.model().size());
+        const auto assignment = problem.solve(options, &solverStats);
+        report("solveSeconds", seconds(t0));
+        report("outcome", outcomeName(assignment.outcome));
+        report("nodes", solverStats.nodes);
+        report("backtracks", solverStats.backtracks);
+        report("maxDepth", solverStats.maxDepth);
+        report("swapsTried", solverStats.swapsTried);
+    }
+
+    struct rusage usage {
+    };
+    getrusage(RUSAGE_SELF, &usage);
+    report("peakRssKb", usage.ru_maxrss);
+}
+
+void runCase(const configgen::Params &params, const std::string &algorithm,
+             const std::string &cfgFilename, unsigned int timeoutSec)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        std::cerr << "Could not create pipe" << std::endl;
+        return;
+    }
+
+    std::cout.flush();
+    const pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        runChild(algorithm, cfgFilename, fds[1]);
+        close(fds[1]);
+        _exit(EXIT_SUCCESS);
+    }
+    close(fds[1]);
+
+    // collect the child's results until it's done or the time is up
+    std::string results;
+    bool timeout = false;
+    const auto deadline = std::chrono::steady_clock::now() +
+                          std::chrono::seconds(timeoutSec);
+    while (true) {
+        const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                              deadline - std::chrono::steady_clock::now())
+                              .count();
+        struct pollfd pfd {
+            fds[0], POLLIN, 0
+        };
+        if (left <= 0 || poll(&pfd, 1, static_cast<int>(left)) == 0) {
+            timeout = true;
+            kill(pid, SIGKILL);
+            break;
+        }
+
+        char buf[256];
+        const auto len = read(fds[0], buf, sizeof(buf));
+        if (len <= 0) {
+            break;
+        }
+        results.append(buf, static_cast<std::size_t>(len));
+    }
+    close(fds[0]);
+
+    int status{0};
+    waitpid(pid, &status, 0);
+
+    std::map<std::string, std::string> values;
+    std::istringstream is(results);
+    std::string key;
+    std::string value;
+    while (is >> key >> value) {
+        values[key] = value;
+    }
+
+    std::string outcome;
+    if (timeout) {
+        outcome = "timeout";
+    } else if (!WIFEXITED(status) || values.count("peakRssKb") == 0) {
+        outcome = "crashed";
+    } else if (values["feasible"] == "0") {
+        outcome = "infeasible";
+    } else {
+        outcome = values["outcome"];
+    }
+
+    std::cout << "{\"people\":" << params.numPeople
+              << ",\"density\":" << params.density
+              << ",\"groupSize\":" << params.groupSize
+              << ",\"tightness\":" << params.tightness
+              << ",\"infeasible\":" << (params.infeasible ? "true" : "false")
+              << ",\"seed\":" << params.seed << ",\"algorithm\":\""
+              << algorithm << "\",\"status\":\"" << outcome << "\"";
+    for (const auto &[k, v] : values) {
+        if (k != "feasible" && k != "outcome") {
+            std::cout << ",\"" << k << "\":" << v;
+        }
+    }
+    std::cout << "}" << std::endl;
+}
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    BenchCfg cfg;
+    if (!parseCmdLine(argc, argv, cfg)) {
+        printHelp();
+        return EXIT_FAILURE;
+    }
+
+    for (const auto &a : cfg.algorithms) {
+        if (algorithmNames.count(a) == 0) {
+            std::cerr << "Unknown algorithm " << a << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!cfg.outFilename.empty()) {
+        std::ofstream os(cfg.outFilename);
+        configgen::generate({cfg.numPeople.front(), cfg.densities.front(),
+                             cfg.groupSizes.front(), cfg.tightness.front(),
+                             cfg.infeasible, cfg.seed},
+                            os);
+        return EXIT_SUCCESS;
+    }
+
+    const auto cfgFilename = (std::filesystem::temp_directory_path() /
+                              ("xmasGiftsBench_" + std::to_string(getpid()) +
+                               ".txt"))
+                                 .string();
+
+    for (const auto n : cfg.numPeople) {
+        for (const auto d : cfg.densities) {
+            for (const auto g : cfg.groupSizes) {
+                for (const auto t : cfg.tightness) {
+                    const configgen::Params params{n, d, g, t, cfg.infeasible,
+                                                   cfg.seed};
+                    {
+                        std::ofstream os(cfgFilename);
+                        configgen::generate(params, os);
+                    }
+
+                    for (const auto &a : cfg.algorithms) {
+                        runCase(params, a, cfgFilename, cfg.timeoutSec);
+                    }
+                }
+            }
+        }
+    }
+
+    std::remove(cfgFilename.c_str());
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,239 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "analysis.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "log.h"
+#include "matching.h"
+
+namespace
+{
+using analysis::Finding;
+using constraints::ConstraintModel;
+
+// everyone needs at least one possible giftee and one possible donor
+std::vector<Finding> checkDegrees(const ConstraintModel& model);
+
+// the "may give to" graph must be strongly connected
+std::vector<Finding> checkConnectivity(const ConstraintModel& model);
+
+// there must be a perfect matching of donors to giftees
+std::vector<Finding> checkHall(const ConstraintModel& model);
+
+// strongly connected components of the "may give to" graph (Kosaraju). The
+// components are returned in topological order, i.e. no one in the first
+// component has a donor in another component and no one in the last
+// component has a giftee in another component.
+std::vector<std::vector<PersonId>> stronglyConnectedComponents(
+    const ConstraintModel& model);
+
+std::vector<Finding> checkDegrees(const ConstraintModel& model)
+{
+    Finding noGiftee{"has no possible giftee", {}};
+    Finding noDonor{"has no possible donor", {}};
+
+    for (PersonId i = 0; i < model.size(); ++i) {
+        if (model.numGiftees(i) == 0) {
+            noGiftee.people.push_back(i);
+        }
+        if (model.numDonors(i) == 0) {
+            noDonor.people.push_back(i);
+        }
+    }
+
+    std::vector<Finding> findings;
+    for (auto* f : {&noGiftee, &noDonor}) {
+        if (!f->people.empty()) {
+            findings.emplace_back(std::move(*f));
+        }
+    }
+    return findings;
+}
+
+std::vector<std::vector<PersonId>> stronglyConnectedComponents(
+    const ConstraintModel& model)
+{
+    const auto n = model.size();
+    const auto words = model.numWords();
+
+    // depth first search along the rows (giftees or donors) starting at root.
+    // visit(p) is called when p is left for the last time
+    std::vector<bitset::Word> unvisited(words);
+    auto dfs = [&](PersonId root, bool forward, auto&& visit) {
+        // person and the position in its row to continue from
+        std::vector<std::pair<PersonId, std::size_t>> stack{{root, 0}};
+        bitset::reset(unvisited.data(), root);
+        while (!stack.empty()) {
+            auto& [p, from] = stack.back();
+            const auto* row = forward ? model.gifteesOf(p) : model.donorsOf(p);
+            const auto next =
+                bitset::findNextAnd(row, unvisited.data(), words, from);
+            if (next == bitset::npos) {
+                visit(p);
+                stack.pop_back();
+            } else {
+                from = next + 1;
+                bitset::reset(unvisited.data(), next);
+                stack.emplace_back(static_cast<PersonId>(next), 0);
+            }
+        }
+    };
+
+    auto markAllUnvisited = [&]() {
+        std::fill(unvisited.begin(), unvisited.end(), 0);
+        for (PersonId i = 0; i < n; ++i) {
+            bitset::set(unvisited.data(), i);
+        }
+    };
+
+    // first pass: order of finishing along the giftees
+    std::vector<PersonId> finished;
+    finished.reserve(n);
+    markAllUnvisited();
+    for (PersonId i = 0; i < n; ++i) {
+        if (bitset::test(unvisited.data(), i)) {
+            dfs(i, true, [&finished](PersonId p) { finished.push_back(p); });
+        }
+    }
+
+    // second pass: along the donors in reverse finishing order
+    std::vector<std::vector<PersonId>> components;
+    markAllUnvisited();
+    for (auto it = finished.crbegin(); it != finished.crend(); ++it) {
+        if (bitset::test(unvisited.data(), *it)) {
+            components.emplace_back();
+            auto& c = components.back();
+            dfs(*it, false, [&c](PersonId p) { c.push_back(p); });
+        }
+    }
+
+    return components;
+}
+
+std::vector<Finding> checkConnectivity(const ConstraintModel& model)
+{
+    std::vector<Finding> findings;
+
+    const auto components = stronglyConnectedComponents(model);
+    if (components.size() > 1) {
+        findings.push_back(
+            {"can't get a gift from anyone outside of this group",
+             components.front()});
+        findings.push_back(
+            {"can't give a gift to anyone outside of this group",
+             components.back()});
+    }
+
+    return findings;
+}
+
+std::vector<Finding> checkHall(const ConstraintModel& model)
+{
+    std::vector<Finding> findings;
+
+    const auto gifteeOf = matching::maximumMatching(model);
+    std::vector<PersonId> giftees;
+    auto donors = matching::hallViolation(model, gifteeOf, giftees);
+    if (!donors.empty()) {
+        std::string reason{"together may only give gifts to"};
+        for (const auto g : giftees) {
+            reason += " ";
+            reason += model.name(g);
+        }
+        reason += " (" + std::to_string(donors.size()) + " donors for " +
+                  std::to_string(giftees.size()) + " giftees)";
+        findings.push_back({reason, std::move(donors)});
+    }
+
+    return findings;
+}
+}  // namespace
+
+namespace analysis
+{
+std::vector<Finding> checkFeasibility(const ConstraintModel& model)
+{
+    if (model.size() < 2) {
+        return {{"at least two participants are required", {}}};
+    }
+
+    for (auto check : {checkDegrees, checkConnectivity, checkHall}) {
+        auto findings = check(model);
+        if (!findings.empty()) {
+            return findings;
+        }
+    }
+
+    LOG(debug) << "feasibility checks passed";
+
+    return {};
+}
+
+std::vector<Finding> checkDerangement(const ConstraintModel& model)
+{
+    if (model.size() < 2) {
+        return {{"at least two participants are required", {}}};
+    }
+
+    for (auto check : {checkDegrees, checkHall}) {
+        auto findings = check(model);
+        if (!findings.empty()) {
+            return findings;
+        }
+    }
+    return {};
+}
+
+std::vector<Finding> checkGiftCounts(const ConstraintModel& model,
+                                     unsigned int numGifts)
+{
+    const auto count = std::to_string(numGifts);
+    Finding fewGiftees{"has fewer than " + count + " possible giftees", {}};
+    Finding fewDonors{"has fewer than " + count + " possible donors", {}};
+
+    for (PersonId i = 0; i < model.size(); ++i) {
+        if (model.numGiftees(i) < numGifts) {
+            fewGiftees.people.push_back(i);
+        }
+        if (model.numDonors(i) < numGifts) {
+            fewDonors.people.push_back(i);
+        }
+    }
+
+    std::vector<Finding> findings;
+    for (auto* f : {&fewGiftees, &fewDonors}) {
+        if (!f->people.empty()) {
+            findings.emplace_back(std::move(*f));
+        }
+    }
+    return findings;
+}
+
+void printFindings(const ConstraintModel& model,
+                   const std::vector<Finding>& findings, std::ostream& os)
+{
+    for (const auto& f : findings) {
+        os << " ";
+        for (auto it = f.people.cbegin(); it != f.people.cend(); ++it) {
+            os << (it == f.people.cbegin() ? "" : ", ") << model.name(*it);
+        }
+        os << (f.people.empty() ? "" : ": ") << f.reason << std::endl;
+    }
+}
+}  // namespace analysis
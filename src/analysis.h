@@ -0,0 +1,54 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "constraints.h"
+#include "person.h"
+
+// polynomial time checks which prove that no valid donor->giftee list exists
+// (before any search is started)
+namespace analysis
+{
+struct Finding {
+    std::string reason;
+    std::vector<PersonId> people;
+};
+
+// runs the checks (cheapest first) and returns the problems found by the
+// first failing check. An empty result means that no problem was found, it
+// does not guarantee that a valid list exists though.
+std::vector<Finding> checkFeasibility(const constraints::ConstraintModel& model);
+
+// the checks for an assignment which may consist of several smaller circles
+// (see findDerangement()): only everyone having a donor and a giftee is
+// required, which is decided exactly by a perfect matching
+std::vector<Finding> checkDerangement(const constraints::ConstraintModel& model);
+
+// with several gifts per person, everyone needs at least numGifts possible
+// giftees and donors
+std::vector<Finding> checkGiftCounts(const constraints::ConstraintModel& model,
+                                     unsigned int numGifts);
+
+// prints the problems found (to the console by default)
+void printFindings(const constraints::ConstraintModel& model,
+                   const std::vector<Finding>& findings,
+                   std::ostream& os = std::cout);
+}  // namespace analysis
@@ -0,0 +1,67 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "arena.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+namespace
+{
+// size of the blocks of memory the names are stored in (longer names get a
+// block of their own)
+constexpr std::size_t blockSize{1U << 16};
+}  // namespace
+
+namespace arena
+{
+std::string_view NameArena::intern(std::string_view name)
+{
+    auto it = m_index.find(name);
+    if (it == m_index.end()) {
+        it = m_index.insert(store(name)).first;
+    }
+    return *it;
+}
+
+std::string_view NameArena::store(std::string_view name)
+{
+    if (!m_free || name.size() > m_freeSize) {
+        const auto size = std::max(blockSize, name.size());
+        m_blocks.emplace_back(new char[size]);
+        m_free = m_blocks.back().get();
+        m_freeSize = size;
+    }
+
+    std::memcpy(m_free, name.data(), name.size());
+    const std::string_view stored(m_free, name.size());
+    m_free += name.size();
+    m_freeSize -= name.size();
+    return stored;
+}
+
+std::string_view intern(std::string_view name)
+{
+    // the names are never released, such that the views can be copied along
+    // with the people freely (the same names come up again and again, e.g.
+    // when the daemon reloads a configuration)
+    static NameArena names;
+    static std::mutex mtx;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    return names.intern(name);
+}
+}  // namespace arena
@@ -0,0 +1,58 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace arena
+{
+// storage for names: every distinct name is copied once into large blocks of
+// memory (no allocation per name) and the returned views stay valid as long
+// as the arena exists
+class NameArena
+{
+public:
+    NameArena() = default;
+    NameArena(const NameArena&) = delete;
+    NameArena& operator=(const NameArena&) = delete;
+    NameArena(NameArena&&) = default;
+    NameArena& operator=(NameArena&&) = default;
+
+    // returns the stored copy of the name (the same view for equal names)
+    std::string_view intern(std::string_view name);
+
+    // number of distinct names stored
+    std::size_t size() const { return m_index.size(); }
+
+private:
+    // copies the name into the current block (or a new one)
+    std::string_view store(std::string_view name);
+
+    std::vector<std::unique_ptr<char[]>> m_blocks{};
+    // free space in the current block
+    char* m_free{nullptr};
+    std::size_t m_freeSize{0};
+    std::unordered_set<std::string_view> m_index{};
+};
+
+// interns the name (or email address) into the arena shared by all rosters of
+// the process, the view stays valid until the process ends. Thread safe.
+std::string_view intern(std::string_view name);
+}  // namespace arena
@@ -0,0 +1,143 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "bitset.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+inline std::size_t popcountWord(bitset::Word w)
+{
+    return static_cast<std::size_t>(__builtin_popcountll(w));
+}
+}  // namespace
+
+namespace bitset
+{
+#if defined(__AVX2__)
+// AVX2 has no vector popcount, so the AND is done 4 words at a time and the
+// popcount on the (hardware supported) 64bit lanes
+constexpr std::size_t wordsPerVec{4};
+
+std::size_t popcount(const Word* row, std::size_t words)
+{
+    std::size_t cnt{0};
+    for (std::size_t i = 0; i < words; ++i) {
+        cnt += popcountWord(row[i]);
+    }
+    return cnt;
+}
+
+std::size_t andPopcount(const Word* a, const Word* b, std::size_t words)
+{
+    std::size_t cnt{0};
+    std::size_t i{0};
+    for (; i + wordsPerVec <= words; i += wordsPerVec) {
+        const __m256i va =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        const __m256i vb =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        const __m256i vand = _mm256_and_si256(va, vb);
+        cnt += popcountWord(static_cast<Word>(_mm256_extract_epi64(vand, 0)));
+        cnt += popcountWord(static_cast<Word>(_mm256_extract_epi64(vand, 1)));
+        cnt += popcountWord(static_cast<Word>(_mm256_extract_epi64(vand, 2)));
+        cnt += popcountWord(static_cast<Word>(_mm256_extract_epi64(vand, 3)));
+    }
+    for (; i < words; ++i) {
+        cnt += popcountWord(a[i] & b[i]);
+    }
+    return cnt;
+}
+
+bool intersects(const Word* a, const Word* b, std::size_t words)
+{
+    std::size_t i{0};
+    for (; i + wordsPerVec <= words; i += wordsPerVec) {
+        const __m256i va =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        const __m256i vb =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        if (!_mm256_testz_si256(va, vb)) {
+            return true;
+        }
+    }
+    for (; i < words; ++i) {
+        if (a[i] & b[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void andInto(Word* dst, const Word* src, std::size_t words)
+{
+    std::size_t i{0};
+    for (; i + wordsPerVec <= words; i += wordsPerVec) {
+        const __m256i vd =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        const __m256i vs =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                            _mm256_and_si256(vd, vs));
+    }
+    for (; i < words; ++i) {
+        dst[i] &= src[i];
+    }
+}
+
+const char* kernelName() { return "avx2"; }
+#else   // __AVX2__
+std::size_t popcount(const Word* row, std::size_t words)
+{
+    std::size_t cnt{0};
+    for (std::size_t i = 0; i < words; ++i) {
+        cnt += popcountWord(row[i]);
+    }
+    return cnt;
+}
+
+std::size_t andPopcount(const Word* a, const Word* b, std::size_t words)
+{
+    std::size_t cnt{0};
+    for (std::size_t i = 0; i < words; ++i) {
+        cnt += popcountWord(a[i] & b[i]);
+    }
+    return cnt;
+}
+
+bool intersects(const Word* a, const Word* b, std::size_t words)
+{
+    for (std::size_t i = 0; i < words; ++i) {
+        if (a[i] & b[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void andInto(Word* dst, const Word* src, std::size_t words)
+{
+    for (std::size_t i = 0; i < words; ++i) {
+        dst[i] &= src[i];
+    }
+}
+
+const char* kernelName() { return "scalar"; }
+#endif  // __AVX2__
+}  // namespace bitset
@@ -0,0 +1,120 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// kernels operating on packed bit rows (used for the constraint matrix). The
+// rows are plain arrays of 64bit words, bit i of a row is stored in word i/64.
+namespace bitset
+{
+using Word = std::uint64_t;
+
+constexpr std::size_t wordBits{64};
+
+// number of words required to store n bits
+constexpr std::size_t numWords(std::size_t n)
+{
+    return (n + wordBits - 1) / wordBits;
+}
+
+inline bool test(const Word* row, std::size_t i)
+{
+    return (row[i / wordBits] >> (i % wordBits)) & 1U;
+}
+
+inline void set(Word* row, std::size_t i)
+{
+    row[i / wordBits] |= Word{1} << (i % wordBits);
+}
+
+inline void reset(Word* row, std::size_t i)
+{
+    row[i / wordBits] &= ~(Word{1} << (i % wordBits));
+}
+
+// calls f(i) for every bit i set in (a & b), in ascending order
+template <typename F>
+void forEachAnd(const Word* a, const Word* b, std::size_t words, F&& f)
+{
+    for (std::size_t i = 0; i < words; ++i) {
+        Word w = a[i] & b[i];
+        while (w) {
+            f(i * wordBits + static_cast<std::size_t>(__builtin_ctzll(w)));
+            w &= w - 1;
+        }
+    }
+}
+
+// calls f(i) for every bit i set in the row, in ascending order
+template <typename F>
+void forEach(const Word* row, std::size_t words, F&& f)
+{
+    for (std::size_t i = 0; i < words; ++i) {
+        Word w = row[i];
+        while (w) {
+            f(i * wordBits + static_cast<std::size_t>(__builtin_ctzll(w)));
+            w &= w - 1;
+        }
+    }
+}
+
+// returned by the find functions if there's no further bit set
+constexpr std::size_t npos{~std::size_t{0}};
+
+// index of the first bit >= from set in (a & b), or npos
+inline std::size_t findNextAnd(const Word* a, const Word* b, std::size_t words,
+                               std::size_t from)
+{
+    std::size_t i = from / wordBits;
+    if (i >= words) {
+        return npos;
+    }
+
+    Word w = a[i] & b[i] & (~Word{0} << (from % wordBits));
+    while (!w) {
+        if (++i == words) {
+            return npos;
+        }
+        w = a[i] & b[i];
+    }
+    return i * wordBits + static_cast<std::size_t>(__builtin_ctzll(w));
+}
+
+// index of the first bit >= from set in the row, or npos
+inline std::size_t findNext(const Word* row, std::size_t words,
+                            std::size_t from)
+{
+    return findNextAnd(row, row, words, from);
+}
+
+// number of bits set in the row
+std::size_t popcount(const Word* row, std::size_t words);
+
+// number of bits set in (a & b)
+std::size_t andPopcount(const Word* a, const Word* b, std::size_t words);
+
+// true if (a & b) has at least one bit set
+bool intersects(const Word* a, const Word* b, std::size_t words);
+
+// dst &= src
+void andInto(Word* dst, const Word* src, std::size_t words);
+
+// name of the kernel implementation compiled in (e.g. "avx2" or "scalar")
+const char* kernelName();
+}  // namespace bitset
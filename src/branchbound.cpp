@@ -0,0 +1,230 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "branchbound.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <optional>
+#include <random>
+
+#include "hamilton.h"
+#include "log.h"
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+// the clock is checked every this many candidates
+constexpr std::uint64_t deadlineCheckInterval{1024};
+
+constexpr std::uint64_t noList{std::numeric_limits<std::uint64_t>::max()};
+
+class Optimizer
+{
+public:
+    Optimizer(const constraints::ConstraintModel& model, std::uint32_t seed,
+              double timeBudgetSec, stats::SolverStats& stats);
+
+    // searches all lists starting with the given person
+    branchbound::Result run(PersonId first);
+
+    const std::vector<PersonId>& best() const { return m_best; }
+
+private:
+    // tries all completions of the current path (with the given penalty)
+    void branch(std::uint64_t penalty);
+
+    // lower bound of the penalties still to come
+    std::uint64_t bound() const { return std::max(m_openOut, m_openIn); }
+
+    // true once the time budget is used up
+    bool outOfTime();
+
+    unsigned int cost(PersonId donor, PersonId giftee) const
+    {
+        return m_cost[donor * m_n + giftee];
+    }
+
+    const constraints::ConstraintModel& m_model;
+    const std::size_t m_n;
+    hamilton::Search m_search;
+    stats::SolverStats& m_stats;
+    std::vector<unsigned int> m_cost;
+    // the cheapest allowed giftee of every donor and donor of every giftee
+    std::vector<unsigned int> m_minOut;
+    std::vector<unsigned int> m_minIn;
+    // their sums over the donors (tail and unvisited people) and giftees
+    // (unvisited people and the first one) without a place in the list yet
+    std::uint64_t m_openOut{0};
+    std::uint64_t m_openIn{0};
+    std::vector<PersonId> m_best{};
+    std::uint64_t m_bestPenalty{noList};
+    std::optional<Clock::time_point> m_deadline{};
+    std::uint64_t m_numChecks{0};
+    bool m_stopped{false};
+};
+
+Optimizer::Optimizer(const constraints::ConstraintModel& model,
+                     std::uint32_t seed, double timeBudgetSec,
+                     stats::SolverStats& stats)
+    : m_model(model),
+      m_n(model.size()),
+      m_search(model, seed),
+      m_stats(stats),
+      m_cost(m_n * m_n, 0),
+      m_minOut(m_n, 0),
+      m_minIn(m_n, 0)
+{
+    for (PersonId d = 0; d < m_n; ++d) {
+        for (const auto& p : model.penaltiesOf(d)) {
+            m_cost[d * m_n + p.giftee] = p.weight;
+        }
+    }
+
+    // the penalties are sparse, most people have a free giftee and donor
+    constexpr auto none = std::numeric_limits<unsigned int>::max();
+    std::fill(m_minOut.begin(), m_minOut.end(), none);
+    std::fill(m_minIn.begin(), m_minIn.end(), none);
+    for (PersonId d = 0; d < m_n; ++d) {
+        bitset::forEach(model.gifteesOf(d), model.numWords(),
+                        [&](std::size_t g) {
+                            const auto c = cost(d, static_cast<PersonId>(g));
+                            m_minOut[d] = std::min(m_minOut[d], c);
+                            m_minIn[g] = std::min(m_minIn[g], c);
+                        });
+    }
+    for (PersonId i = 0; i < m_n; ++i) {
+        m_minOut[i] = m_minOut[i] == none ? 0 : m_minOut[i];
+        m_minIn[i] = m_minIn[i] == none ? 0 : m_minIn[i];
+    }
+
+    if (timeBudgetSec > 0) {
+        m_deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                        std::chrono::duration<double>(
+                                            timeBudgetSec));
+    }
+}
+
+branchbound::Result Optimizer::run(PersonId first)
+{
+    branchbound::Result result;
+    if (m_search.start(first)) {
+        for (PersonId i = 0; i < m_n; ++i) {
+            m_openOut += m_minOut[i];
+            m_openIn += m_minIn[i];
+        }
+        branch(0);
+    }
+
+    result.found = m_bestPenalty != noList;
+    result.complete = !m_stopped;
+    result.penalty = result.found ? m_bestPenalty : 0;
+    return result;
+}
+
+void Optimizer::branch(std::uint64_t penalty)
+{
+    const auto& path = m_search.path();
+    const PersonId tail = path.back();
+
+    if (path.size() == m_n) {
+        if (m_search.complete()) {
+            const auto total = penalty + cost(tail, path.front());
+            if (total < m_bestPenalty) {
+                if (m_best.empty()) {
+                    m_stats.solutionFound();
+                }
+                m_bestPenalty = total;
+                m_best = path;
+                LOG(debug) << "list with penalty " << total << " found";
+            }
+        }
+        return;
+    }
+
+    // the cheapest giftees first
+    auto candidates = m_search.candidates();
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [this, tail](PersonId a, PersonId b) {
+                         return cost(tail, a) < cost(tail, b);
+                     });
+
+    for (const auto next : candidates) {
+        if (m_stopped || outOfTime()) {
+            return;
+        }
+
+        // the tail and "next" got their places, their cheapest options don't
+        // count for the bound anymore
+        const auto extended = penalty + cost(tail, next);
+        m_openOut -= m_minOut[tail];
+        m_openIn -= m_minIn[next];
+        if (extended + bound() < m_bestPenalty && m_search.push(next)) {
+            ++m_stats.nodes;
+            m_stats.depth(m_search.path().size());
+            branch(extended);
+            m_search.pop();
+            ++m_stats.backtracks;
+        } else {
+            m_stats.reject(tail);
+        }
+        m_openOut += m_minOut[tail];
+        m_openIn += m_minIn[next];
+    }
+}
+
+bool Optimizer::outOfTime()
+{
+    if (m_deadline && ++m_numChecks % deadlineCheckInterval == 0 &&
+        Clock::now() > *m_deadline) {
+        LOG(info) << "time budget used up, stopping the optimization";
+        m_stopped = true;
+    }
+    return m_stopped;
+}
+}  // namespace
+
+branchbound::Result findBestList(std::vector<PersonId>& cycle,
+                                 const constraints::ConstraintModel& model,
+                                 double timeBudgetSec,
+                                 stats::SolverStats* stats)
+{
+    stats::SolverStats localStats;
+    auto& st = stats ? *stats : localStats;
+
+    branchbound::Result result;
+    if (model.size() < 2 || model.size() > branchbound::maxPeople) {
+        // no circle possible, or too many people for the matrix
+        result.complete = model.size() < 2;
+        return result;
+    }
+
+    std::random_device rd;
+    std::mt19937 gen(rd());
+
+    Optimizer optimizer(model, gen(), timeBudgetSec, st);
+    result = optimizer.run(hamilton::mostConstrainedPerson(model, gen));
+    if (result.found) {
+        cycle = optimizer.best();
+    }
+    LOG(debug) << "optimization "
+               << (result.complete ? "completed" : "stopped") << " after "
+               << st.nodes << " partial lists";
+
+    return result;
+}
@@ -0,0 +1,56 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "constraints.h"
+#include "person.h"
+#include "stats.h"
+
+// minimum penalty donor->giftee lists by branch and bound
+namespace branchbound
+{
+// largest number of people, the penalties are kept in a dense matrix of
+// 4 byte entries (16MB for 2048 people)
+constexpr std::size_t maxPeople{2048};
+
+struct Result {
+    // a valid list was found (the best one found is returned)
+    bool found{false};
+    // the search was completed within the time budget: the list is the one
+    // with the smallest penalty, or there's no valid list at all
+    bool complete{false};
+    // the sum of the penalties of the list
+    std::uint64_t penalty{0};
+};
+}  // namespace branchbound
+
+// find the valid donor->giftee list with the smallest sum of penalties. The
+// pruned depth-first search (see hamilton::Search) tries the cheapest giftees
+// first and gives up every partial list which can't beat the best list found
+// so far: the penalties of the partial list plus the cheapest possible
+// giftee of every donor still to be placed (or the cheapest possible donor of
+// every giftee still to be placed) is a lower bound of every completion. The
+// search stops after timeBudgetSec seconds (0: no limit) with the best list
+// found so far. Only for up to branchbound::maxPeople people.
+branchbound::Result findBestList(std::vector<PersonId>& cycle,
+                                 const constraints::ConstraintModel& model,
+                                 double timeBudgetSec,
+                                 stats::SolverStats* stats = nullptr);
@@ -0,0 +1,436 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "cache.h"
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string_view>
+
+#include "arena.h"
+#include "log.h"
+#include "mappedfile.h"
+#include "parser.h"
+
+namespace
+{
+constexpr char fileMagic[8] = {'x', 'm', 'a', 's', 'G', 'C', 'F', 'G'};
+constexpr std::uint32_t formatVersion{3};
+constexpr std::uint32_t flagEmails{1};
+
+// all sections are aligned to this
+constexpr std::size_t sectionAlign{8};
+
+// the file starts with this header, followed by the sections
+//  - group name offsets (numGroups + 1 uint64) and the group names,
+//  - group offsets (numGroups + 1 uint64, the index of every group's first
+//    person),
+//  - name offsets (numPeople + 1 uint64) and the names (of all groups),
+//  - email offsets and the emails (with the email flag only),
+//  - blocked offsets (numPeople + 1 uint64) and the blocked IDs (uint32,
+//    within the group),
+//  - penalty offsets (numPeople + 1 uint64) and the penalties (giftee ID and
+//    weight, uint32 each),
+//  - the messages of the parser (duplicate and unknown names).
+// All numbers are stored in the native byte order (the magic and version
+// are checked, everything else is validated while reading).
+struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t flags;
+    std::uint64_t sourceHash;
+    std::uint64_t sourceSize;
+    std::uint64_t numGroups;
+    std::uint64_t groupNameBytes;
+    std::uint64_t numPeople;
+    std::uint64_t numBlocked;
+    std::uint64_t numPenalties;
+    std::uint64_t nameBytes;
+    std::uint64_t emailBytes;
+    std::uint64_t diagBytes;
+};
+
+// walks through the sections of a mapped cache file, checking the bounds
+class Reader
+{
+public:
+    explicit Reader(std::string_view data) : m_data(data) {}
+
+    // the next count elements of type T (nullptr if the file is too short)
+    template <typename T>
+    const T* take(std::uint64_t count)
+    {
+        if (count > (m_data.size() - m_pos) / sizeof(T)) {
+            return nullptr;
+        }
+        const auto* p = reinterpret_cast<const T*>(m_data.data() + m_pos);
+        m_pos += count * sizeof(T);
+        m_pos += (sectionAlign - m_pos % sectionAlign) % sectionAlign;
+        m_pos = std::min(m_pos, m_data.size());
+        return p;
+    }
+
+private:
+    std::string_view m_data;
+    std::size_t m_pos{0};
+};
+
+// 64bit hash of the file content (not cryptographic, it just detects changed
+// files)
+std::uint64_t contentHash(std::string_view data);
+
+// appends an array to the buffer and pads it to the section alignment
+template <typename T>
+void appendSection(std::string& buf, const T* data, std::size_t count);
+
+// string table: the offsets of count strings followed by their characters
+template <typename F>
+void appendStrings(std::string& buf, std::size_t count, F&& str);
+
+// reads a string table, returns false if it's inconsistent
+bool readStrings(Reader& reader, std::uint64_t count, std::uint64_t bytes,
+                 std::vector<std::string_view>& strings);
+
+// the groups stored in the cache file, if it matches the source
+std::optional<std::vector<Group>> readCache(const std::string& filename,
+                                            std::uint64_t sourceHash,
+                                            std::uint64_t sourceSize,
+                                            bool sendEmails, std::string& diag);
+
+// writes the cache file (into a temporary file which is renamed, such that
+// concurrent runs never see half written files)
+void writeCache(const std::string& filename, std::uint64_t sourceHash,
+                std::uint64_t sourceSize, bool sendEmails,
+                const std::vector<Group>& groups, const std::string& diag);
+
+std::uint64_t contentHash(std::string_view data)
+{
+    constexpr std::uint64_t k1{0x9e3779b97f4a7c15ULL};
+    constexpr std::uint64_t k2{0xc2b2ae3d27d4eb4fULL};
+
+    auto mix = [](std::uint64_t h, std::uint64_t w) {
+        h ^= w * k1;
+        h = (h << 31) | (h >> 33);
+        return h * k2;
+    };
+
+    std::uint64_t h{data.size() * k2};
+    std::size_t i{0};
+    for (; i + 8 <= data.size(); i += 8) {
+        std::uint64_t w;
+        std::memcpy(&w, data.data() + i, 8);
+        h = mix(h, w);
+    }
+    if (i < data.size()) {
+        std::uint64_t w{0};
+        std::memcpy(&w, data.data() + i, data.size() - i);
+        h = mix(h, w);
+    }
+
+    h ^= h >> 33;
+    h *= k1;
+    h ^= h >> 29;
+    return h;
+}
+
+template <typename T>
+void appendSection(std::string& buf, const T* data, std::size_t count)
+{
+    buf.append(reinterpret_cast<const char*>(data), count * sizeof(T));
+    buf.append((sectionAlign - buf.size() % sectionAlign) % sectionAlign, '\0');
+}
+
+template <typename F>
+void appendStrings(std::string& buf, std::size_t count, F&& str)
+{
+    std::vector<std::uint64_t> offsets(count + 1, 0);
+    for (std::size_t i = 0; i < count; ++i) {
+        offsets[i + 1] = offsets[i] + str(i).size();
+    }
+    appendSection(buf, offsets.data(), offsets.size());
+
+    for (std::size_t i = 0; i < count; ++i) {
+        buf.append(str(i));
+    }
+    buf.append((sectionAlign - buf.size() % sectionAlign) % sectionAlign, '\0');
+}
+
+bool readStrings(Reader& reader, std::uint64_t count, std::uint64_t bytes,
+                 std::vector<std::string_view>& strings)
+{
+    const auto* offsets = reader.take<std::uint64_t>(count + 1);
+    const auto* chars = reader.take<char>(bytes);
+    if (!offsets || !chars || offsets[0] != 0 || offsets[count] != bytes) {
+        return false;
+    }
+
+    strings.resize(count);
+    for (std::uint64_t i = 0; i < count; ++i) {
+        if (offsets[i + 1] < offsets[i]) {
+            return false;
+        }
+        strings[i] = std::string_view(chars + offsets[i],
+                                      offsets[i + 1] - offsets[i]);
+    }
+    return true;
+}
+
+std::optional<std::vector<Group>> readCache(const std::string& filename,
+                                            std::uint64_t sourceHash,
+                                            std::uint64_t sourceSize,
+                                            bool sendEmails, std::string& diag)
+{
+    const io::MappedFile file(filename);
+    if (!file.ok()) {
+        return std::nullopt;
+    }
+
+    Reader reader(file.data());
+    const auto* header = reader.take<Header>(1);
+    if (!header || std::memcmp(header->magic, fileMagic, 8) != 0 ||
+        header->version != formatVersion ||
+        header->sourceHash != sourceHash ||
+        header->sourceSize != sourceSize ||
+        ((header->flags & flagEmails) != 0) != sendEmails ||
+        header->numGroups > file.data().size() / sizeof(std::uint64_t) ||
+        header->numPeople > file.data().size() / sizeof(std::uint64_t)) {
+        return std::nullopt;
+    }
+
+    const auto numGroups = header->numGroups;
+    std::vector<std::string_view> groupNames;
+    if (!readStrings(reader, numGroups, header->groupNameBytes, groupNames)) {
+        return std::nullopt;
+    }
+    const auto* groupOffsets = reader.take<std::uint64_t>(numGroups + 1);
+    if (!groupOffsets || groupOffsets[0] != 0 ||
+        groupOffsets[numGroups] != header->numPeople) {
+        return std::nullopt;
+    }
+
+    const auto n = header->numPeople;
+    std::vector<std::string_view> names;
+    std::vector<std::string_view> emails;
+    if (!readStrings(reader, n, header->nameBytes, names) ||
+        (sendEmails && !readStrings(reader, n, header->emailBytes, emails))) {
+        return std::nullopt;
+    }
+
+    const auto* blockedOffsets = reader.take<std::uint64_t>(n + 1);
+    const auto* blocked = reader.take<std::uint32_t>(header->numBlocked);
+    const auto* penaltyOffsets = reader.take<std::uint64_t>(n + 1);
+    const auto* penalties = reader.take<Penalty>(header->numPenalties);
+    const auto* diagChars = reader.take<char>(header->diagBytes);
+    if (!blockedOffsets || !blocked || !penaltyOffsets || !penalties ||
+        !diagChars || blockedOffsets[0] != 0 ||
+        blockedOffsets[n] != header->numBlocked || penaltyOffsets[0] != 0 ||
+        penaltyOffsets[n] != header->numPenalties) {
+        return std::nullopt;
+    }
+
+    std::vector<Group> groups(numGroups);
+    for (std::uint64_t g = 0; g < numGroups; ++g) {
+        const auto first = groupOffsets[g];
+        if (groupOffsets[g + 1] < first) {
+            return std::nullopt;
+        }
+        const auto size = groupOffsets[g + 1] - first;
+
+        auto& people = groups[g].people;
+        groups[g].name = groupNames[g];
+        people.resize(size);
+        for (PersonId i = 0; i < size; ++i) {
+            const auto begin = blockedOffsets[first + i];
+            const auto end = blockedOffsets[first + i + 1];
+            const auto penaltiesBegin = penaltyOffsets[first + i];
+            const auto penaltiesEnd = penaltyOffsets[first + i + 1];
+            if (end < begin || penaltiesEnd < penaltiesBegin) {
+                return std::nullopt;
+            }
+
+            auto& p = people[i];
+            p.name = arena::intern(names[first + i]);
+            if (sendEmails) {
+                p.email = arena::intern(emails[first + i]);
+            }
+            p.blocked.assign(blocked + begin, blocked + end);
+            p.penalties.assign(penalties + penaltiesBegin,
+                               penalties + penaltiesEnd);
+            p.id = i;
+            for (const auto b : p.blocked) {
+                if (b >= size) {
+                    return std::nullopt;
+                }
+            }
+            for (const auto& penalty : p.penalties) {
+                if (penalty.giftee >= size) {
+                    return std::nullopt;
+                }
+            }
+        }
+    }
+
+    diag.assign(diagChars, header->diagBytes);
+    return groups;
+}
+
+void writeCache(const std::string& filename, std::uint64_t sourceHash,
+                std::uint64_t sourceSize, bool sendEmails,
+                const std::vector<Group>& groups, const std::string& diag)
+{
+    // the people of all groups one after the other
+    std::vector<const Person*> people;
+    std::vector<std::uint64_t> groupOffsets{0};
+    for (const auto& g : groups) {
+        for (const auto& p : g.people) {
+            people.push_back(&p);
+        }
+        groupOffsets.push_back(people.size());
+    }
+    const auto n = people.size();
+
+    std::vector<std::uint64_t> blockedOffsets(n + 1, 0);
+    std::vector<std::uint64_t> penaltyOffsets(n + 1, 0);
+    for (std::size_t i = 0; i < n; ++i) {
+        blockedOffsets[i + 1] = blockedOffsets[i] + people[i]->blocked.size();
+        penaltyOffsets[i + 1] =
+            penaltyOffsets[i] + people[i]->penalties.size();
+    }
+
+    Header header{};
+    std::memcpy(header.magic, fileMagic, 8);
+    header.version = formatVersion;
+    header.flags = sendEmails ? flagEmails : 0;
+    header.sourceHash = sourceHash;
+    header.sourceSize = sourceSize;
+    header.numGroups = groups.size();
+    for (const auto& g : groups) {
+        header.groupNameBytes += g.name.size();
+    }
+    header.numPeople = n;
+    header.numBlocked = blockedOffsets[n];
+    header.numPenalties = penaltyOffsets[n];
+    for (const auto* p : people) {
+        header.nameBytes += p->name.size();
+        header.emailBytes += p->email ? p->email->size() : 0;
+    }
+    header.diagBytes = diag.size();
+
+    std::string buf;
+    appendSection(buf, &header, 1);
+    appendStrings(buf, groups.size(),
+                  [&groups](std::size_t i) -> std::string_view {
+                      return groups[i].name;
+                  });
+    appendSection(buf, groupOffsets.data(), groupOffsets.size());
+    appendStrings(buf, n, [&people](std::size_t i) -> std::string_view {
+        return people[i]->name;
+    });
+    if (sendEmails) {
+        appendStrings(buf, n, [&people](std::size_t i) -> std::string_view {
+            return people[i]->email ? std::string_view(*people[i]->email)
+                                    : std::string_view();
+        });
+    }
+    appendSection(buf, blockedOffsets.data(), blockedOffsets.size());
+    for (const auto* p : people) {
+        buf.append(reinterpret_cast<const char*>(p->blocked.data()),
+                   p->blocked.size() * sizeof(PersonId));
+    }
+    buf.append((sectionAlign - buf.size() % sectionAlign) % sectionAlign, '\0');
+    appendSection(buf, penaltyOffsets.data(), penaltyOffsets.size());
+    for (const auto* p : people) {
+        buf.append(reinterpret_cast<const char*>(p->penalties.data()),
+                   p->penalties.size() * sizeof(Penalty));
+    }
+    buf.append((sectionAlign - buf.size() % sectionAlign) % sectionAlign, '\0');
+    appendSection(buf, diag.data(), diag.size());
+
+    const auto tmpFilename = filename + "." + std::to_string(getpid());
+    {
+        std::ofstream os(tmpFilename, std::ios::binary);
+        os.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+        if (!os) {
+            LOG(debug) << "Could not write " << tmpFilename;
+            os.close();
+            std::remove(tmpFilename.c_str());
+            return;
+        }
+    }
+
+    if (std::rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+        std::remove(tmpFilename.c_str());
+        return;
+    }
+    LOG(debug) << "compiled configuration written into " << filename;
+}
+}  // namespace
+
+namespace cache
+{
+std::string cacheFilename(const std::string& inFilename)
+{
+    return inFilename + ".cache";
+}
+
+std::vector<Group> loadConfig(const std::string& inFilename, bool sendEmails)
+{
+    static_assert(sizeof(PersonId) == sizeof(std::uint32_t),
+                  "blocked IDs are stored as uint32");
+    static_assert(sizeof(Penalty) == 2 * sizeof(std::uint32_t),
+                  "penalties are stored as two uint32");
+
+    // streams (e.g. pipes) can't have a cache file next to them
+    std::error_code ec;
+    if (!std::filesystem::is_regular_file(inFilename, ec)) {
+        return parseGroupFile(inFilename, sendEmails);
+    }
+
+    const io::MappedFile source(inFilename);
+    if (!source.ok()) {
+        std::cerr << "Could not read " << inFilename << std::endl;
+        return {};
+    }
+
+    const auto data = source.data();
+    const auto hash = contentHash(data);
+    const auto filename = cacheFilename(inFilename);
+
+    std::string diag;
+    if (auto groups = readCache(filename, hash, data.size(), sendEmails,
+                                diag)) {
+        std::cerr << diag;
+        LOG(debug) << groups->size() << " groups loaded from " << filename;
+        return std::move(*groups);
+    }
+
+    std::ostringstream diagStream;
+    auto groups = parseGroups(data, sendEmails, diagStream);
+    diag = diagStream.str();
+    std::cerr << diag;
+
+    writeCache(filename, hash, data.size(), sendEmails, groups, diag);
+
+    return groups;
+}
+}  // namespace cache
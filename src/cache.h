@@ -13,12 +13,22 @@
 // You should have received a copy of the GNU General Public License
 // along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
 //
+#pragma once
 
-#include "output.h"
+#include <string>
+#include <vector>
 
-#include <iostream>
+#include "person.h"
 
-unsigned int OutputCfg::verbosityLevel = 0;
+// compiled (binary) form of configuration files, stored next to them such
+// that later runs on the same file don't have to parse it again
+namespace cache
+{
+// the filename of the compiled form of a configuration file
+std::string cacheFilename(const std::string& inFilename);
 
-OutputData out;
-OutputDbg dbg;
+// loads the compiled form of the configuration file (its groups, see
+// parseGroups()) if it was written for the same file content (and email
+// option), otherwise parses the file and writes its compiled form
+std::vector<Group> loadConfig(const std::string& inFilename, bool sendEmails);
+}  // namespace cache
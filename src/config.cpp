@@ -28,7 +28,40 @@ std::string const &Config::getEmailUsername() const { return m_emailUsername; }
 
 std::string const &Config::getEmailPwd() const { return m_emailPwd; }
 
+std::string const &Config::getAlgorithm() const { return m_algorithm; }
+
+std::string const &Config::getStatsFormat() const { return m_statsFormat; }
+
+std::string const &Config::getSocketPath() const { return m_socketPath; }
+
+std::string const &Config::getConfigDir() const { return m_configDir; }
+
+unsigned int Config::getNumThreads() const { return m_numThreads; }
+
+unsigned int Config::getNumSolutions() const { return m_numSolutions; }
+
+unsigned int Config::getNumSmtpConnections() const
+{
+    return m_numSmtpConnections;
+}
+
+unsigned int Config::getHistoryYears() const { return m_historyYears; }
+
+unsigned int Config::getPenaltyYears() const { return m_penaltyYears; }
+
+unsigned int Config::getTimeBudget() const { return m_timeBudget; }
+
+unsigned int Config::getNumGifts() const { return m_numGifts; }
+
+unsigned int Config::getMinCycleLength() const { return m_minCycleLength; }
+
 bool Config::useEmails() const { return m_useEmails; }
 
-bool Config::useRandomAlgo() const { return m_useRandomAlgo; }
+bool Config::useCache() const { return m_useCache; }
+
+bool Config::deliverOnly() const { return m_deliverOnly; }
+
+bool Config::countOnly() const { return m_countOnly; }
+
+bool Config::allowPlaintextAuth() const { return m_allowPlaintextAuth; }
 }  // namespace config
\ No newline at end of file
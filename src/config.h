@@ -18,7 +18,7 @@
 
 #include <string>
 
-#include "output.h"
+#include "log.h"
 
 namespace config
 {
@@ -33,14 +33,24 @@ public:
         if constexpr (std::is_same_v<bool, T>) {
             if (cfgOption == "useEmails") {
                 m_useEmails = cfgValue;
-            } else if (cfgOption == "useRandomAlgo") {
-                m_useRandomAlgo = cfgValue;
+            } else if (cfgOption == "useCache") {
+                m_useCache = cfgValue;
+            } else if (cfgOption == "deliverOnly") {
+                m_deliverOnly = cfgValue;
+            } else if (cfgOption == "countOnly") {
+                m_countOnly = cfgValue;
+            } else if (cfgOption == "allowPlaintextAuth") {
+                m_allowPlaintextAuth = cfgValue;
             } else {
                 // unknown entry, just don't do anything
             }
         } else if constexpr (std::is_same_v<std::string, T>) {
             if (cfgOption == "inputFilename") {
                 m_inputFilename = cfgValue;
+            } else if (cfgOption == "algorithm") {
+                m_algorithm = cfgValue;
+            } else if (cfgOption == "statsFormat") {
+                m_statsFormat = cfgValue;
             } else if (cfgOption == "emailSender") {
                 m_emailSender = cfgValue;
             } else if (cfgOption == "smtpServer") {
@@ -49,11 +59,35 @@ public:
                 m_emailUsername = cfgValue;
             } else if (cfgOption == "emailPwd") {
                 m_emailPwd = cfgValue;
+            } else if (cfgOption == "socketPath") {
+                m_socketPath = cfgValue;
+            } else if (cfgOption == "configDir") {
+                m_configDir = cfgValue;
+            } else {
+                // unknown entry, just don't do anything
+            }
+        } else if constexpr (std::is_same_v<unsigned int, T>) {
+            if (cfgOption == "numThreads") {
+                m_numThreads = cfgValue;
+            } else if (cfgOption == "numSolutions") {
+                m_numSolutions = cfgValue;
+            } else if (cfgOption == "numSmtpConnections") {
+                m_numSmtpConnections = cfgValue;
+            } else if (cfgOption == "historyYears") {
+                m_historyYears = cfgValue;
+            } else if (cfgOption == "penaltyYears") {
+                m_penaltyYears = cfgValue;
+            } else if (cfgOption == "timeBudget") {
+                m_timeBudget = cfgValue;
+            } else if (cfgOption == "numGifts") {
+                m_numGifts = cfgValue;
+            } else if (cfgOption == "minCycleLength") {
+                m_minCycleLength = cfgValue;
             } else {
                 // unknown entry, just don't do anything
             }
         } else {
-            dbg << "Unknown configuration option " << cfgOption << std::endl;
+            LOG(debug) << "Unknown configuration option " << cfgOption;
         }
     }
 
@@ -62,8 +96,23 @@ public:
     std::string const& getSmtpServer() const;
     std::string const& getEmailUsername() const;
     std::string const& getEmailPwd() const;
+    std::string const& getAlgorithm() const;
+    std::string const& getStatsFormat() const;
+    std::string const& getSocketPath() const;
+    std::string const& getConfigDir() const;
+    unsigned int getNumThreads() const;
+    unsigned int getNumSolutions() const;
+    unsigned int getNumSmtpConnections() const;
+    unsigned int getHistoryYears() const;
+    unsigned int getPenaltyYears() const;
+    unsigned int getTimeBudget() const;
+    unsigned int getNumGifts() const;
+    unsigned int getMinCycleLength() const;
     bool useEmails() const;
-    bool useRandomAlgo() const;
+    bool useCache() const;
+    bool deliverOnly() const;
+    bool countOnly() const;
+    bool allowPlaintextAuth() const;
 
 private:
     std::string m_inputFilename{};
@@ -71,7 +120,36 @@ private:
     std::string m_smtpServer{};
     std::string m_emailUsername{};
     std::string m_emailPwd{};
+    std::string m_algorithm{"auto"};
+    // empty: no solver statistics, otherwise "text" or "json"
+    std::string m_statsFormat{};
+    // serve requests on this UNIX domain socket instead of solving once
+    std::string m_socketPath{};
+    // the daemon only serves the configuration files inside this directory
+    // (empty: the working directory)
+    std::string m_configDir{};
+    unsigned int m_numThreads{1};
+    unsigned int m_numSolutions{1};
+    // number of simultaneous connections to the SMTP server
+    unsigned int m_numSmtpConnections{4};
+    // exclude the giftees of this many past years (from the history file)
+    unsigned int m_historyYears{0};
+    // penalize the giftees of this many past years (from the history file)
+    unsigned int m_penaltyYears{0};
+    // seconds the optimization may take (0: no limit)
+    unsigned int m_timeBudget{10};
+    // gifts every person gives and receives
+    unsigned int m_numGifts{1};
+    // smallest circle allowed if several circles are allowed
+    unsigned int m_minCycleLength{2};
     bool m_useEmails{false};
-    bool m_useRandomAlgo{false};
+    // use (and write) the compiled form of the configuration file
+    bool m_useCache{true};
+    // only deliver the emails left in the spool, don't construct a list
+    bool m_deliverOnly{false};
+    // only count the valid lists, don't construct one
+    bool m_countOnly{false};
+    // log in to an SMTP server which doesn't offer encryption
+    bool m_allowPlaintextAuth{false};
 };
 }  // namespace config
@@ -0,0 +1,205 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "constraints.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+#include "arena.h"
+#include "log.h"
+
+namespace
+{
+// throws std::invalid_argument unless the IDs of the people are 0..n-1 (each
+// one once) and the blocked and penalized giftees are among them
+void checkIds(const std::vector<Person>& people);
+
+// sets the first n bits of the row, except for bit "self"
+void fillRow(bitset::Word* row, std::size_t n, PersonId self);
+
+void checkIds(const std::vector<Person>& people)
+{
+    const auto n = people.size();
+    auto invalid = [](const Person& p, const std::string& what) {
+        return std::invalid_argument(std::string(p.name) + " (ID " +
+                                     std::to_string(p.id) + "): " + what);
+    };
+
+    std::vector<bool> seen(n, false);
+    for (const auto& p : people) {
+        if (p.id >= n) {
+            throw invalid(p, "ID out of range (" + std::to_string(n) +
+                                 " people)");
+        }
+        if (seen[p.id]) {
+            throw invalid(p, "ID used twice");
+        }
+        seen[p.id] = true;
+
+        for (const auto b : p.blocked) {
+            if (b >= n) {
+                throw invalid(p, "blocked ID " + std::to_string(b) +
+                                     " out of range");
+            }
+        }
+        for (const auto& penalty : p.penalties) {
+            if (penalty.giftee >= n) {
+                throw invalid(p, "penalized ID " +
+                                     std::to_string(penalty.giftee) +
+                                     " out of range");
+            }
+        }
+    }
+}
+
+void fillRow(bitset::Word* row, std::size_t n, PersonId self)
+{
+    const auto words = bitset::numWords(n);
+    std::fill(row, row + words, ~bitset::Word{0});
+    if (n % bitset::wordBits != 0) {
+        row[words - 1] = (bitset::Word{1} << (n % bitset::wordBits)) - 1;
+    }
+    bitset::reset(row, self);
+}
+}  // namespace
+
+namespace constraints
+{
+ConstraintModel::ConstraintModel(const std::vector<Person>& people)
+    : m_numWords(bitset::numWords(people.size())),
+      m_names(people.size()),
+      m_giftees(people.size() * m_numWords, 0),
+      m_donors(people.size() * m_numWords, 0),
+      m_numGiftees(people.size(), 0),
+      m_numDonors(people.size(), 0),
+      m_penalties(people.size())
+{
+    const auto n = people.size();
+    checkIds(people);
+
+    for (const auto& p : people) {
+        // the people might not be kept around as long as the model
+        m_names[p.id] = arena::intern(p.name);
+    }
+
+    // start with "everyone may give to everyone else" (in both matrices) and
+    // clear the blocked entries afterwards
+    for (PersonId i = 0; i < n; ++i) {
+        fillRow(m_giftees.data() + i * m_numWords, n, i);
+        fillRow(m_donors.data() + i * m_numWords, n, i);
+    }
+
+    for (const auto& p : people) {
+        auto* row = m_giftees.data() + p.id * m_numWords;
+        for (const auto b : p.blocked) {
+            bitset::reset(row, b);
+            bitset::reset(m_donors.data() + b * m_numWords, p.id);
+        }
+    }
+
+    for (const auto& p : people) {
+        for (const auto& penalty : p.penalties) {
+            addPenalty(p.id, penalty.giftee, penalty.weight);
+        }
+    }
+
+    for (PersonId i = 0; i < n; ++i) {
+        m_numGiftees[i] = static_cast<unsigned int>(
+            bitset::popcount(gifteesOf(i), m_numWords));
+        m_numDonors[i] = static_cast<unsigned int>(
+            bitset::popcount(donorsOf(i), m_numWords));
+    }
+
+    LOG(debug) << "constraint model compiled (" << n << " people, "
+               << bitset::kernelName() << " kernels)";
+}
+
+bool ConstraintModel::block(PersonId donor, PersonId giftee)
+{
+    if (!allowed(donor, giftee)) {
+        return false;
+    }
+
+    bitset::reset(m_giftees.data() + donor * m_numWords, giftee);
+    bitset::reset(m_donors.data() + giftee * m_numWords, donor);
+    --m_numGiftees[donor];
+    --m_numDonors[giftee];
+    return true;
+}
+
+void ConstraintModel::addPenalty(PersonId donor, PersonId giftee,
+                                 unsigned int weight)
+{
+    if (donor == giftee || weight == 0) {
+        return;
+    }
+
+    auto& penalties = m_penalties[donor];
+    const auto it = std::find_if(
+        penalties.begin(), penalties.end(),
+        [giftee](const Penalty& p) { return p.giftee == giftee; });
+    if (it != penalties.end()) {
+        it->weight += weight;
+    } else {
+        penalties.push_back({giftee, weight});
+        ++m_numPenalties;
+    }
+}
+
+unsigned int ConstraintModel::penalty(PersonId donor, PersonId giftee) const
+{
+    for (const auto& p : m_penalties[donor]) {
+        if (p.giftee == giftee) {
+            return p.weight;
+        }
+    }
+    return 0;
+}
+
+std::uint64_t totalPenalty(const ConstraintModel& model,
+                           const std::vector<PersonId>& cycle)
+{
+    std::uint64_t total{0};
+    for (std::size_t i = 0; i < cycle.size(); ++i) {
+        total += model.penalty(cycle[i], cycle[(i + 1) % cycle.size()]);
+    }
+    return total;
+}
+
+std::vector<PersonId> identityOrder(const ConstraintModel& model)
+{
+    std::vector<PersonId> order(model.size());
+    std::iota(order.begin(), order.end(), PersonId{0});
+    return order;
+}
+
+void applyOrder(std::vector<Person>& giftList,
+                const std::vector<PersonId>& order)
+{
+    std::vector<Person> byId(giftList.size());
+    for (auto& p : giftList) {
+        const auto id = p.id;
+        byId[id] = std::move(p);
+    }
+
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        giftList[i] = std::move(byId[order[i]]);
+    }
+}
+}  // namespace constraints
@@ -0,0 +1,118 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bitset.h"
+#include "person.h"
+
+namespace constraints
+{
+// compiled form of the participants' constraints. Every person is identified
+// by its dense ID (Person::id) and the "may give to" relation is stored as a
+// packed bit matrix: bit g in row d is set if d may be donor for giftee g. The
+// transposed matrix (bit d in row g) is kept as well such that the donors of a
+// giftee can be queried just as cheaply. Soft constraints (pairs which are
+// allowed but cost a penalty) are kept per donor.
+class ConstraintModel
+{
+public:
+    ConstraintModel() = default;
+
+    // builds the model from the parsed people. The IDs have to be 0..n-1
+    // (each one once) and the blocked and penalized giftees among them,
+    // otherwise std::invalid_argument is thrown.
+    explicit ConstraintModel(const std::vector<Person>& people);
+
+    std::size_t size() const { return m_names.size(); }
+    std::size_t numWords() const { return m_numWords; }
+
+    bool allowed(PersonId donor, PersonId giftee) const
+    {
+        return bitset::test(gifteesOf(donor), giftee);
+    }
+
+    // row of all allowed giftees of a donor
+    const bitset::Word* gifteesOf(PersonId donor) const
+    {
+        return m_giftees.data() + donor * m_numWords;
+    }
+
+    // row of all allowed donors of a giftee
+    const bitset::Word* donorsOf(PersonId giftee) const
+    {
+        return m_donors.data() + giftee * m_numWords;
+    }
+
+    unsigned int numGiftees(PersonId donor) const
+    {
+        return m_numGiftees[donor];
+    }
+    unsigned int numDonors(PersonId giftee) const
+    {
+        return m_numDonors[giftee];
+    }
+
+    // the name (interned, see arena::intern())
+    std::string_view name(PersonId id) const { return m_names[id]; }
+
+    // forbids the donor to give a gift to the giftee (in addition to the
+    // blocked giftees), returns false if it wasn't allowed anyway
+    bool block(PersonId donor, PersonId giftee);
+
+    // adds the weight to the penalty of the pair (the penalties of a pair add
+    // up)
+    void addPenalty(PersonId donor, PersonId giftee, unsigned int weight);
+
+    // the penalty of the pair, 0 if there's none
+    unsigned int penalty(PersonId donor, PersonId giftee) const;
+
+    // the penalized giftees of a donor
+    const std::vector<Penalty>& penaltiesOf(PersonId donor) const
+    {
+        return m_penalties[donor];
+    }
+
+    bool hasPenalties() const { return m_numPenalties > 0; }
+
+private:
+    std::size_t m_numWords{0};
+    std::vector<std::string_view> m_names{};
+    std::vector<bitset::Word> m_giftees{};
+    std::vector<bitset::Word> m_donors{};
+    std::vector<unsigned int> m_numGiftees{};
+    std::vector<unsigned int> m_numDonors{};
+    std::vector<std::vector<Penalty>> m_penalties{};
+    std::size_t m_numPenalties{0};
+};
+
+// the sum of the penalties of a list (the people's IDs in the order of the
+// circle)
+std::uint64_t totalPenalty(const ConstraintModel& model,
+                           const std::vector<PersonId>& cycle);
+
+// the identity order of all people in the model (0, 1, ..., n-1)
+std::vector<PersonId> identityOrder(const ConstraintModel& model);
+
+// re-arranges the people in giftList such that they're in the given order of
+// IDs (i.e. giftList[i].id == order[i] afterwards)
+void applyOrder(std::vector<Person>& giftList,
+                const std::vector<PersonId>& order);
+}  // namespace constraints
@@ -0,0 +1,588 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "counting.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <thread>
+
+#include "hamilton.h"
+#include "log.h"
+#include "threadpool.h"
+
+namespace
+{
+using constraints::ConstraintModel;
+using Clock = std::chrono::steady_clock;
+
+// set of people, bit i is person i + 1 (person 0 starts every path)
+using Mask = std::uint32_t;
+
+static_assert(counting::maxExactPeople <= 32, "people have to fit into a Mask");
+
+// the estimation stops once its relative standard error is below this (but
+// not before minSamples paths)
+constexpr double targetRelativeError{0.01};
+constexpr std::uint64_t minSamples{1000};
+constexpr std::uint64_t maxSamples{10000000};
+// paths per thread between two checks of the stop conditions
+constexpr std::uint64_t samplesPerBatch{64};
+
+// the Markov chain moves segments of up to this many people, and makes this
+// many steps per person
+constexpr std::size_t maxSegmentLength{3};
+constexpr std::size_t chainStepsPerPerson{1000};
+// the clock is checked every this many steps
+constexpr std::size_t deadlineCheckInterval{1024};
+
+constexpr double minusInfinity{-std::numeric_limits<double>::infinity()};
+
+// the counting table: entry s * (n - 1) + v is the number of paths starting
+// at person 0 which visit exactly the people in s and end at person v + 1
+class PathTable
+{
+public:
+    // fills the table, the sets of equal size are computed in parallel
+    PathTable(const ConstraintModel& model, unsigned int numThreads);
+
+    // the number of valid lists
+    std::uint64_t numLists() const;
+
+    // a valid list drawn uniformly (there has to be one)
+    std::vector<PersonId> sample(std::mt19937& gen) const;
+
+private:
+    std::uint64_t& at(Mask s, std::size_t v)
+    {
+        return m_table[s * m_others + v];
+    }
+    std::uint64_t at(Mask s, std::size_t v) const
+    {
+        return m_table[s * m_others + v];
+    }
+
+    // fills the entries of the sets of the given size in [from, to)
+    void fill(std::size_t size, Mask from, Mask to);
+
+    const ConstraintModel& m_model;
+    // the number of people besides person 0
+    const std::size_t m_others;
+    // the donors of every person (besides person 0)
+    std::vector<Mask> m_donors;
+    std::vector<std::uint64_t> m_table;
+};
+
+// running mean and variance of Knuth's estimates, which are kept as
+// logarithms (they easily exceed the range of a double) and summed relative to
+// the largest estimate
+class Estimate
+{
+public:
+    // adds an estimate given as its natural logarithm (minusInfinity for 0)
+    void add(double lnValue);
+
+    void merge(const Estimate& other);
+
+    std::uint64_t samples() const { return m_samples; }
+
+    // natural logarithm of the mean (minusInfinity if all estimates are 0)
+    double lnMean() const;
+
+    // standard error of the mean relative to the mean (infinity if all
+    // estimates are 0)
+    double relativeError() const;
+
+private:
+    // rescales the sums to a new largest estimate
+    void rescale(double lnMax);
+
+    std::uint64_t m_samples{0};
+    double m_lnMax{minusInfinity};
+    double m_sum{0.0};
+    double m_sumSq{0.0};
+};
+
+// a random path from person 0, taking a random allowed giftee in every step.
+// Returns the natural logarithm of the product of the numbers of choices if
+// the path is a valid list, otherwise minusInfinity.
+double randomPath(const ConstraintModel& model, std::mt19937& gen,
+                  std::vector<bitset::Word>& unvisited);
+
+// the index of the k-th (from 0) bit set in (a & b)
+std::size_t nthAnd(const bitset::Word* a, const bitset::Word* b,
+                   std::size_t words, std::size_t k);
+
+// Markov chain over the valid lists, the circle is stored as a doubly linked
+// list (the giftee and the donor of every person)
+class CircleChain
+{
+public:
+    CircleChain(const ConstraintModel& model,
+                const std::vector<PersonId>& cycle, std::mt19937& gen,
+                stats::SolverStats& stats);
+
+    // makes the given number of steps (or until the deadline)
+    void run(std::size_t steps, std::optional<Clock::time_point> deadline);
+
+    // the circle starting with person 0
+    std::vector<PersonId> cycle() const;
+
+private:
+    // proposes moving a random segment between two other people and makes
+    // the move if all new pairs are allowed
+    void step();
+
+    void link(PersonId donor, PersonId giftee)
+    {
+        m_giftee[donor] = giftee;
+        m_donor[giftee] = donor;
+    }
+
+    const ConstraintModel& m_model;
+    std::mt19937& m_gen;
+    stats::SolverStats& m_stats;
+    std::vector<PersonId> m_giftee;
+    std::vector<PersonId> m_donor;
+};
+
+PathTable::PathTable(const ConstraintModel& model, unsigned int numThreads)
+    : m_model(model),
+      m_others(model.size() - 1),
+      m_donors(m_others, 0),
+      m_table((std::size_t{1} << m_others) * m_others, 0)
+{
+    const Mask all = static_cast<Mask>((std::size_t{1} << m_others) - 1);
+    for (std::size_t v = 0; v < m_others; ++v) {
+        m_donors[v] =
+            static_cast<Mask>(model.donorsOf(static_cast<PersonId>(v + 1))[0] >>
+                              1) &
+            all;
+        if (model.allowed(0, static_cast<PersonId>(v + 1))) {
+            at(Mask{1} << v, v) = 1;
+        }
+    }
+
+    // the sets of one size only depend on the sets one smaller
+    const auto threads = threadpool::effectiveNumThreads(numThreads);
+    const std::size_t numSets = std::size_t{1} << m_others;
+    const std::size_t chunk =
+        std::max<std::size_t>(numSets / (threads * 8), 1024);
+    std::optional<threadpool::ThreadPool> pool;
+    if (threads > 1 && numSets > chunk) {
+        pool.emplace(threads);
+    }
+
+    for (std::size_t size = 2; size <= m_others; ++size) {
+        for (std::size_t from = 0; from < numSets; from += chunk) {
+            const auto to = static_cast<Mask>(std::min(from + chunk, numSets));
+            if (pool) {
+                pool->submit([this, size, from, to]() {
+                    fill(size, static_cast<Mask>(from), to);
+                });
+            } else {
+                fill(size, static_cast<Mask>(from), to);
+            }
+        }
+        if (pool) {
+            pool->wait();
+        }
+    }
+}
+
+void PathTable::fill(std::size_t size, Mask from, Mask to)
+{
+    for (Mask s = from; s < to; ++s) {
+        if (static_cast<std::size_t>(__builtin_popcount(s)) != size) {
+            continue;
+        }
+        for (Mask ends = s; ends; ends &= ends - 1) {
+            const auto v = static_cast<std::size_t>(__builtin_ctz(ends));
+            const Mask before = s & ~(Mask{1} << v);
+            std::uint64_t paths{0};
+            for (Mask d = m_donors[v] & before; d; d &= d - 1) {
+                paths += at(before, static_cast<std::size_t>(__builtin_ctz(d)));
+            }
+            at(s, v) = paths;
+        }
+    }
+}
+
+std::uint64_t PathTable::numLists() const
+{
+    const Mask all = static_cast<Mask>((std::size_t{1} << m_others) - 1);
+    std::uint64_t lists{0};
+    for (std::size_t v = 0; v < m_others; ++v) {
+        if (m_model.allowed(static_cast<PersonId>(v + 1), 0)) {
+            lists += at(all, v);
+        }
+    }
+    return lists;
+}
+
+std::vector<PersonId> PathTable::sample(std::mt19937& gen) const
+{
+    // walks back from the last person, every predecessor is chosen with a
+    // probability proportional to the number of paths through it
+    auto choose = [&gen](const std::vector<std::uint64_t>& weights) {
+        std::uint64_t total{0};
+        for (const auto w : weights) {
+            total += w;
+        }
+        std::uniform_int_distribution<std::uint64_t> udist(0, total - 1);
+        auto r = udist(gen);
+        std::size_t i = 0;
+        while (r >= weights[i]) {
+            r -= weights[i++];
+        }
+        return i;
+    };
+
+    Mask s = static_cast<Mask>((std::size_t{1} << m_others) - 1);
+    std::vector<std::uint64_t> weights(m_others);
+    for (std::size_t v = 0; v < m_others; ++v) {
+        weights[v] = m_model.allowed(static_cast<PersonId>(v + 1), 0)
+                         ? at(s, v)
+                         : 0;
+    }
+    auto v = choose(weights);
+
+    std::vector<PersonId> reversed{static_cast<PersonId>(v + 1)};
+    while (s != (Mask{1} << v)) {
+        s &= ~(Mask{1} << v);
+        for (std::size_t u = 0; u < m_others; ++u) {
+            weights[u] = (m_donors[v] & s & (Mask{1} << u)) ? at(s, u) : 0;
+        }
+        v = choose(weights);
+        reversed.push_back(static_cast<PersonId>(v + 1));
+    }
+
+    std::vector<PersonId> cycle{0};
+    cycle.insert(cycle.end(), reversed.rbegin(), reversed.rend());
+    return cycle;
+}
+
+void Estimate::add(double lnValue)
+{
+    ++m_samples;
+    if (lnValue == minusInfinity) {
+        return;
+    }
+    if (lnValue > m_lnMax) {
+        rescale(lnValue);
+    }
+    const double x = std::exp(lnValue - m_lnMax);
+    m_sum += x;
+    m_sumSq += x * x;
+}
+
+void Estimate::merge(const Estimate& other)
+{
+    if (other.m_lnMax > m_lnMax) {
+        rescale(other.m_lnMax);
+    }
+    if (other.m_lnMax != minusInfinity) {
+        const double f = std::exp(other.m_lnMax - m_lnMax);
+        m_sum += other.m_sum * f;
+        m_sumSq += other.m_sumSq * f * f;
+    }
+    m_samples += other.m_samples;
+}
+
+double Estimate::lnMean() const
+{
+    if (m_sum == 0.0) {
+        return minusInfinity;
+    }
+    return m_lnMax + std::log(m_sum / static_cast<double>(m_samples));
+}
+
+double Estimate::relativeError() const
+{
+    if (m_sum == 0.0) {
+        return std::numeric_limits<double>::infinity();
+    }
+    const auto n = static_cast<double>(m_samples);
+    const double mean = m_sum / n;
+    const double variance = std::max(m_sumSq / n - mean * mean, 0.0);
+    return std::sqrt(variance / n) / mean;
+}
+
+void Estimate::rescale(double lnMax)
+{
+    if (m_lnMax != minusInfinity) {
+        const double f = std::exp(m_lnMax - lnMax);
+        m_sum *= f;
+        m_sumSq *= f * f;
+    }
+    m_lnMax = lnMax;
+}
+
+double randomPath(const ConstraintModel& model, std::mt19937& gen,
+                  std::vector<bitset::Word>& unvisited)
+{
+    const auto n = model.size();
+    const auto words = model.numWords();
+    std::fill(unvisited.begin(), unvisited.end(), 0);
+    for (PersonId i = 1; i < n; ++i) {
+        bitset::set(unvisited.data(), i);
+    }
+
+    double lnValue{0.0};
+    PersonId tail{0};
+    for (std::size_t k = 1; k < n; ++k) {
+        const auto* row = model.gifteesOf(tail);
+        const auto choices = bitset::andPopcount(row, unvisited.data(), words);
+        if (choices == 0) {
+            return minusInfinity;
+        }
+        std::uniform_int_distribution<std::size_t> idist(0, choices - 1);
+        tail = static_cast<PersonId>(
+            nthAnd(row, unvisited.data(), words, idist(gen)));
+        bitset::reset(unvisited.data(), tail);
+        lnValue += std::log(static_cast<double>(choices));
+    }
+    return model.allowed(tail, 0) ? lnValue : minusInfinity;
+}
+
+std::size_t nthAnd(const bitset::Word* a, const bitset::Word* b,
+                   std::size_t words, std::size_t k)
+{
+    for (std::size_t i = 0; i < words; ++i) {
+        auto w = a[i] & b[i];
+        const auto bits = static_cast<std::size_t>(__builtin_popcountll(w));
+        if (k >= bits) {
+            k -= bits;
+            continue;
+        }
+        for (; k > 0; --k) {
+            w &= w - 1;
+        }
+        return i * bitset::wordBits +
+               static_cast<std::size_t>(__builtin_ctzll(w));
+    }
+    return bitset::npos;
+}
+
+CircleChain::CircleChain(const ConstraintModel& model,
+                         const std::vector<PersonId>& cycle,
+                         std::mt19937& gen, stats::SolverStats& stats)
+    : m_model(model),
+      m_gen(gen),
+      m_stats(stats),
+      m_giftee(cycle.size()),
+      m_donor(cycle.size())
+{
+    for (std::size_t i = 0; i < cycle.size(); ++i) {
+        link(cycle[i], cycle[(i + 1) % cycle.size()]);
+    }
+}
+
+void CircleChain::run(std::size_t steps,
+                      std::optional<Clock::time_point> deadline)
+{
+    for (std::size_t i = 0; i < steps; ++i) {
+        if (deadline && i % deadlineCheckInterval == 0 &&
+            Clock::now() > *deadline) {
+            LOG(info) << "time budget used up after " << i
+                      << " steps of the Markov chain";
+            break;
+        }
+        step();
+    }
+}
+
+std::vector<PersonId> CircleChain::cycle() const
+{
+    std::vector<PersonId> cycle;
+    cycle.reserve(m_giftee.size());
+    PersonId p{0};
+    do {
+        cycle.push_back(p);
+        p = m_giftee[p];
+    } while (p != 0);
+    return cycle;
+}
+
+void CircleChain::step()
+{
+    // the segment first ... last is moved between x and its giftee. Every
+    // segment and every insertion point is equally likely, so the reverse
+    // move (back between before and after) is as likely as this one.
+    const auto n = m_giftee.size();
+    std::uniform_int_distribution<PersonId> idist(0,
+                                                  static_cast<PersonId>(n - 1));
+    std::uniform_int_distribution<std::size_t> ldist(
+        1, std::min(maxSegmentLength, n - 3));
+
+    ++m_stats.swapsTried;
+    const PersonId first = idist(m_gen);
+    const auto length = ldist(m_gen);
+    const PersonId x = idist(m_gen);
+
+    PersonId last = first;
+    bool inSegment = x == first;
+    for (std::size_t k = 1; k < length; ++k) {
+        last = m_giftee[last];
+        inSegment |= x == last;
+    }
+    const PersonId before = m_donor[first];
+    const PersonId after = m_giftee[last];
+    const PersonId y = m_giftee[x];
+    if (inSegment || x == before || !m_model.allowed(before, after) ||
+        !m_model.allowed(x, first) || !m_model.allowed(last, y)) {
+        m_stats.reject(first);
+        return;
+    }
+
+    link(before, after);
+    link(x, first);
+    link(last, y);
+    ++m_stats.swapsAccepted;
+}
+}  // namespace
+
+namespace counting
+{
+Count countLists(const ConstraintModel& model, unsigned int numThreads,
+                 double timeBudgetSec)
+{
+    const auto n = model.size();
+    Count count;
+    if (n < 2) {
+        count.exact = true;
+        count.log10Count = minusInfinity;
+        count.log10Fraction = minusInfinity;
+        return count;
+    }
+
+    // all circles of n people (with a fixed first person)
+    const double log10AllLists = std::lgamma(static_cast<double>(n)) /
+                                 std::log(10.0);
+
+    if (n <= maxExactPeople) {
+        const PathTable table(model, numThreads);
+        count.exact = true;
+        count.value = table.numLists();
+        count.log10Count = count.value > 0
+                               ? std::log10(static_cast<double>(count.value))
+                               : minusInfinity;
+        count.log10Fraction = count.log10Count - log10AllLists;
+        return count;
+    }
+
+    std::optional<Clock::time_point> deadline;
+    if (timeBudgetSec > 0) {
+        deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                      std::chrono::duration<double>(
+                                          timeBudgetSec));
+    }
+
+    // every thread adds its paths in batches and checks whether to stop
+    Estimate total;
+    std::mutex mtx;
+    std::atomic<bool> stop{false};
+    std::random_device rd;
+    auto sampler = [&](std::uint32_t seed) {
+        std::mt19937 gen(seed);
+        std::vector<bitset::Word> unvisited(model.numWords());
+        while (!stop) {
+            Estimate batch;
+            for (std::uint64_t i = 0; i < samplesPerBatch; ++i) {
+                batch.add(randomPath(model, gen, unvisited));
+            }
+
+            std::lock_guard<std::mutex> lock(mtx);
+            total.merge(batch);
+            if (total.samples() >= maxSamples ||
+                (deadline && Clock::now() > *deadline) ||
+                (total.samples() >= minSamples &&
+                 total.relativeError() < targetRelativeError)) {
+                stop = true;
+            }
+        }
+    };
+
+    const auto threads = threadpool::effectiveNumThreads(numThreads);
+    std::vector<std::thread> workers;
+    for (unsigned int t = 1; t < threads; ++t) {
+        workers.emplace_back(sampler, rd());
+    }
+    sampler(rd());
+    for (auto& w : workers) {
+        w.join();
+    }
+
+    count.samples = total.samples();
+    count.log10Count = total.lnMean() / std::log(10.0);
+    count.log10Fraction = count.log10Count - log10AllLists;
+    count.relativeError = total.relativeError();
+    LOG(debug) << "number of lists estimated from " << count.samples
+               << " random paths";
+    return count;
+}
+}  // namespace counting
+
+bool findUniformList(std::vector<PersonId>& cycle,
+                     const ConstraintModel& model, unsigned int numThreads,
+                     double timeBudgetSec, stats::SolverStats* stats)
+{
+    stats::SolverStats localStats;
+    auto& st = stats ? *stats : localStats;
+
+    const auto n = model.size();
+    if (n < 2) {
+        return false;
+    }
+
+    std::random_device rd;
+    std::mt19937 gen(rd());
+
+    if (n <= counting::maxExactPeople) {
+        const PathTable table(model, numThreads);
+        if (table.numLists() == 0) {
+            return false;
+        }
+        cycle = table.sample(gen);
+        st.solutionFound();
+        return true;
+    }
+
+    // the chain starts at any valid list
+    std::vector<PersonId> start;
+    if (!findValidListPruned(start, model, &st)) {
+        return false;
+    }
+
+    std::optional<Clock::time_point> deadline;
+    if (timeBudgetSec > 0) {
+        deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                      std::chrono::duration<double>(
+                                          timeBudgetSec));
+    }
+
+    CircleChain chain(model, start, gen, st);
+    chain.run(n * chainStepsPerPerson, deadline);
+    cycle = chain.cycle();
+    LOG(debug) << st.swapsAccepted << " of " << st.swapsTried
+               << " moves of the Markov chain made";
+    return true;
+}
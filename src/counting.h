@@ -0,0 +1,73 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "constraints.h"
+#include "person.h"
+#include "stats.h"
+
+// the number of valid donor->giftee lists, and lists drawn uniformly from all
+// of them
+namespace counting
+{
+// largest number of people counted exactly: the table has 2^(n-1) * (n-1)
+// entries of 64bit (80MB for 20 people), and (n-1)! lists still fit
+constexpr std::size_t maxExactPeople{20};
+
+struct Count {
+    // the count is exact, otherwise it's estimated
+    bool exact{false};
+    // the number of valid lists (if exact)
+    std::uint64_t value{0};
+    // log10 of the number of valid lists (-infinity if there's none)
+    double log10Count{0.0};
+    // log10 of the fraction of all circles of the people which are valid
+    // (0: no constraints at all, the smaller the more constrained)
+    double log10Fraction{0.0};
+    // relative standard error of the estimate (0 if exact)
+    double relativeError{0.0};
+    // random paths the estimate is based on
+    std::uint64_t samples{0};
+};
+
+// counts the valid lists: exactly by dynamic programming over the subsets of
+// people for up to maxExactPeople people (the sets of equal size are computed
+// in parallel on numThreads threads, 0: one per CPU core), otherwise
+// estimated by random paths (Knuth's estimator: a path takes a random allowed
+// giftee at every step, and the product of the numbers of choices is an
+// unbiased estimate of the number of lists). The estimation stops after
+// timeBudgetSec seconds (0: no limit) or once it's accurate to 1%.
+Count countLists(const constraints::ConstraintModel& model,
+                 unsigned int numThreads, double timeBudgetSec);
+}  // namespace counting
+
+// find a valid donor->giftee list drawn uniformly from all valid lists. For up
+// to counting::maxExactPeople people exactly (the list is built backwards from
+// the counting table, every step weighted by the number of completions),
+// otherwise nearly uniformly by a Markov chain: starting at a list found by
+// the pruned search, segments of people are moved between two others (if the
+// new pairs are allowed) for a number of steps per person or until
+// timeBudgetSec seconds are used up. Every valid move is as likely as its
+// reverse, so the chain converges to the uniform distribution over the lists
+// it can reach.
+bool findUniformList(std::vector<PersonId>& cycle,
+                     const constraints::ConstraintModel& model,
+                     unsigned int numThreads, double timeBudgetSec,
+                     stats::SolverStats* stats = nullptr);
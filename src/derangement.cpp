@@ -0,0 +1,251 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "derangement.h"
+
+#include <algorithm>
+#include <random>
+
+#include "log.h"
+#include "matching.h"
+
+namespace
+{
+using constraints::ConstraintModel;
+
+// switches tried per person by the random walk
+constexpr std::size_t switchesPerPerson{8};
+
+// the circles are merged into different ones after another random walk if a
+// circle couldn't be merged
+constexpr unsigned int maxAttempts{4};
+
+class Derangement
+{
+public:
+    Derangement(const ConstraintModel& model, std::vector<PersonId> gifteeOf,
+                std::mt19937& gen, stats::SolverStats& stats);
+
+    // random walk of switches, starting at the matching
+    void shuffle();
+
+    // merges every circle shorter than minLength people with other circles,
+    // returns false if a circle couldn't be merged
+    bool mergeShortCircles(unsigned int minLength);
+
+    // the circles, each one starting with its lowest ID
+    std::vector<std::vector<PersonId>> circles() const;
+
+private:
+    // the donors exchange their giftees
+    void exchange(PersonId a, PersonId b);
+
+    // the circle (the representative of the merged circles) of a person
+    std::size_t circleOf(PersonId p);
+
+    // merges the circle of p with any other circle, false if no switch
+    // between them is allowed
+    bool mergeCircle(PersonId p);
+
+    const ConstraintModel& m_model;
+    std::mt19937& m_gen;
+    stats::SolverStats& m_stats;
+    std::vector<PersonId> m_gifteeOf;
+    std::vector<PersonId> m_donorOf;
+    // the circle every person was in after the random walk, merged circles
+    // are joined in a union-find forest
+    std::vector<std::size_t> m_circle{};
+    std::vector<std::size_t> m_parent{};
+    std::vector<std::size_t> m_size{};
+};
+
+Derangement::Derangement(const ConstraintModel& model,
+                         std::vector<PersonId> gifteeOf, std::mt19937& gen,
+                         stats::SolverStats& stats)
+    : m_model(model),
+      m_gen(gen),
+      m_stats(stats),
+      m_gifteeOf(std::move(gifteeOf)),
+      m_donorOf(m_gifteeOf.size())
+{
+    for (PersonId d = 0; d < m_gifteeOf.size(); ++d) {
+        m_donorOf[m_gifteeOf[d]] = d;
+    }
+}
+
+void Derangement::shuffle()
+{
+    const auto n = m_gifteeOf.size();
+    std::uniform_int_distribution<PersonId> pick(
+        0, static_cast<PersonId>(n - 1));
+    for (std::size_t i = 0; i < n * switchesPerPerson; ++i) {
+        const auto a = pick(m_gen);
+        const auto b = pick(m_gen);
+        ++m_stats.swapsTried;
+        if (a != b && m_model.allowed(a, m_gifteeOf[b]) &&
+            m_model.allowed(b, m_gifteeOf[a])) {
+            exchange(a, b);
+            ++m_stats.swapsAccepted;
+        }
+    }
+}
+
+bool Derangement::mergeShortCircles(unsigned int minLength)
+{
+    const auto n = m_gifteeOf.size();
+    m_circle.assign(n, n);
+    m_parent.clear();
+    m_size.clear();
+    for (PersonId p = 0; p < n; ++p) {
+        if (m_circle[p] != n) {
+            continue;
+        }
+        const auto c = m_parent.size();
+        m_parent.push_back(c);
+        m_size.push_back(0);
+        for (auto q = p; m_circle[q] == n; q = m_gifteeOf[q]) {
+            m_circle[q] = c;
+            ++m_size[c];
+        }
+    }
+    LOG(debug) << m_parent.size() << " circles after the random walk";
+
+    for (PersonId p = 0; p < n; ++p) {
+        while (m_size[circleOf(p)] < minLength) {
+            if (!mergeCircle(p)) {
+                LOG(debug) << "the circle of " << m_model.name(p)
+                           << " can't be merged with another one";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+std::vector<std::vector<PersonId>> Derangement::circles() const
+{
+    std::vector<std::vector<PersonId>> circles;
+    std::vector<bool> seen(m_gifteeOf.size(), false);
+    for (PersonId p = 0; p < m_gifteeOf.size(); ++p) {
+        if (seen[p]) {
+            continue;
+        }
+        circles.emplace_back();
+        for (auto q = p; !seen[q]; q = m_gifteeOf[q]) {
+            seen[q] = true;
+            circles.back().push_back(q);
+        }
+    }
+    return circles;
+}
+
+void Derangement::exchange(PersonId a, PersonId b)
+{
+    std::swap(m_gifteeOf[a], m_gifteeOf[b]);
+    m_donorOf[m_gifteeOf[a]] = a;
+    m_donorOf[m_gifteeOf[b]] = b;
+}
+
+std::size_t Derangement::circleOf(PersonId p)
+{
+    auto c = m_circle[p];
+    while (m_parent[c] != c) {
+        m_parent[c] = m_parent[m_parent[c]];
+        c = m_parent[c];
+    }
+    return c;
+}
+
+bool Derangement::mergeCircle(PersonId p)
+{
+    // a (in the circle) and b (in another one) exchange their giftees, which
+    // joins the two circles: a -> giftee of b -> ... -> b -> giftee of a
+    const auto words = m_model.numWords();
+    const auto circle = circleOf(p);
+    std::uniform_int_distribution<std::size_t> start(0, m_gifteeOf.size() - 1);
+
+    auto a = p;
+    do {
+        const auto* row = m_model.gifteesOf(a);
+        const auto from = start(m_gen);
+        auto tryGiftee = [&](std::size_t g) {
+            const auto b = m_donorOf[g];
+            const auto other = circleOf(b);
+            if (other == circle || !m_model.allowed(b, m_gifteeOf[a])) {
+                return false;
+            }
+            exchange(a, b);
+            m_parent[other] = circle;
+            m_size[circle] += m_size[other];
+            ++m_stats.swapsAccepted;
+            return true;
+        };
+
+        // the giftees from a random position on, wrapping around
+        for (auto g = bitset::findNext(row, words, from); g != bitset::npos;
+             g = bitset::findNext(row, words, g + 1)) {
+            if (tryGiftee(g)) {
+                return true;
+            }
+        }
+        for (auto g = bitset::findNext(row, words, 0);
+             g != bitset::npos && g < from;
+             g = bitset::findNext(row, words, g + 1)) {
+            if (tryGiftee(g)) {
+                return true;
+            }
+        }
+
+        a = m_gifteeOf[a];
+    } while (a != p);
+
+    return false;
+}
+}  // namespace
+
+bool findDerangement(std::vector<std::vector<PersonId>>& circles,
+                     const ConstraintModel& model, unsigned int minCycleLength,
+                     stats::SolverStats* stats)
+{
+    stats::SolverStats localStats;
+    auto& st = stats ? *stats : localStats;
+
+    if (model.size() < 2) {
+        return false;
+    }
+
+    std::random_device rd;
+    std::mt19937 gen(rd());
+
+    const auto gifteeOf = matching::randomMatching(model, gen);
+    if (std::find(gifteeOf.cbegin(), gifteeOf.cend(), matching::unmatched) !=
+        gifteeOf.cend()) {
+        LOG(debug) << "no perfect matching of donors to giftees";
+        return false;
+    }
+
+    for (unsigned int attempt = 0; attempt < maxAttempts; ++attempt) {
+        Derangement derangement(model, gifteeOf, gen, st);
+        derangement.shuffle();
+        if (derangement.mergeShortCircles(minCycleLength)) {
+            circles = derangement.circles();
+            st.solutionFound();
+            LOG(debug) << "assignment with " << circles.size()
+                       << " circles found";
+            return true;
+        }
+    }
+    return false;
+}
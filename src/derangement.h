@@ -0,0 +1,37 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+#pragma once
+
+#include <vector>
+
+#include "constraints.h"
+#include "person.h"
+#include "stats.h"
+
+// find a valid donor->giftee assignment which may consist of several smaller
+// circles, each one returned as the people's IDs in the order of the circle.
+// Such an assignment is a perfect matching of donors to giftees, found in
+// polynomial time (randomized Hopcroft-Karp, see matching.h) and shuffled by
+// a random walk of switches (two donors exchange their giftees if both may
+// give to the other one's giftee). Circles shorter than minCycleLength people
+// (e.g. 3 to rule out two people giving gifts to each other) are then merged
+// with other circles by such switches. Returns false if there's no perfect
+// matching or a short circle couldn't be merged with any other one (after a
+// few random walks).
+bool findDerangement(std::vector<std::vector<PersonId>>& circles,
+                     const constraints::ConstraintModel& model,
+                     unsigned int minCycleLength,
+                     stats::SolverStats* stats = nullptr);
@@ -0,0 +1,205 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "disjoint.h"
+
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <random>
+
+#include "hamilton.h"
+#include "log.h"
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+// the clock is checked every this many candidates
+constexpr std::uint64_t deadlineCheckInterval{1024};
+
+class JointSearch
+{
+public:
+    JointSearch(const constraints::ConstraintModel& model,
+                unsigned int numCycles, std::uint32_t seed,
+                double timeBudgetSec, stats::SolverStats& stats);
+
+    disjoint::Result run();
+
+    const std::vector<std::vector<PersonId>>& cycles() const
+    {
+        return m_cycles;
+    }
+
+private:
+    // starts the list with the given index (the lists before it are fixed),
+    // returns true if it and all lists after it were found
+    bool startCycle(std::size_t index);
+
+    // tries all completions of the list's current path
+    bool branch(std::size_t index);
+
+    // true once the time budget is used up
+    bool outOfTime();
+
+    const std::size_t m_n;
+    // the model of every list: without the pairs of the lists before it
+    std::vector<constraints::ConstraintModel> m_models;
+    std::vector<hamilton::Search> m_searches{};
+    std::vector<std::vector<PersonId>> m_cycles;
+    std::mt19937 m_gen;
+    stats::SolverStats& m_stats;
+    std::optional<Clock::time_point> m_deadline{};
+    std::uint64_t m_numChecks{0};
+    bool m_stopped{false};
+};
+
+JointSearch::JointSearch(const constraints::ConstraintModel& model,
+                         unsigned int numCycles, std::uint32_t seed,
+                         double timeBudgetSec, stats::SolverStats& stats)
+    : m_n(model.size()),
+      m_models(numCycles, model),
+      m_cycles(numCycles),
+      m_gen(seed),
+      m_stats(stats)
+{
+    // the searches keep a reference to their model, which is filled in when
+    // the list is started
+    m_searches.reserve(numCycles);
+    for (const auto& m : m_models) {
+        m_searches.emplace_back(m, m_gen());
+    }
+
+    if (timeBudgetSec > 0) {
+        m_deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                        std::chrono::duration<double>(
+                                            timeBudgetSec));
+    }
+}
+
+disjoint::Result JointSearch::run()
+{
+    disjoint::Result result;
+    result.found = startCycle(0);
+    result.complete = !m_stopped;
+    return result;
+}
+
+bool JointSearch::startCycle(std::size_t index)
+{
+    if (index == m_models.size()) {
+        return true;
+    }
+
+    auto& model = m_models[index];
+    if (index > 0) {
+        model = m_models[index - 1];
+        const auto& before = m_cycles[index - 1];
+        for (std::size_t i = 0; i < before.size(); ++i) {
+            model.block(before[i], before[(i + 1) % before.size()]);
+        }
+    }
+
+    // everyone needs a giftee and a donor in this and every later list
+    const auto numLeft = static_cast<unsigned int>(m_models.size() - index);
+    for (PersonId i = 0; i < m_n; ++i) {
+        if (model.numGiftees(i) < numLeft || model.numDonors(i) < numLeft) {
+            m_stats.reject(i);
+            return false;
+        }
+    }
+
+    auto& search = m_searches[index];
+    return search.start(hamilton::mostConstrainedPerson(model, m_gen)) &&
+           branch(index);
+}
+
+bool JointSearch::branch(std::size_t index)
+{
+    auto& search = m_searches[index];
+    const auto& path = search.path();
+    const PersonId tail = path.back();
+
+    if (path.size() == m_n) {
+        if (!search.complete()) {
+            return false;
+        }
+        m_cycles[index] = path;
+        LOG(trace) << "list " << index + 1 << " of " << m_models.size()
+                   << " found";
+        return startCycle(index + 1);
+    }
+
+    for (const auto next : search.candidates()) {
+        if (outOfTime()) {
+            return false;
+        }
+
+        if (search.push(next)) {
+            ++m_stats.nodes;
+            m_stats.depth(index * m_n + path.size());
+            if (branch(index)) {
+                return true;
+            }
+            search.pop();
+            ++m_stats.backtracks;
+        } else {
+            m_stats.reject(tail);
+        }
+    }
+    return false;
+}
+
+bool JointSearch::outOfTime()
+{
+    if (m_deadline && ++m_numChecks % deadlineCheckInterval == 0 &&
+        Clock::now() > *m_deadline) {
+        LOG(info) << "time budget used up, stopping the search";
+        m_stopped = true;
+    }
+    return m_stopped;
+}
+}  // namespace
+
+disjoint::Result findDisjointLists(std::vector<std::vector<PersonId>>& cycles,
+                                   const constraints::ConstraintModel& model,
+                                   unsigned int numCycles,
+                                   double timeBudgetSec,
+                                   stats::SolverStats* stats)
+{
+    stats::SolverStats localStats;
+    auto& st = stats ? *stats : localStats;
+
+    disjoint::Result result;
+    if (model.size() < 2) {
+        // no circle possible
+        result.complete = true;
+        return result;
+    }
+
+    std::random_device rd;
+    JointSearch search(model, numCycles, rd(), timeBudgetSec, st);
+    result = search.run();
+    if (result.found) {
+        cycles = search.cycles();
+        st.solutionFound();
+    }
+    LOG(debug) << numCycles << " disjoint lists "
+               << (result.found ? "found" : "not found") << " after "
+               << st.nodes << " partial lists";
+
+    return result;
+}
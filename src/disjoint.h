@@ -0,0 +1,47 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+#pragma once
+
+#include <vector>
+
+#include "constraints.h"
+#include "person.h"
+#include "stats.h"
+
+// several gifts per person: lists which don't share a donor->giftee pair
+namespace disjoint
+{
+struct Result {
+    // all lists were found
+    bool found{false};
+    // the search was completed within the time budget: if nothing was found,
+    // there are no such lists
+    bool complete{false};
+};
+}  // namespace disjoint
+
+// find numCycles valid donor->giftee lists (see shuffle.h) at once, such that
+// nobody gives two gifts to the same person. The lists are searched jointly
+// by a pruned depth-first search (see hamilton::Search) per list, each one on
+// the model without the pairs of the lists before it: if a list can't be
+// completed, the search continues with the next alternative of the list
+// before it instead of starting all over. Every list prunes the subtree right
+// away if somebody is left with fewer options than lists still to come. The
+// search stops after timeBudgetSec seconds (0: no limit).
+disjoint::Result findDisjointLists(
+    std::vector<std::vector<PersonId>>& cycles,
+    const constraints::ConstraintModel& model, unsigned int numCycles,
+    double timeBudgetSec, stats::SolverStats* stats = nullptr);
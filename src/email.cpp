@@ -16,16 +16,62 @@
 
 #include "email.h"
 
-#include <quickmail.h>
-
+#include <cstdlib>
+#include <ctime>
 #include <iostream>
 #include <sstream>
 
 #include "guid.h"
-#include "output.h"
+#include "mappedfile.h"
+#include "smtp.h"
+#include "spool.h"
+
+namespace email
+{
+constexpr std::string_view msgSubject{"Ho Ho Ho!"};
+constexpr std::string_view msgSalutation{"Hallo"};
+constexpr std::string_view msgPart1{
+    "Ich freue mich, dass du mich auch dieses Jahr tatkräftig beim "
+    "Wichteln unterstützt. Deine Aufgabe bis Weihnachten: ein unvergessliches, "
+    "grandioses, lustiges und "
+    "nicht all zu teures Geschenk für"};
+// joins the last two of several giftees
+constexpr std::string_view msgAnd{"und"};
+constexpr std::string_view msgPart2{
+    "basteln/kaufen/bestellen/organisieren. "
+    "Viel Spass und Erfolg!\n\nDeine Familie Schweizer Wichtelfee"};
+}  // namespace email
 
 namespace
 {
+// the port of SMTPS, the connection is encrypted right from the start there
+constexpr unsigned int smtpsPort{465};
+
+// one spooled email
+struct Outgoing {
+    // the name of the file in the spool
+    std::string filename{};
+    std::string name{};
+};
+
+std::string_view getEmailAddrDomain(std::string_view const emailAddr);
+
+// the server settings, the address is given as "host" or "host:port" (the
+// connection is encrypted right away for the SMTPS port)
+smtp::Server smtpServer(config::Config const &cfg, std::string_view domain);
+
+// the email (header and body) for a donor
+std::string renderMessage(config::Config const &cfg, const Person &donor,
+                          const std::vector<const Person *> &giftees);
+
+// the value of a header field of the message (empty if it's missing)
+std::string_view headerValue(std::string_view message, std::string_view field);
+
+// reads a spooled email, fills in the sender and the recipient from the
+// header. Returns false if the file can't be read or the header is broken.
+bool loadOutgoing(const spool::Spool &spool, Outgoing &mail,
+                  smtp::Message &message);
+
 std::string_view getEmailAddrDomain(std::string_view const emailAddr)
 {
     auto posAtChar = emailAddr.find_first_of('@');
@@ -36,83 +82,267 @@ std::string_view getEmailAddrDomain(std::string_view const emailAddr)
     }
 }
 
-bool validEmailConfig(config::Config const &cfg)
+smtp::Server smtpServer(config::Config const &cfg, std::string_view domain)
 {
-    return not cfg.getEmailPwd().empty() && not cfg.getEmailSender().empty() &&
-           not cfg.getEmailUsername().empty() &&
-           not cfg.getSmtpServer().empty();
+    smtp::Server server;
+    server.host = cfg.getSmtpServer();
+    const auto colon = server.host.find(':');
+    if (colon != std::string::npos &&
+        server.host.find(':', colon + 1) == std::string::npos) {
+        server.port = static_cast<unsigned int>(
+            std::strtoul(server.host.c_str() + colon + 1, nullptr, 10));
+        server.host.resize(colon);
+    }
+    server.username = cfg.getEmailUsername();
+    server.password = cfg.getEmailPwd();
+    server.domain = domain;
+    server.implicitTls = server.port == smtpsPort;
+    server.allowPlaintextAuth = cfg.allowPlaintextAuth();
+    return server;
+}
+
+std::string renderMessage(config::Config const &cfg, const Person &donor,
+                          const std::vector<const Person *> &giftees)
+{
+    char date[64];
+    const auto now = std::time(nullptr);
+    std::tm local{};
+    localtime_r(&now, &local);
+    std::strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S %z", &local);
+
+    // the name is quoted (names may contain e.g. dots)
+    std::string quotedName;
+    for (const char c : donor.name) {
+        if (c == '"' || c == '\\') {
+            quotedName += '\\';
+        }
+        quotedName += c;
+    }
+
+    std::ostringstream ss;
+    ss << "From: " << cfg.getEmailSender() << "\n";
+    ss << "To: \"" << quotedName << "\" <" << donor.email.value() << ">\n";
+    ss << "Subject: " << email::msgSubject << "\n";
+    ss << "Date: " << date << "\n";
+    // Google needs a GUID in the email header's Message-ID
+    // (otherwise you have a good chance it's moved to Junk)
+    ss << "Message-ID: <" << guid::getGuidStr8_4_4_4_12() << "@"
+       << getEmailAddrDomain(cfg.getEmailSender()) << ">\n";
+    ss << "MIME-Version: 1.0\n";
+    ss << "Content-Type: text/plain; charset=UTF-8\n";
+    ss << "Content-Transfer-Encoding: 8bit\n";
+    ss << "\n";
+    ss << email::msgSalutation << " " << donor.name << ",\n\n";
+    ss << email::msgPart1;
+    for (std::size_t i = 0; i < giftees.size(); ++i) {
+        if (i > 0) {
+            ss << (i + 1 == giftees.size() ? " " + std::string(email::msgAnd)
+                                           : std::string(","));
+        }
+        ss << " " << giftees[i]->name;
+    }
+    ss << " ";
+    ss << email::msgPart2 << "\n";
+    return ss.str();
+}
+
+std::string_view headerValue(std::string_view message, std::string_view field)
+{
+    while (!message.empty()) {
+        const auto eol = message.find('\n');
+        auto line = message.substr(0, eol);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line.empty()) {
+            // end of the header
+            break;
+        }
+
+        if (line.size() > field.size() && line[field.size()] == ':' &&
+            line.substr(0, field.size()) == field) {
+            line.remove_prefix(field.size() + 1);
+            while (!line.empty() && line.front() == ' ') {
+                line.remove_prefix(1);
+            }
+            return line;
+        }
+
+        if (eol == std::string_view::npos) {
+            break;
+        }
+        message.remove_prefix(eol + 1);
+    }
+    return {};
+}
+
+bool loadOutgoing(const spool::Spool &spool, Outgoing &mail,
+                  smtp::Message &message)
+{
+    const io::MappedFile file(spool.path(mail.filename));
+    if (!file.ok()) {
+        return false;
+    }
+    message.data = file.data();
+
+    // the header was written by renderMessage(): "From: <address>" and
+    // "To: "<name>" <<address>>"
+    message.sender = headerValue(message.data, "From");
+    const auto to = headerValue(message.data, "To");
+    const auto open = to.rfind('<');
+    const auto close = to.rfind('>');
+    if (message.sender.empty() || open == std::string_view::npos ||
+        close == std::string_view::npos || close < open) {
+        return false;
+    }
+    message.recipient = to.substr(open + 1, close - open - 1);
+
+    auto name = to.substr(0, open);
+    while (!name.empty() && (name.back() == ' ' || name.back() == '"')) {
+        name.remove_suffix(1);
+    }
+    while (!name.empty() && name.front() == '"') {
+        name.remove_prefix(1);
+    }
+    for (std::size_t i = 0; i < name.size(); ++i) {
+        if (name[i] == '\\' && i + 1 < name.size()) {
+            ++i;
+        }
+        mail.name += name[i];
+    }
+    return true;
 }
 }  // namespace
 
 namespace email
 {
-constexpr std::string_view msgSubject{"Ho Ho Ho!"};
-constexpr std::string_view msgSalutation{"Hallo"};
-constexpr std::string_view msgPart1{
-    "Ich freue mich, dass du mich auch dieses Jahr tatkräftig beim "
-    "Wichteln unterstützt. Deine Aufgabe bis Weihnachten: ein unvergessliches, "
-    "grandioses, lustiges und "
-    "nicht all zu teures Geschenk für"};
-constexpr std::string_view msgPart2{
-    "basteln/kaufen/bestellen/organisieren. "
-    "Viel Spass und Erfolg!\n\nDeine Familie Schweizer Wichtelfee"};
+bool hasPendingEmails(config::Config const &cfg)
+{
+    const spool::Spool spool(spool::spoolDirname(cfg.getInputFilename()));
+    return not spool.pending().empty();
+}
 
-void sendEmails(std::vector<Person> &giftList, config::Config const &cfg)
+bool spoolEmails(std::vector<GiftList> const &giftLists,
+                 config::Config const &cfg)
 {
-    if (not cfg.useEmails()) {
-        // sending emails not commanded
-        return;
-    } else if (not validEmailConfig(cfg)) {
-        std::cerr << "Email configuration incomplete, not sending any email."
+    if (cfg.getEmailSender().empty()) {
+        std::cerr << "Email sender missing, not sending any email."
+                  << std::endl;
+        return false;
+    }
+
+    spool::Spool spool(spool::spoolDirname(cfg.getInputFilename()));
+    std::string error;
+    if (not spool.open(error)) {
+        std::cerr << error << std::endl;
+        return false;
+    }
+
+    for (const auto &giftList : giftLists) {
+        std::vector<const Person *> byId(giftList.people.size(), nullptr);
+        for (const auto &p : giftList.people) {
+            byId[p.id] = &p;
+        }
+
+        for (const auto &donor : giftList.people) {
+            std::vector<const Person *> giftees;
+            for (const auto g : giftList.giftees[donor.id]) {
+                giftees.push_back(byId[g]);
+            }
+            if (not spool.write(renderMessage(cfg, donor, giftees), error)) {
+                std::cerr << error << std::endl;
+                return false;
+            }
+        }
+    }
+
+    // only complete sets of emails are ever waiting for delivery
+    if (not spool.publish(error)) {
+        std::cerr << error << std::endl;
+        return false;
+    }
+
+    std::cout << "Emails written into " << spool.dir() << std::endl;
+    return true;
+}
+
+void deliverEmails(config::Config const &cfg)
+{
+    spool::Spool spool(spool::spoolDirname(cfg.getInputFilename()));
+    const auto pending = spool.pending();
+    if (pending.empty()) {
+        std::cout << "No emails waiting for delivery in " << spool.dir()
                   << std::endl;
         return;
+    } else if (cfg.getSmtpServer().empty()) {
+        std::cerr << "SMTP server missing, " << pending.size()
+                  << " emails left in " << spool.dir() << std::endl;
+        return;
+    }
+
+    std::vector<Outgoing> mails(pending.size());
+    std::vector<smtp::Message> messages(pending.size());
+    for (std::size_t i = 0; i < pending.size(); ++i) {
+        mails[i].filename = pending[i];
+        if (not loadOutgoing(spool, mails[i], messages[i])) {
+            mails[i].name = pending[i];
+            messages[i].error = "could not read " + spool.path(pending[i]);
+        }
     }
 
-    std::cout << "Sending emails ";
+    const auto server =
+        smtpServer(cfg, getEmailAddrDomain(messages.front().sender));
+    smtp::DeliveryOptions options;
+    options.numConnections = cfg.getNumSmtpConnections();
+
+    std::cout << "Sending emails " << std::flush;
 
-    // giftee iterator points one ahead
-    auto itGiftee = ++(giftList.begin());
+    // delivered emails are moved out of the way at once, such that a later
+    // run only sends the remaining ones
+    smtp::deliver(server, messages, options, [&](std::size_t i) {
+        const auto &message = messages[i];
+        std::string spoolError;
+        const bool moved =
+            message.error || spool.markDelivered(mails[i].filename, spoolError);
 
-    for (auto itDonor = giftList.begin(); itDonor != giftList.end();
-         ++itDonor) {
-        // wrap around the giftee (which always points one ahead)
-        if (itGiftee == giftList.end()) {
-            itGiftee = giftList.begin();
+        std::cout << (message.error ? "x" : ".") << std::flush;
+        if (not moved) {
+            std::cerr << "\n" << spoolError << std::endl;
         }
+    });
 
-        quickmail mailobj =
-            quickmail_create(cfg.getEmailSender().c_str(), msgSubject.data());
-        quickmail_add_to(mailobj, itDonor->email.value().c_str());
-        std::ostringstream ss;
-        ss << msgSalutation << " " << itDonor->name << ",\n\n";
-        ss << msgPart1 << " " << itGiftee->name << " ";
-        ss << msgPart2;
-        quickmail_set_body(mailobj, ss.str().c_str());
-
-        // Google needs a GUID in the email header's Message-ID
-        // (otherwise you have a good chance it's moved to Junk)
-        ss.str("");
-        ss.clear();
-        ss << "Message-ID: <" << guid::getGuidStr8_4_4_4_12() << "@"
-           << getEmailAddrDomain(cfg.getEmailSender()) << ">";
-        quickmail_add_header(mailobj, ss.str().c_str());
-
-        constexpr unsigned smtpport{25};
-        const char *emailSendResult = quickmail_send(
-            mailobj, cfg.getSmtpServer().c_str(), smtpport,
-            cfg.getEmailUsername().c_str(), cfg.getEmailPwd().c_str());
-
-        if (emailSendResult) {
-            std::cerr << "Could not send an email to " << itDonor->name << " ("
-                      << itDonor->email.value() << "): " << emailSendResult
-                      << std::endl;
-        } else {
-            std::cout << ".";
+    std::cout << " Done." << std::endl;
+
+    std::size_t numFailed{0};
+    for (const auto &message : messages) {
+        numFailed += message.error ? 1 : 0;
+    }
+
+    std::cout << messages.size() - numFailed << " emails delivered, "
+              << numFailed << " failed" << std::endl;
+    for (std::size_t i = 0; i < messages.size(); ++i) {
+        if (messages[i].error) {
+            std::cerr << "Could not send an email to " << mails[i].name
+                      << " (" << messages[i].recipient
+                      << "): " << *messages[i].error << std::endl;
         }
+    }
+    if (numFailed > 0) {
+        std::cerr << "The failed emails are left in " << spool.dir()
+                  << ", send them with -D" << std::endl;
+    }
+}
 
-        ++itGiftee;
+void sendEmails(std::vector<GiftList> const &giftLists,
+                config::Config const &cfg)
+{
+    if (not cfg.useEmails()) {
+        // sending emails not commanded
+        return;
     }
 
-    std::cout << " Done." << std::endl;
+    if (spoolEmails(giftLists, cfg)) {
+        deliverEmails(cfg);
+    }
 }
 }  // namespace email
@@ -21,7 +21,34 @@
 #include "config.h"
 #include "person.h"
 
+// the emails are first rendered into a spool next to the configuration file
+// (see spool.h) and then delivered from there. Delivered emails are moved out
+// of the way, such that an interrupted delivery can be resumed with
+// deliverEmails() without sending any email twice.
 namespace email
 {
-void sendEmails(std::vector<Person>& giftList, config::Config const& cfg);
-}
+// the people of a group with the giftees of every person (indexed by
+// Person::id, several if everyone gives several gifts)
+struct GiftList {
+    std::vector<Person> people{};
+    std::vector<std::vector<PersonId>> giftees{};
+};
+
+// true if the spool of the configuration file still contains undelivered
+// emails
+bool hasPendingEmails(config::Config const& cfg);
+
+// renders the emails for all donors of the gift lists (one per group) into
+// the spool, returns false if they couldn't be written (nothing is waiting
+// for delivery then)
+bool spoolEmails(std::vector<GiftList> const& giftLists,
+                 config::Config const& cfg);
+
+// sends the emails waiting in the spool and reports the failed ones (which
+// stay in the spool)
+void deliverEmails(config::Config const& cfg);
+
+// spools and delivers the emails (if sending them is commanded)
+void sendEmails(std::vector<GiftList> const& giftLists,
+                config::Config const& cfg);
+}  // namespace email
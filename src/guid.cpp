@@ -18,6 +18,7 @@
 
 #include <uuid/uuid.h>
 
+#include <array>
 #include <iomanip>
 #include <sstream>
 #include <type_traits>
@@ -0,0 +1,338 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "hamilton.h"
+
+#include <algorithm>
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+// the clock is read once per this many steps of the search
+constexpr std::uint64_t deadlineCheckInterval{1024};
+
+// the reachability check costs O(remaining people * words), it's therefore
+// only done on every path extension if this product is small. On larger
+// instances it's done every few levels only.
+constexpr std::size_t connectivityBudget{1U << 16};
+constexpr std::size_t connectivityInterval{32};
+}  // namespace
+
+namespace hamilton
+{
+Search::Search(const constraints::ConstraintModel& model, std::uint32_t seed)
+    : m_model(model),
+      m_gen(seed),
+      m_unvisited(model.numWords(), 0),
+      m_numFreeGiftees(model.size(), 0),
+      m_numFreeDonors(model.size(), 0),
+      m_seen(model.numWords(), 0)
+{
+}
+
+bool Search::start(PersonId first)
+{
+    const auto n = m_model.size();
+    if (n < 2) {
+        return false;
+    }
+
+    m_path.assign(1, first);
+    std::fill(m_unvisited.begin(), m_unvisited.end(), 0);
+    for (PersonId i = 0; i < n; ++i) {
+        if (i != first) {
+            bitset::set(m_unvisited.data(), i);
+        }
+    }
+
+    // initially all people are either unvisited, the first or the tail
+    bool ok = true;
+    for (PersonId i = 0; i < n; ++i) {
+        m_numFreeGiftees[i] = static_cast<int>(m_model.numGiftees(i));
+        m_numFreeDonors[i] = static_cast<int>(m_model.numDonors(i));
+        ok &= m_numFreeGiftees[i] > 0 && m_numFreeDonors[i] > 0;
+    }
+
+    return ok && connected();
+}
+
+bool Search::push(PersonId next)
+{
+    const auto words = m_model.numWords();
+    const PersonId tail = m_path.back();
+    const PersonId first = m_path.front();
+
+    bitset::reset(m_unvisited.data(), next);
+    m_path.push_back(next);
+
+    // "next" isn't available as giftee anymore: all its donors lose an option
+    bool ok = true;
+    bitset::forEach(m_model.donorsOf(next), words, [&](std::size_t d) {
+        if (--m_numFreeGiftees[d] == 0 &&
+            bitset::test(m_unvisited.data(), d)) {
+            ok = false;
+        }
+    });
+
+    // the old tail isn't available as donor anymore: all its giftees lose an
+    // option
+    bitset::forEach(m_model.gifteesOf(tail), words, [&](std::size_t g) {
+        if (--m_numFreeDonors[g] == 0 &&
+            (g == first || bitset::test(m_unvisited.data(), g))) {
+            ok = false;
+        }
+    });
+
+    // the new tail needs a free giftee as well: an unvisited one, or the
+    // first person once everybody is on the path
+    const int toFirst = m_model.allowed(next, first) ? 1 : 0;
+    if (m_path.size() < m_model.size() ? m_numFreeGiftees[next] == toFirst
+                                       : toFirst == 0) {
+        ok = false;
+    }
+
+    if (ok) {
+        const auto remaining = m_model.size() - m_path.size();
+        if (remaining * words <= connectivityBudget ||
+            m_path.size() % connectivityInterval == 0) {
+            ok = connected();
+        }
+    }
+
+    if (!ok) {
+        pop();
+    }
+
+    return ok;
+}
+
+void Search::pop()
+{
+    const auto words = m_model.numWords();
+    const PersonId last = m_path.back();
+    m_path.pop_back();
+    const PersonId tail = m_path.back();
+
+    bitset::forEach(m_model.gifteesOf(tail), words,
+                    [&](std::size_t g) { ++m_numFreeDonors[g]; });
+    bitset::forEach(m_model.donorsOf(last), words,
+                    [&](std::size_t d) { ++m_numFreeGiftees[d]; });
+
+    bitset::set(m_unvisited.data(), last);
+}
+
+std::vector<PersonId> Search::candidates()
+{
+    std::vector<PersonId> cand;
+    bitset::forEachAnd(
+        m_model.gifteesOf(m_path.back()), m_unvisited.data(),
+        m_model.numWords(),
+        [&cand](std::size_t g) { cand.push_back(static_cast<PersonId>(g)); });
+
+    // random order among equally constrained candidates
+    std::shuffle(cand.begin(), cand.end(), m_gen);
+    std::stable_sort(cand.begin(), cand.end(),
+                     [this](PersonId a, PersonId b) {
+                         return m_numFreeGiftees[a] < m_numFreeGiftees[b];
+                     });
+
+    return cand;
+}
+
+bool Search::complete() const
+{
+    return m_path.size() == m_model.size() &&
+           m_model.allowed(m_path.back(), m_path.front());
+}
+
+bool Search::run(const std::atomic<bool>* cancel, stats::SolverStats* stats)
+{
+    stats::SolverStats localStats;
+    auto& st = stats ? *stats : localStats;
+
+    m_rootDepth = m_path.size();
+    m_numNodes = 0;
+    m_stopped = false;
+    m_candStack.clear();
+    m_frames.clear();
+    if (complete()) {
+        st.solutionFound();
+        return true;
+    }
+
+    m_candStack = candidates();
+    m_frames.push_back({0, m_candStack.size(), 0});
+    return resume(cancel, st);
+}
+
+bool Search::next(const std::atomic<bool>* cancel, stats::SolverStats* stats)
+{
+    stats::SolverStats localStats;
+    auto& st = stats ? *stats : localStats;
+
+    m_stopped = false;
+    if (m_frames.empty()) {
+        return false;
+    }
+
+    // give up the cycle found last, the search goes on with the next
+    // candidate on its last level
+    pop();
+    ++st.backtracks;
+    return resume(cancel, st);
+}
+
+bool Search::resume(const std::atomic<bool>* cancel, stats::SolverStats& st)
+{
+    while (!m_frames.empty()) {
+        if ((cancel && cancel->load(std::memory_order_relaxed)) ||
+            (m_maxNodes > 0 && m_numNodes >= m_maxNodes) || outOfTime()) {
+            m_stopped = true;
+            break;
+        }
+
+        Frame& f = m_frames.back();
+        if (f.next == f.end) {
+            // all candidates on this level failed, backtrack
+            m_candStack.resize(f.begin);
+            m_frames.pop_back();
+            if (m_path.size() > m_rootDepth) {
+                pop();
+                ++st.backtracks;
+                st.reject(m_path.back());
+            }
+        } else if (push(m_candStack[f.next++])) {
+            ++m_numNodes;
+            ++st.nodes;
+            st.depth(m_path.size());
+            if (complete()) {
+                st.solutionFound();
+                return true;
+            }
+
+            auto cand = candidates();
+            const auto begin = m_candStack.size();
+            m_candStack.insert(m_candStack.end(), cand.cbegin(), cand.cend());
+            m_frames.push_back({begin, m_candStack.size(), begin});
+        } else {
+            // pruned right away
+            st.reject(m_path.back());
+        }
+    }
+
+    // restore the path we were started with
+    while (m_path.size() > m_rootDepth) {
+        pop();
+    }
+    m_candStack.clear();
+    m_frames.clear();
+
+    return false;
+}
+
+bool Search::outOfTime()
+{
+    return m_deadline && ++m_numChecks % deadlineCheckInterval == 0 &&
+           Clock::now() > *m_deadline;
+}
+
+bool Search::connected() const
+{
+    const auto words = m_model.numWords();
+    const auto remaining = m_model.size() - m_path.size();
+    if (remaining == 0) {
+        return true;
+    }
+
+    // all unvisited people must be reachable from the tail (via unvisited
+    // people) and must reach the first person
+    auto reachesAll = [&](PersonId root, bool forward) {
+        std::fill(m_seen.begin(), m_seen.end(), 0);
+        std::size_t numSeen{0};
+        m_stack.assign(1, root);
+        while (!m_stack.empty()) {
+            const PersonId v = m_stack.back();
+            m_stack.pop_back();
+            const auto* row =
+                forward ? m_model.gifteesOf(v) : m_model.donorsOf(v);
+            for (std::size_t i = 0; i < words; ++i) {
+                const bitset::Word w = row[i] & m_unvisited[i] & ~m_seen[i];
+                if (w) {
+                    m_seen[i] |= w;
+                    bitset::forEach(&w, 1, [&](std::size_t b) {
+                        m_stack.push_back(
+                            static_cast<PersonId>(i * bitset::wordBits + b));
+                        ++numSeen;
+                    });
+                }
+            }
+        }
+        return numSeen == remaining;
+    };
+
+    return reachesAll(m_path.back(), true) && reachesAll(m_path.front(), false);
+}
+
+PersonId mostConstrainedPerson(const constraints::ConstraintModel& model,
+                               std::mt19937& gen)
+{
+    std::vector<PersonId> best;
+    unsigned int bestOptions{0};
+    for (PersonId i = 0; i < model.size(); ++i) {
+        const auto options = std::min(model.numGiftees(i), model.numDonors(i));
+        if (best.empty() || options < bestOptions) {
+            best.assign(1, i);
+            bestOptions = options;
+        } else if (options == bestOptions) {
+            best.push_back(i);
+        }
+    }
+
+    std::uniform_int_distribution<std::size_t> idist(0, best.size() - 1);
+    return best[idist(gen)];
+}
+
+Result findValidList(std::vector<PersonId>& cycle,
+                     const constraints::ConstraintModel& model,
+                     std::uint64_t maxNodes, stats::SolverStats* stats)
+{
+    std::random_device rd;
+    std::mt19937 gen(rd());
+
+    Result result;
+    result.complete = true;
+    if (model.size() > 1) {
+        Search search(model, gen());
+        search.limitNodes(maxNodes);
+        result.found = search.start(mostConstrainedPerson(model, gen)) &&
+                       search.run(nullptr, stats);
+        result.complete = result.found || !search.stopped();
+        if (result.found) {
+            cycle = search.path();
+        }
+    }
+
+    return result;
+}
+}  // namespace hamilton
+
+bool findValidListPruned(std::vector<PersonId>& cycle,
+                         const constraints::ConstraintModel& model,
+                         stats::SolverStats* stats)
+{
+    return hamilton::findValidList(cycle, model, 0, stats).found;
+}
@@ -0,0 +1,158 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "constraints.h"
+#include "person.h"
+#include "stats.h"
+
+namespace hamilton
+{
+// depth-first search for a Hamiltonian cycle in the "may give to" graph. The
+// cycle is constructed as a path starting at a fixed first person (which
+// removes the rotation symmetry) and every extension of the path is
+// immediately rejected if
+//  - an unvisited person (or the path's tail) is left without a free giftee,
+//  - an unvisited person (or the first person) is left without a free donor,
+//  - the unvisited people are not reachable from the tail anymore or cannot
+//    reach the first person anymore.
+// Candidates are tried in the order of fewest remaining options first.
+class Search
+{
+public:
+    Search(const constraints::ConstraintModel& model, std::uint32_t seed);
+
+    // starts a new path with the given person, returns false if the
+    // constraints can't be fulfilled already
+    bool start(PersonId first);
+
+    // appends a giftee to the path, returns false (and leaves the path
+    // untouched) if the extension was pruned
+    bool push(PersonId next);
+
+    // removes the last person from the path
+    void pop();
+
+    // exhaustively searches all completions of the current path. Returns
+    // true if a cycle was found (available in path() then) and false if
+    // there's no cycle or the search was cancelled. The search statistics are
+    // added to stats if given.
+    bool run(const std::atomic<bool>* cancel = nullptr,
+             stats::SolverStats* stats = nullptr);
+
+    // continues the search of run() after the cycle found last, returns true
+    // if another one was found. Every cycle is found once only (the first
+    // person is fixed), false means there are no more (or the search was
+    // cancelled).
+    bool next(const std::atomic<bool>* cancel = nullptr,
+              stats::SolverStats* stats = nullptr);
+
+    // the searches of run() and next() stop after this many extensions of
+    // the path (0: no limit)
+    void limitNodes(std::uint64_t maxNodes) { m_maxNodes = maxNodes; }
+
+    // the searches of run() and next() stop once the deadline has passed
+    void limitTime(std::chrono::steady_clock::time_point deadline)
+    {
+        m_deadline = deadline;
+    }
+
+    // true if the last run() or next() stopped early (cancelled, out of
+    // nodes or out of time), false if it returned because it found a cycle or
+    // there's none
+    bool stopped() const { return m_stopped; }
+
+    // the not yet tried giftees for the path's tail, best candidate first
+    std::vector<PersonId> candidates();
+
+    // true if the path forms a valid cycle including all people
+    bool complete() const;
+
+    const std::vector<PersonId>& path() const { return m_path; }
+
+private:
+    // one level of the search
+    struct Frame {
+        std::size_t begin;  // first candidate in the candidate stack
+        std::size_t end;    // one past the last candidate
+        std::size_t next;   // next candidate to try
+    };
+
+    // the depth-first search of run() and next() from the current state
+    bool resume(const std::atomic<bool>* cancel, stats::SolverStats& stats);
+
+    // true if the deadline has passed (the clock is only read every few calls)
+    bool outOfTime();
+
+    // checks the reachability of the unvisited people
+    bool connected() const;
+
+    const constraints::ConstraintModel& m_model;
+    std::mt19937 m_gen;
+    std::vector<PersonId> m_path{};
+    std::vector<bitset::Word> m_unvisited{};
+    // number of giftees in the unvisited people and the first person
+    std::vector<int> m_numFreeGiftees{};
+    // number of donors in the unvisited people and the path's tail
+    std::vector<int> m_numFreeDonors{};
+    // scratch space for the reachability checks
+    mutable std::vector<bitset::Word> m_seen{};
+    mutable std::vector<PersonId> m_stack{};
+    // the state of the depth-first search (empty once it's done): the length
+    // of the path it was started with, the candidates of all levels
+    std::size_t m_rootDepth{0};
+    std::vector<PersonId> m_candStack{};
+    std::vector<Frame> m_frames{};
+    // the limit of path extensions and the extensions since run()
+    std::uint64_t m_maxNodes{0};
+    std::uint64_t m_numNodes{0};
+    std::optional<std::chrono::steady_clock::time_point> m_deadline{};
+    std::uint64_t m_numChecks{0};
+    bool m_stopped{false};
+};
+
+// the person with the fewest options (giftees or donors), ties are broken
+// randomly
+PersonId mostConstrainedPerson(const constraints::ConstraintModel& model,
+                               std::mt19937& gen);
+
+struct Result {
+    // a valid list was found
+    bool found{false};
+    // the search was completed, i.e. there's no valid list unless found
+    bool complete{false};
+};
+
+// the pruned depth-first search of findValidListPruned(), which gives up
+// after maxNodes extensions of the path (0: no limit)
+Result findValidList(std::vector<PersonId>& cycle,
+                     const constraints::ConstraintModel& model,
+                     std::uint64_t maxNodes,
+                     stats::SolverStats* stats = nullptr);
+}  // namespace hamilton
+
+// find a valid donor->giftee list by a pruned depth-first search
+bool findValidListPruned(std::vector<PersonId>& cycle,
+                         const constraints::ConstraintModel& model,
+                         stats::SolverStats* stats = nullptr);
@@ -0,0 +1,152 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "heldkarp.h"
+
+#include <cstdint>
+#include <random>
+
+#include "log.h"
+
+namespace
+{
+// set of people, bit i is person i (at most heldkarp::maxPeople people)
+using Mask = std::uint32_t;
+
+static_assert(heldkarp::maxPeople <= 32, "people have to fit into a Mask");
+
+// the people allowed to give a gift to each person
+std::vector<Mask> donorMasks(const constraints::ConstraintModel& model);
+
+// a random person out of a non-empty set
+PersonId randomMember(Mask m, std::mt19937& gen);
+
+// fills the table: paths start at person 0, entry s holds the set of people a
+// path can end at which visits exactly the people in s (bit i of s is person
+// i + 1, person 0 is part of every path). Returns the number of reachable
+// (set, end) states.
+std::size_t fillTable(const std::vector<Mask>& donors,
+                      std::vector<Mask>& table);
+
+// walks back from the full set, choosing a random predecessor wherever there
+// are several
+std::vector<PersonId> reconstruct(const std::vector<Mask>& donors,
+                                  const std::vector<Mask>& table,
+                                  std::mt19937& gen);
+
+std::vector<Mask> donorMasks(const constraints::ConstraintModel& model)
+{
+    std::vector<Mask> donors(model.size(), 0);
+    for (PersonId g = 0; g < model.size(); ++g) {
+        donors[g] = static_cast<Mask>(model.donorsOf(g)[0]);
+    }
+    return donors;
+}
+
+PersonId randomMember(Mask m, std::mt19937& gen)
+{
+    std::uniform_int_distribution<int> idist(0, __builtin_popcount(m) - 1);
+    for (int k = idist(gen); k > 0; --k) {
+        m &= m - 1;
+    }
+    return static_cast<PersonId>(__builtin_ctz(m));
+}
+
+std::size_t fillTable(const std::vector<Mask>& donors,
+                      std::vector<Mask>& table)
+{
+    const auto n = donors.size();
+    const Mask others = static_cast<Mask>((std::size_t{1} << (n - 1)) - 1);
+
+    std::size_t numStates{0};
+    table.assign(std::size_t{1} << (n - 1), 0);
+    table[0] = 1;  // the path consisting of person 0 only
+
+    // every set is complete before it's extended since supersets have larger
+    // indices
+    for (std::size_t s = 0; s < table.size(); ++s) {
+        const Mask ends = table[s];
+        if (!ends) {
+            continue;
+        }
+        numStates += static_cast<std::size_t>(__builtin_popcount(ends));
+
+        // extend the paths by any person not yet visited which may receive a
+        // gift from one of the possible ends
+        for (Mask rest = ~static_cast<Mask>(s) & others; rest;
+             rest &= rest - 1) {
+            const auto bit = __builtin_ctz(rest);
+            const PersonId next = static_cast<PersonId>(bit + 1);
+            if (ends & donors[next]) {
+                table[s | (Mask{1} << bit)] |= Mask{1} << next;
+            }
+        }
+    }
+
+    return numStates;
+}
+
+std::vector<PersonId> reconstruct(const std::vector<Mask>& donors,
+                                  const std::vector<Mask>& table,
+                                  std::mt19937& gen)
+{
+    const auto n = donors.size();
+    std::vector<PersonId> path(n, 0);
+
+    // the last person has to give a gift to person 0
+    std::size_t s = table.size() - 1;
+    Mask candidates = table[s] & donors[0];
+    for (std::size_t pos = n - 1; pos > 0; --pos) {
+        const PersonId p = randomMember(candidates, gen);
+        path[pos] = p;
+        s &= ~(std::size_t{1} << (p - 1));
+        candidates = table[s] & donors[p];
+    }
+
+    return path;
+}
+}  // namespace
+
+bool findValidListExact(std::vector<PersonId>& cycle,
+                        const constraints::ConstraintModel& model,
+                        stats::SolverStats* stats)
+{
+    stats::SolverStats localStats;
+    auto& st = stats ? *stats : localStats;
+
+    bool success = false;
+    const auto n = model.size();
+    if (n < 2 || n > heldkarp::maxPeople) {
+        // no circle possible, or too many people for the table
+    } else {
+        std::random_device rd;
+        std::mt19937 gen(rd());
+
+        const auto donors = donorMasks(model);
+        std::vector<Mask> table;
+        st.nodes += fillTable(donors, table);
+        LOG(debug) << st.nodes << " reachable states";
+
+        if (table.back() & donors[0]) {
+            success = true;
+            st.depth(n);
+            st.solutionFound();
+            cycle = reconstruct(donors, table, gen);
+        }
+    }
+
+    return success;
+}
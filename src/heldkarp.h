@@ -0,0 +1,40 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "constraints.h"
+#include "person.h"
+#include "stats.h"
+
+// exact dynamic programming over subsets of people (Held-Karp)
+namespace heldkarp
+{
+// largest number of people the DP is used for: the table has 2^(n-1) entries
+// of 32bit, i.e. 64MB for 25 people
+constexpr std::size_t maxPeople{25};
+}  // namespace heldkarp
+
+// find a valid donor->giftee list by dynamic programming over the subsets of
+// people. Takes O(2^n * n) time regardless of the constraints and either finds
+// a (random) valid list or proves there's none. Only for up to
+// heldkarp::maxPeople people.
+bool findValidListExact(std::vector<PersonId>& cycle,
+                        const constraints::ConstraintModel& model,
+                        stats::SolverStats* stats = nullptr);
@@ -0,0 +1,276 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "history.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <iostream>
+
+#include "arena.h"
+#include "log.h"
+
+namespace
+{
+constexpr char fileMagic[8] = {'x', 'm', 'a', 's', 'G', 'H', 'S', 'T'};
+constexpr std::uint32_t formatVersion{1};
+
+constexpr std::uint32_t recordName{1};
+constexpr std::uint32_t recordYear{2};
+
+// the records are aligned to this
+constexpr std::size_t recordAlign{4};
+
+struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+};
+
+// followed by count characters (a name, padded to the alignment) or count
+// uint32 (the numbers of the names in a year's list)
+struct RecordHeader {
+    std::uint32_t type;
+    std::int32_t year;
+    std::uint32_t count;
+};
+
+// the size of a record's payload in the file
+std::size_t payloadSize(const RecordHeader& record);
+
+// appends a record to the buffer
+void appendRecord(std::string& buf, std::uint32_t type, std::int32_t year,
+                  const void* payload, std::uint32_t count,
+                  std::size_t payloadBytes);
+
+std::size_t payloadSize(const RecordHeader& record)
+{
+    const std::size_t bytes = record.type == recordYear
+                                  ? record.count * sizeof(std::uint32_t)
+                                  : record.count;
+    return (bytes + recordAlign - 1) / recordAlign * recordAlign;
+}
+
+void appendRecord(std::string& buf, std::uint32_t type, std::int32_t year,
+                  const void* payload, std::uint32_t count,
+                  std::size_t payloadBytes)
+{
+    const RecordHeader record{type, year, count};
+    buf.append(reinterpret_cast<const char*>(&record), sizeof(record));
+    buf.append(static_cast<const char*>(payload), payloadBytes);
+    buf.append(payloadSize(record) - payloadBytes, '\0');
+}
+}  // namespace
+
+namespace history
+{
+std::string historyFilename(const std::string& inFilename)
+{
+    return inFilename + ".history";
+}
+
+int currentYear()
+{
+    const auto now = std::time(nullptr);
+    std::tm local{};
+    localtime_r(&now, &local);
+    return local.tm_year + 1900;
+}
+
+History::History(std::string filename)
+    : m_filename(std::move(filename)), m_file(m_filename)
+{
+    std::error_code ec;
+    if (std::filesystem::exists(m_filename, ec)) {
+        read();
+    }
+}
+
+void History::read()
+{
+    const auto data = m_file.data();
+    Header header{};
+    if (m_file.ok() && data.size() >= sizeof(header)) {
+        std::memcpy(&header, data.data(), sizeof(header));
+    }
+    if (std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0 ||
+        header.version != formatVersion) {
+        std::cerr << m_filename << " is not a history file (not updated)"
+                  << std::endl;
+        m_ok = false;
+        return;
+    }
+
+    // only the names are decoded, the lists are just indexed
+    std::size_t pos = sizeof(header);
+    while (data.size() - pos >= sizeof(RecordHeader)) {
+        RecordHeader record{};
+        std::memcpy(&record, data.data() + pos, sizeof(record));
+        const auto payload = pos + sizeof(record);
+        if (payloadSize(record) > data.size() - payload) {
+            break;
+        }
+
+        if (record.type == recordName) {
+            m_names.push_back(arena::intern(
+                std::string_view(data.data() + payload, record.count)));
+            m_nameNumbers.emplace(m_names.back(),
+                                  static_cast<std::uint32_t>(m_names.size() -
+                                                             1));
+        } else if (record.type == recordYear) {
+            m_years[record.year] = {payload, record.count};
+        } else {
+            break;
+        }
+        pos = payload + payloadSize(record);
+    }
+    m_validSize = pos;
+
+    if (m_validSize < data.size()) {
+        LOG(warn) << m_filename << ": ignoring " << data.size() - m_validSize
+                  << " bytes of an incomplete record";
+    }
+    LOG(debug) << m_filename << ": " << m_years.size() << " years, "
+               << m_names.size() << " names";
+}
+
+template <typename F>
+void History::forEachRecentPair(const constraints::ConstraintModel& model,
+                                int year, unsigned int numYears, F&& f) const
+{
+    if (numYears == 0 || m_years.empty()) {
+        return;
+    }
+
+    // the people of the model by the numbers of their names
+    std::vector<PersonId> people(m_names.size(), PersonId(-1));
+    for (PersonId id = 0; id < model.size(); ++id) {
+        const auto it = m_nameNumbers.find(model.name(id));
+        if (it != m_nameNumbers.end()) {
+            people[it->second] = id;
+        }
+    }
+
+    const auto data = m_file.data();
+    for (auto it = m_years.lower_bound(year - static_cast<int>(numYears));
+         it != m_years.end() && it->first < year; ++it) {
+        const auto& list = it->second;
+        std::vector<std::uint32_t> cycle(list.count);
+        std::memcpy(cycle.data(), data.data() + list.offset,
+                    cycle.size() * sizeof(std::uint32_t));
+
+        const auto age = static_cast<unsigned int>(year - it->first);
+        for (std::size_t i = 0; i < cycle.size(); ++i) {
+            const auto donor = cycle[i];
+            const auto giftee = cycle[(i + 1) % cycle.size()];
+            if (donor < people.size() && giftee < people.size() &&
+                people[donor] != PersonId(-1) &&
+                people[giftee] != PersonId(-1)) {
+                f(people[donor], people[giftee], age);
+            }
+        }
+    }
+}
+
+std::size_t History::excludeRecent(constraints::ConstraintModel& model,
+                                   int year, unsigned int numYears) const
+{
+    std::size_t numBlocked{0};
+    forEachRecentPair(model, year, numYears,
+                      [&](PersonId donor, PersonId giftee, unsigned int) {
+                          numBlocked += model.block(donor, giftee) ? 1 : 0;
+                      });
+    return numBlocked;
+}
+
+std::size_t History::penalizeRecent(constraints::ConstraintModel& model,
+                                    int year, unsigned int numYears) const
+{
+    std::size_t numPenalized{0};
+    forEachRecentPair(
+        model, year, numYears,
+        [&](PersonId donor, PersonId giftee, unsigned int age) {
+            model.addPenalty(donor, giftee, numYears - age + 1);
+            ++numPenalized;
+        });
+    return numPenalized;
+}
+
+bool History::append(int year, const std::vector<Person>& giftList)
+{
+    if (!m_ok) {
+        return false;
+    }
+
+    std::string buf;
+    if (m_validSize == 0) {
+        Header header{};
+        std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+        header.version = formatVersion;
+        buf.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+
+    // the names not known yet are added before the list
+    const auto numNames = m_names.size();
+    std::vector<std::uint32_t> cycle;
+    cycle.reserve(giftList.size());
+    for (const auto& p : giftList) {
+        const auto [it, added] = m_nameNumbers.emplace(
+            p.name, static_cast<std::uint32_t>(m_names.size()));
+        if (added) {
+            m_names.emplace_back(p.name);
+            appendRecord(buf, recordName, 0, p.name.data(),
+                         static_cast<std::uint32_t>(p.name.size()),
+                         p.name.size());
+        }
+        cycle.push_back(it->second);
+    }
+    appendRecord(buf, recordYear, year, cycle.data(),
+                 static_cast<std::uint32_t>(cycle.size()),
+                 cycle.size() * sizeof(std::uint32_t));
+
+    const int fd = open(m_filename.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC,
+                        0644);
+
+    // a record cut off by an interrupted run is overwritten
+    bool written = fd >= 0 && ftruncate(fd, static_cast<off_t>(m_validSize)) == 0 &&
+                   lseek(fd, static_cast<off_t>(m_validSize), SEEK_SET) >= 0;
+    for (std::size_t pos = 0; written && pos < buf.size();) {
+        const auto len = write(fd, buf.data() + pos, buf.size() - pos);
+        written = len > 0;
+        pos += written ? static_cast<std::size_t>(len) : 0;
+    }
+    written = written && fsync(fd) == 0;
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    if (written) {
+        m_validSize += buf.size();
+    } else {
+        // the new names weren't written
+        for (auto i = numNames; i < m_names.size(); ++i) {
+            m_nameNumbers.erase(m_names[i]);
+        }
+        m_names.resize(numNames);
+    }
+    return written;
+}
+}  // namespace history
@@ -0,0 +1,105 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "constraints.h"
+#include "mappedfile.h"
+#include "person.h"
+
+// the lists of past years, stored next to the configuration file such that
+// the giftees of the last years can be excluded without listing them in the
+// configuration file
+namespace history
+{
+// the history file of a configuration file
+std::string historyFilename(const std::string& inFilename);
+
+// the current calendar year (local time)
+int currentYear();
+
+// append-only binary file: a header followed by records, every record being
+//  - a name (the names are numbered in the order they appear) or
+//  - the list of a year, as the numbers of the names in the order of the
+//    circle (a later list of the same year replaces an earlier one).
+// New names and the list of a year are appended in O(n), the lists are only
+// decoded for the years asked for.
+class History
+{
+public:
+    // reads the history file, a missing file is an empty history
+    explicit History(std::string filename);
+
+    // false if the file exists but isn't a history file (it's not written
+    // then)
+    bool ok() const { return m_ok; }
+
+    // the years with a list
+    std::size_t numYears() const { return m_years.size(); }
+
+    // blocks the giftee every donor had in the numYears years before year
+    // (people which aren't in the model anymore are skipped), returns the
+    // number of pairs blocked
+    std::size_t excludeRecent(constraints::ConstraintModel& model, int year,
+                              unsigned int numYears) const;
+
+    // like excludeRecent(), but the giftees are penalized instead of blocked:
+    // the giftee of the last year costs numYears, the one of the year before
+    // numYears - 1 etc. Returns the number of pairs penalized.
+    std::size_t penalizeRecent(constraints::ConstraintModel& model, int year,
+                               unsigned int numYears) const;
+
+    // appends the list of the year (the people in the order of the circle),
+    // returns false if it couldn't be written. Lists appended aren't seen by
+    // excludeRecent() of the same object.
+    bool append(int year, const std::vector<Person>& giftList);
+
+private:
+    // a list in the mapped file
+    struct YearList {
+        std::size_t offset;
+        std::uint32_t count;
+    };
+
+    // checks the header and indexes the records, stops at a record cut off
+    // by an interrupted run
+    void read();
+
+    // calls f(donor, giftee, age) for every pair of the lists of the numYears
+    // years before year whose people are in the model
+    template <typename F>
+    void forEachRecentPair(const constraints::ConstraintModel& model,
+                           int year, unsigned int numYears, F&& f) const;
+
+    std::string m_filename;
+    io::MappedFile m_file;
+    bool m_ok{true};
+    // the size up to the last complete record (appended from there on)
+    std::size_t m_validSize{0};
+    // the names are interned (see arena::intern())
+    std::vector<std::string_view> m_names{};
+    std::unordered_map<std::string_view, std::uint32_t> m_nameNumbers{};
+    std::map<int, YearList> m_years{};
+};
+}  // namespace history
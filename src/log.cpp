@@ -0,0 +1,223 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+// number of messages the ring buffer can hold (a power of 2)
+constexpr std::size_t capacity{4096};
+// longest pause of the writing thread when there's nothing to write
+constexpr std::chrono::milliseconds maxIdleSleep{10};
+
+// bounded multi-producer single-consumer queue (every slot carries a
+// sequence number telling whether it's free for the producer of a position
+// or filled for the consumer) with a thread writing the messages
+class Sink
+{
+public:
+    Sink();
+    ~Sink();
+
+    // false if the buffer is full
+    bool push(std::string&& message);
+
+    bool setFile(const std::string& filename);
+
+    void flush();
+
+private:
+    struct Slot {
+        std::atomic<std::size_t> seq{0};
+        std::string message{};
+    };
+
+    bool pop(std::string& message);
+
+    // writes all queued messages, returns false if there weren't any
+    bool drain();
+
+    void run();
+
+    std::unique_ptr<Slot[]> m_slots;
+    alignas(64) std::atomic<std::size_t> m_head{0};
+    // only used by the consumer
+    alignas(64) std::size_t m_tail{0};
+    std::atomic<std::uint64_t> m_dropped{0};
+    // serializes the consumer (writing thread and flush())
+    std::mutex m_consumerMtx{};
+    std::FILE* m_file{stderr};
+    std::atomic<bool> m_stop{false};
+    std::thread m_thread{};
+};
+
+Sink& sink();
+
+Sink::Sink() : m_slots(new Slot[capacity])
+{
+    for (std::size_t i = 0; i < capacity; ++i) {
+        m_slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+    m_thread = std::thread(&Sink::run, this);
+}
+
+Sink::~Sink()
+{
+    m_stop = true;
+    m_thread.join();
+    flush();
+
+    if (const auto dropped = m_dropped.load()) {
+        std::fprintf(m_file, "%llu log messages dropped\n",
+                     static_cast<unsigned long long>(dropped));
+    }
+    if (m_file != stderr) {
+        std::fclose(m_file);
+    }
+}
+
+bool Sink::push(std::string&& message)
+{
+    auto pos = m_head.load(std::memory_order_relaxed);
+    Slot* slot{nullptr};
+    for (;;) {
+        slot = &m_slots[pos & (capacity - 1)];
+        const auto seq = slot->seq.load(std::memory_order_acquire);
+        const auto diff =
+            static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+        if (diff == 0) {
+            if (m_head.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // the consumer didn't free this slot yet
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = m_head.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->message = std::move(message);
+    slot->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool Sink::setFile(const std::string& filename)
+{
+    auto* file = std::fopen(filename.c_str(), "a");
+    if (!file) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_consumerMtx);
+    std::fflush(m_file);
+    if (m_file != stderr) {
+        std::fclose(m_file);
+    }
+    m_file = file;
+    return true;
+}
+
+void Sink::flush()
+{
+    while (drain()) {
+    }
+}
+
+bool Sink::pop(std::string& message)
+{
+    auto& slot = m_slots[m_tail & (capacity - 1)];
+    if (slot.seq.load(std::memory_order_acquire) != m_tail + 1) {
+        return false;
+    }
+
+    message = std::move(slot.message);
+    slot.message.clear();
+    slot.seq.store(m_tail + capacity, std::memory_order_release);
+    ++m_tail;
+    return true;
+}
+
+bool Sink::drain()
+{
+    std::lock_guard<std::mutex> lock(m_consumerMtx);
+    std::string message;
+    bool any = false;
+    while (pop(message)) {
+        std::fwrite(message.data(), 1, message.size(), m_file);
+        std::fputc('\n', m_file);
+        any = true;
+    }
+    if (any) {
+        std::fflush(m_file);
+    }
+    return any;
+}
+
+void Sink::run()
+{
+    auto idleSleep = std::chrono::milliseconds{1};
+    while (!m_stop) {
+        if (drain()) {
+            idleSleep = std::chrono::milliseconds{1};
+        } else {
+            std::this_thread::sleep_for(idleSleep);
+            idleSleep = std::min(idleSleep * 2, maxIdleSleep);
+        }
+    }
+}
+
+Sink& sink()
+{
+    static Sink s;
+    return s;
+}
+}  // namespace
+
+namespace logging
+{
+namespace detail
+{
+std::atomic<int> runtimeLevel{static_cast<int>(Level::warn)};
+
+void submit(std::string message) { sink().push(std::move(message)); }
+}  // namespace detail
+
+void increaseVerbosity()
+{
+    auto level = detail::runtimeLevel.load();
+    level = level < static_cast<int>(Level::debug)
+                ? static_cast<int>(Level::debug)
+                : std::min(level + 1, static_cast<int>(Level::trace));
+    detail::runtimeLevel = level;
+}
+
+bool setLogFile(const std::string& filename)
+{
+    return sink().setFile(filename);
+}
+
+void flush() { sink().flush(); }
+}  // namespace logging
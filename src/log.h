@@ -0,0 +1,93 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+#pragma once
+
+#include <atomic>
+#include <sstream>
+#include <string>
+
+// the most detailed level compiled in (see Level), set by CMake
+#ifndef XMASGIFTS_LOG_LEVEL
+#define XMASGIFTS_LOG_LEVEL 3
+#endif
+
+// diagnostic messages, written as
+//   LOG(debug) << "searching " << n << " subtrees";
+// Messages above the compiled-in level (XMASGIFTS_LOG_LEVEL) are removed by
+// the compiler. For messages above the level chosen at run time (-v) none of
+// the arguments are evaluated or formatted. Enabled messages are queued in a
+// lock-free ring buffer and written by a background thread, such that
+// logging never blocks the caller (messages are dropped if the buffer is
+// full).
+namespace logging
+{
+enum class Level : int { error, warn, info, debug, trace };
+
+constexpr Level compiledLevel = static_cast<Level>(XMASGIFTS_LOG_LEVEL);
+
+namespace detail
+{
+extern std::atomic<int> runtimeLevel;
+
+// queues a message for writing
+void submit(std::string message);
+}  // namespace detail
+
+constexpr bool compiledIn(Level level) { return level <= compiledLevel; }
+
+inline bool enabled(Level level)
+{
+    return compiledIn(level) &&
+           static_cast<int>(level) <=
+               detail::runtimeLevel.load(std::memory_order_relaxed);
+}
+
+// the first call enables debug messages, the next one trace messages
+void increaseVerbosity();
+
+// writes the messages into the file (appending) instead of stderr, returns
+// false if the file can't be opened
+bool setLogFile(const std::string& filename);
+
+// blocks until all queued messages are written
+void flush();
+
+// one message, queued when it's complete (i.e. at the end of the statement)
+class Record
+{
+public:
+    Record() = default;
+    ~Record() { detail::submit(m_stream.str()); }
+    Record(const Record&) = delete;
+    Record& operator=(const Record&) = delete;
+
+    template <typename T>
+    Record& operator<<(const T& x)
+    {
+        m_stream << x;
+        return *this;
+    }
+
+private:
+    std::ostringstream m_stream{};
+};
+}  // namespace logging
+
+#define LOG(level)                                                  \
+    if constexpr (!::logging::compiledIn(::logging::Level::level)) { \
+    } else if (!::logging::enabled(::logging::Level::level)) {       \
+    } else                                                          \
+        ::logging::Record()
@@ -0,0 +1,68 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "mappedfile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace io
+{
+MappedFile::MappedFile(const std::string& filename)
+{
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat st {
+    };
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        m_mapSize = static_cast<std::size_t>(st.st_size);
+        m_map = mmap(nullptr, m_mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m_map == MAP_FAILED) {
+            m_map = nullptr;
+        } else {
+            // the file is tokenized front to back exactly once
+            madvise(m_map, m_mapSize, MADV_SEQUENTIAL);
+            m_data = std::string_view(static_cast<const char*>(m_map),
+                                      m_mapSize);
+            m_ok = true;
+        }
+    }
+
+    if (!m_map) {
+        // empty files can't be mapped, streams (pipes) neither
+        char buf[1U << 16];
+        ssize_t len{0};
+        while ((len = read(fd, buf, sizeof(buf))) > 0) {
+            m_buffer.append(buf, static_cast<std::size_t>(len));
+        }
+        m_data = m_buffer;
+        m_ok = len == 0;
+    }
+
+    close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_map) {
+        munmap(m_map, m_mapSize);
+    }
+}
+}  // namespace io
@@ -0,0 +1,46 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace io
+{
+// read-only view of a whole file. Regular files are memory-mapped, anything
+// else (e.g. pipes) is read into a buffer.
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string& filename);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // false if the file couldn't be opened or read
+    bool ok() const { return m_ok; }
+
+    std::string_view data() const { return m_data; }
+
+private:
+    void* m_map{nullptr};
+    std::size_t m_mapSize{0};
+    std::string m_buffer{};
+    std::string_view m_data{};
+    bool m_ok{false};
+};
+}  // namespace io
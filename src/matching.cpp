@@ -0,0 +1,238 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "matching.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+namespace
+{
+using constraints::ConstraintModel;
+using matching::unmatched;
+
+constexpr unsigned int infDist{std::numeric_limits<unsigned int>::max()};
+
+class HopcroftKarp
+{
+public:
+    // with a generator, the donors are matched in a random order and the
+    // initial matching starts at random giftees
+    explicit HopcroftKarp(const ConstraintModel& model,
+                          std::mt19937* gen = nullptr)
+        : m_model(model),
+          m_gen(gen),
+          m_order(model.size()),
+          m_gifteeOf(model.size(), unmatched),
+          m_donorOf(model.size(), unmatched),
+          m_dist(model.size(), infDist),
+          m_cursor(model.size(), 0)
+    {
+        std::iota(m_order.begin(), m_order.end(), PersonId{0});
+        if (m_gen) {
+            std::shuffle(m_order.begin(), m_order.end(), *m_gen);
+        }
+    }
+
+    std::vector<PersonId> run()
+    {
+        greedy();
+        while (layers()) {
+            std::fill(m_cursor.begin(), m_cursor.end(), 0);
+            for (const auto d : m_order) {
+                if (m_gifteeOf[d] == unmatched) {
+                    augment(d);
+                }
+            }
+        }
+        return m_gifteeOf;
+    }
+
+private:
+    // initial matching: every donor takes the first free giftee (from a
+    // random position on, wrapping around, if randomized)
+    void greedy()
+    {
+        const auto words = m_model.numWords();
+        std::vector<bitset::Word> free(words, ~bitset::Word{0});
+        std::uniform_int_distribution<std::size_t> start(
+            0, m_model.size() > 0 ? m_model.size() - 1 : 0);
+
+        for (const auto d : m_order) {
+            const auto* row = m_model.gifteesOf(d);
+            auto g = bitset::findNextAnd(row, free.data(), words,
+                                         m_gen ? start(*m_gen) : 0);
+            if (g == bitset::npos && m_gen) {
+                g = bitset::findNextAnd(row, free.data(), words, 0);
+            }
+            if (g != bitset::npos) {
+                bitset::reset(free.data(), g);
+                m_gifteeOf[d] = static_cast<PersonId>(g);
+                m_donorOf[g] = d;
+            }
+        }
+    }
+
+    // breadth first search from the unmatched donors along alternating
+    // paths. Returns true if a free giftee is reachable. Every giftee is
+    // visited only once (the first visit determines the layer of its donor),
+    // so this is O(people * words) instead of O(allowed pairs).
+    bool layers()
+    {
+        const auto words = m_model.numWords();
+        std::vector<bitset::Word> unseen(words, ~bitset::Word{0});
+
+        std::vector<PersonId> queue;
+        for (PersonId d = 0; d < m_model.size(); ++d) {
+            if (m_gifteeOf[d] == unmatched) {
+                m_dist[d] = 0;
+                queue.push_back(d);
+            } else {
+                m_dist[d] = infDist;
+            }
+        }
+
+        bool found = false;
+        for (std::size_t q = 0; q < queue.size(); ++q) {
+            const PersonId d = queue[q];
+            bitset::forEachAnd(m_model.gifteesOf(d), unseen.data(), words,
+                               [&](std::size_t g) {
+                                   bitset::reset(unseen.data(), g);
+                                   const PersonId next = m_donorOf[g];
+                                   if (next == unmatched) {
+                                       found = true;
+                                   } else if (m_dist[next] == infDist) {
+                                       m_dist[next] = m_dist[d] + 1;
+                                       queue.push_back(next);
+                                   }
+                               });
+        }
+        return found;
+    }
+
+    // depth first search for an augmenting path along the layers (iterative,
+    // such that long paths don't exhaust the stack)
+    bool augment(PersonId root)
+    {
+        const auto words = m_model.numWords();
+        std::vector<PersonId> donors{root};
+        std::vector<PersonId> giftees;
+
+        while (!donors.empty()) {
+            const PersonId d = donors.back();
+            const auto g = bitset::findNext(m_model.gifteesOf(d), words,
+                                            m_cursor[d]);
+            if (g == bitset::npos) {
+                // dead end, don't visit this donor again in this phase
+                m_dist[d] = infDist;
+                donors.pop_back();
+                if (!giftees.empty()) {
+                    giftees.pop_back();
+                }
+                continue;
+            }
+
+            m_cursor[d] = g + 1;
+            const PersonId next = m_donorOf[g];
+            if (next == unmatched) {
+                // augmenting path found, flip it
+                giftees.push_back(static_cast<PersonId>(g));
+                for (std::size_t i = 0; i < donors.size(); ++i) {
+                    m_gifteeOf[donors[i]] = giftees[i];
+                    m_donorOf[giftees[i]] = donors[i];
+                }
+                return true;
+            } else if (m_dist[next] != infDist &&
+                       m_dist[next] == m_dist[d] + 1) {
+                giftees.push_back(static_cast<PersonId>(g));
+                donors.push_back(next);
+            }
+        }
+
+        return false;
+    }
+
+    const ConstraintModel& m_model;
+    std::mt19937* m_gen;
+    std::vector<PersonId> m_order;
+    std::vector<PersonId> m_gifteeOf;
+    std::vector<PersonId> m_donorOf;
+    std::vector<unsigned int> m_dist;
+    std::vector<std::size_t> m_cursor;
+};
+}  // namespace
+
+namespace matching
+{
+std::vector<PersonId> maximumMatching(const ConstraintModel& model)
+{
+    return HopcroftKarp(model).run();
+}
+
+std::vector<PersonId> randomMatching(const ConstraintModel& model,
+                                     std::mt19937& gen)
+{
+    return HopcroftKarp(model, &gen).run();
+}
+
+std::vector<PersonId> hallViolation(const ConstraintModel& model,
+                                    const std::vector<PersonId>& gifteeOf,
+                                    std::vector<PersonId>& giftees)
+{
+    std::vector<PersonId> donors;
+    giftees.clear();
+
+    std::vector<PersonId> donorOf(model.size(), unmatched);
+    PersonId root{unmatched};
+    for (PersonId d = 0; d < model.size(); ++d) {
+        if (gifteeOf[d] == unmatched) {
+            root = root == unmatched ? d : root;
+        } else {
+            donorOf[gifteeOf[d]] = d;
+        }
+    }
+
+    if (root == unmatched) {
+        // perfect matching, Hall's condition holds
+        return donors;
+    }
+
+    // all donors reachable from the unmatched one via alternating paths. As
+    // the matching is maximum, every giftee reached is matched, hence the
+    // donors found have exactly one giftee less than there are donors
+    std::vector<bool> seenDonor(model.size(), false);
+    std::vector<bool> seenGiftee(model.size(), false);
+    donors.push_back(root);
+    seenDonor[root] = true;
+    for (std::size_t q = 0; q < donors.size(); ++q) {
+        bitset::forEach(model.gifteesOf(donors[q]), model.numWords(),
+                        [&](std::size_t g) {
+                            if (!seenGiftee[g]) {
+                                seenGiftee[g] = true;
+                                giftees.push_back(static_cast<PersonId>(g));
+                                const PersonId d = donorOf[g];
+                                if (d != unmatched && !seenDonor[d]) {
+                                    seenDonor[d] = true;
+                                    donors.push_back(d);
+                                }
+                            }
+                        });
+    }
+
+    return donors;
+}
+}  // namespace matching
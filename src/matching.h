@@ -0,0 +1,46 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <random>
+#include <vector>
+
+#include "constraints.h"
+#include "person.h"
+
+// bipartite matchings between donors and giftees
+namespace matching
+{
+constexpr PersonId unmatched{~PersonId{0}};
+
+// maximum matching of donors to allowed giftees (Hopcroft-Karp). Returns the
+// giftee of every donor (or unmatched)
+std::vector<PersonId> maximumMatching(const constraints::ConstraintModel& model);
+
+// like maximumMatching(), but the donors are matched in a random order (so
+// a different matching is found every time if there are several)
+std::vector<PersonId> randomMatching(const constraints::ConstraintModel& model,
+                                     std::mt19937& gen);
+
+// for a maximum matching which isn't perfect: a set of donors which together
+// have fewer allowed giftees than there are donors in the set (i.e. a
+// violation of Hall's condition). The giftees they may give to are stored in
+// giftees
+std::vector<PersonId> hallViolation(const constraints::ConstraintModel& model,
+                                    const std::vector<PersonId>& gifteeOf,
+                                    std::vector<PersonId>& giftees);
+}  // namespace matching
@@ -17,98 +17,321 @@
 #include "parser.h"
 
 #include <algorithm>
-#include <fstream>
 #include <iostream>
+#include <map>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 
-#include "output.h"
+#include "arena.h"
+#include "log.h"
+#include "mappedfile.h"
 
 namespace
 {
-// parse a list of (delimited) names
-void parseBlockedGiftees(Person &p, std::istringstream &is);
+// largest weight of a soft constraint (such that the sums over all people
+// can't overflow)
+constexpr unsigned int maxWeight{1000000};
+
+// index of the participants' names (views into the name arena)
+using NameIndex = std::unordered_map<std::string_view, PersonId>;
+
+// whitespace (like std::isspace() in the "C" locale)
+bool isSpace(char c);
+
+// returns the next whitespace delimited token of the line starting at pos
+// (and moves pos behind it), empty if there is none
+std::string_view nextToken(std::string_view line, std::size_t &pos);
+
+// the donors which blocked a name not belonging to any participant
+using UnknownNames = std::map<std::string_view, std::vector<PersonId>>;
+
+// parse a list of (delimited) names and resolve them to IDs, names with a
+// weight ("<name>:<weight>") are soft constraints
+void parseBlockedGiftees(Person &p, std::string_view list,
+                         const NameIndex &index, UnknownNames &unknown);
+
+// removes the weight from a "<name>:<weight>" entry and returns it
+std::optional<unsigned int> splitWeight(std::string_view &entry);
+
+// reports the blocked names which don't belong to any participant
+void reportUnknown(const std::vector<Person> &people,
+                   const UnknownNames &unknown, std::ostream &diag);
 
 // debug prints the parsed configuration
 void debugPrintCfg(const std::vector<Person> &people);
 
-void parseBlockedGiftees(Person &p, std::istringstream &is)
+// the group name if the line is a group line "[<name>]"
+std::optional<std::string_view> groupLine(std::string_view line);
+
+// writes the text to diag, every line prefixed with the group name
+void prefixedDiag(std::string_view group, const std::string &text,
+                  std::ostream &diag);
+
+bool isSpace(char c)
 {
-    std::string s;
-    while (is >> s) {
-        std::string tmp;
-        for (auto c = s.cbegin(); c != s.cend(); c++) {
-            if (*c == ',' || *c == ';') {
-                if (tmp.size() > 0) {
-                    p.blockedNames.insert(tmp);
-                    tmp = "";
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' ||
+           c == '\r';
+}
+
+std::string_view nextToken(std::string_view line, std::size_t &pos)
+{
+    while (pos < line.size() && isSpace(line[pos])) {
+        ++pos;
+    }
+    const auto begin = pos;
+    while (pos < line.size() && !isSpace(line[pos])) {
+        ++pos;
+    }
+    return line.substr(begin, pos - begin);
+}
+
+void parseBlockedGiftees(Person &p, std::string_view list,
+                         const NameIndex &index, UnknownNames &unknown)
+{
+    std::size_t pos{0};
+    for (auto s = nextToken(list, pos); !s.empty(); s = nextToken(list, pos)) {
+        // the names within a token are separated by ',' or ';'
+        std::size_t begin{0};
+        while (begin <= s.size()) {
+            auto end = s.find_first_of(",;", begin);
+            if (end == std::string_view::npos) {
+                end = s.size();
+            }
+            if (end > begin) {
+                auto name = s.substr(begin, end - begin);
+                const auto weight = splitWeight(name);
+                const auto it = index.find(name);
+                if (it != index.end() && weight) {
+                    p.penalties.push_back({it->second, *weight});
+                } else if (it != index.end()) {
+                    p.blocked.push_back(it->second);
+                } else {
+                    unknown[name].push_back(p.id);
                 }
-            } else {
-                tmp += *c;
             }
+            begin = end + 1;
         }
+    }
+}
+
+std::optional<unsigned int> splitWeight(std::string_view &entry)
+{
+    const auto colon = entry.rfind(':');
+    if (colon == std::string_view::npos || colon == 0 ||
+        colon + 1 == entry.size()) {
+        return std::nullopt;
+    }
+
+    unsigned int weight{0};
+    for (const auto c : entry.substr(colon + 1)) {
+        if (c < '0' || c > '9') {
+            return std::nullopt;
+        }
+        weight = weight * 10 + static_cast<unsigned int>(c - '0');
+        if (weight > maxWeight) {
+            return std::nullopt;
+        }
+    }
+    if (weight == 0) {
+        return std::nullopt;
+    }
+
+    entry = entry.substr(0, colon);
+    return weight;
+}
 
-        if (tmp.size() > 0) {
-            p.blockedNames.insert(tmp);
+void reportUnknown(const std::vector<Person> &people,
+                   const UnknownNames &unknown, std::ostream &diag)
+{
+    for (const auto &[name, donors] : unknown) {
+        diag << name << " is not a participant (blocked by ";
+        for (auto it = donors.cbegin(); it != donors.cend(); ++it) {
+            diag << (it == donors.cbegin() ? "" : ", ") << people[*it].name;
         }
+        diag << ")" << std::endl;
     }
 }
 
 void debugPrintCfg(const std::vector<Person> &people)
 {
-    for (const auto &p : people) {
-        dbg << p.name << ":";
+    if (!logging::enabled(logging::Level::trace)) {
+        return;
+    }
 
-        for (const auto &b : p.blockedNames) {
-            dbg << " " << b;
+    for (const auto &p : people) {
+        std::string line{p.name};
+        line += ":";
+        for (const auto b : p.blocked) {
+            line += " ";
+            line += people[b].name;
         }
-
-        dbg << std::endl;
+        for (const auto &penalty : p.penalties) {
+            line += " ";
+            line += people[penalty.giftee].name;
+            line += ":" + std::to_string(penalty.weight);
+        }
+        LOG(trace) << line;
     }
+}
+std::optional<std::string_view> groupLine(std::string_view line)
+{
+    std::size_t pos{0};
+    const auto token = nextToken(line, pos);
+    if (token.size() < 2 || token.front() != '[' || token.back() != ']' ||
+        !nextToken(line, pos).empty()) {
+        return std::nullopt;
+    }
+    return token.substr(1, token.size() - 2);
+}
 
-    dbg << std::endl;
+void prefixedDiag(std::string_view group, const std::string &text,
+                  std::ostream &diag)
+{
+    std::size_t begin{0};
+    while (begin < text.size()) {
+        auto end = text.find('\n', begin);
+        end = end == std::string::npos ? text.size() : end + 1;
+        diag << group << ": "
+             << std::string_view(text).substr(begin, end - begin);
+        begin = end;
+    }
 }
 }  // namespace
 
-bool operator==(const Person &x, const Person &y) { return x.name == y.name; }
-
 std::vector<Person> parseFile(const std::string &fIn, const bool sendEmails)
+{
+    // the file is tokenized in place (the names are views into it until
+    // they're interned or resolved)
+    const io::MappedFile inputFile(fIn);
+    if (!inputFile.ok()) {
+        std::cerr << "Could not read " << fIn << std::endl;
+        return {};
+    }
+
+    return parseConfig(inputFile.data(), sendEmails, std::cerr);
+}
+
+std::vector<Person> parseConfig(std::string_view data, const bool sendEmails,
+                                std::ostream &diag)
 {
     std::vector<Person> people;
 
-    std::ifstream inputFile(fIn);
+    // first pass: the participants, i.e. the first name on every line (such
+    // that blocked names can be resolved no matter where the blocked person
+    // is listed). The rest of the line is parsed in the second pass.
+    NameIndex index;
+    std::vector<std::string_view> blockedLists;
 
-    std::string line;
-    while (std::getline(inputFile, line)) {
-        std::istringstream entry(line);
-        std::string name;
+    std::size_t lineBegin{0};
+    while (lineBegin < data.size()) {
+        auto lineEnd = data.find('\n', lineBegin);
+        if (lineEnd == std::string_view::npos) {
+            lineEnd = data.size();
+        }
+        const auto line = data.substr(lineBegin, lineEnd - lineBegin);
+        lineBegin = lineEnd + 1;
 
-        entry >> name;
+        std::size_t pos{0};
+        const auto name = nextToken(line, pos);
         if (!name.empty()) {
-            Person p{name, {}, {}};
+            // check if this person doesn't exist yet in the list, otherwise
+            // assign the next dense ID. The name is interned into the arena
+            // (the only copy of it, the index and the person refer to it).
+            const auto id = static_cast<PersonId>(people.size());
+            const auto interned = arena::intern(name);
+            if (index.emplace(interned, id).second) {
+                Person p{interned, {}, {}, id};
 
-            if (sendEmails) {
-                std::string email;
-                entry >> email;
-                p.email = email;
-            }
+                if (sendEmails) {
+                    p.email = arena::intern(nextToken(line, pos));
+                }
 
-            // check if this person doesn't exist yet in the list
-            if (find(people.cbegin(), people.cend(), p) == people.cend()) {
-                parseBlockedGiftees(p, entry);
-                people.emplace_back(p);
+                people.emplace_back(std::move(p));
+                blockedLists.push_back(line.substr(pos));
             } else {
-                std::cerr
-                    << name
-                    << " appears multiple times (using just the first entry)"
-                    << std::endl;
+                diag << name
+                     << " appears multiple times (using just the first entry)"
+                     << std::endl;
             }
         }
     }
 
-    dbg << people.size() << " people parsed" << std::endl;
+    UnknownNames unknown;
+    for (auto &p : people) {
+        parseBlockedGiftees(p, blockedLists[p.id], index, unknown);
+    }
+    reportUnknown(people, unknown, diag);
+
+    LOG(debug) << people.size() << " people parsed";
 
     debugPrintCfg(people);
 
     return people;
 }
+
+std::vector<Group> parseGroups(std::string_view data, const bool sendEmails,
+                               std::ostream &diag)
+{
+    std::vector<Group> groups;
+
+    // the group's name and the part of the data belonging to it
+    std::string_view name;
+    std::size_t sectionBegin{0};
+    auto addGroup = [&](std::size_t sectionEnd) {
+        const auto section =
+            data.substr(sectionBegin, sectionEnd - sectionBegin);
+        if (name.empty()) {
+            std::size_t pos{0};
+            if (nextToken(section, pos).empty()) {
+                // nothing before the first group line
+                return;
+            }
+            groups.push_back(Group{{}, parseConfig(section, sendEmails, diag)});
+        } else {
+            std::ostringstream groupDiag;
+            groups.push_back(
+                Group{std::string{name},
+                      parseConfig(section, sendEmails, groupDiag)});
+            prefixedDiag(name, groupDiag.str(), diag);
+        }
+    };
+
+    std::size_t lineBegin{0};
+    while (lineBegin < data.size()) {
+        auto lineEnd = data.find('\n', lineBegin);
+        if (lineEnd == std::string_view::npos) {
+            lineEnd = data.size();
+        }
+        const auto line = data.substr(lineBegin, lineEnd - lineBegin);
+
+        if (const auto group = groupLine(line)) {
+            addGroup(lineBegin);
+            name = *group;
+            sectionBegin = std::min(lineEnd + 1, data.size());
+        }
+        lineBegin = lineEnd + 1;
+    }
+    addGroup(data.size());
+
+    // a configuration without any group line is a single group, even if it's
+    // empty
+    if (groups.empty() && name.empty()) {
+        groups.push_back(Group{});
+    }
+
+    return groups;
+}
+
+std::vector<Group> parseGroupFile(const std::string &fIn, const bool sendEmails)
+{
+    const io::MappedFile inputFile(fIn);
+    if (!inputFile.ok()) {
+        std::cerr << "Could not read " << fIn << std::endl;
+        return {};
+    }
+
+    return parseGroups(inputFile.data(), sendEmails, std::cerr);
+}
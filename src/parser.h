@@ -13,11 +13,32 @@
 // You should have received a copy of the GNU General Public License
 // along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
 //
-
 #pragma once
 
+#include <ostream>
+#include <string>
+#include <string_view>
 #include <vector>
 
 #include "person.h"
 
+// parses the configuration file. Every person gets a dense ID (its index in
+// the list) and the blocked names are resolved to these IDs, names which
+// don't belong to any participant are reported.
 std::vector<Person> parseFile(const std::string& fIn, const bool sendEmails);
+
+// like parseFile(), but parses the configuration from memory. Duplicate and
+// unknown names are reported to diag.
+std::vector<Person> parseConfig(std::string_view data, const bool sendEmails,
+                                std::ostream& diag);
+
+// parses a configuration which may be split into groups by lines
+// "[<group name>]". Every group is parsed like a configuration of its own,
+// people listed before the first group line form a group without a name
+// (which is the only group if there are no group lines at all).
+std::vector<Group> parseGroups(std::string_view data, const bool sendEmails,
+                               std::ostream& diag);
+
+// like parseGroups(), but reads the configuration file
+std::vector<Group> parseGroupFile(const std::string& fIn,
+                                  const bool sendEmails);
@@ -18,10 +18,37 @@
 
 #include <optional>
 #include <string>
-#include <unordered_set>
+#include <string_view>
+#include <vector>
+
+// dense integer ID of a participant (index into the constraint model)
+using PersonId = unsigned int;
+
+// a soft constraint: giving a gift to the giftee is allowed, but it costs
+// the weight (e.g. a giftee of the last years or someone of the household)
+struct Penalty {
+    PersonId giftee{0};
+    unsigned int weight{0};
+};
 
 struct Person {
+    // the name and the email address are views into the arena the parser
+    // interns them into (see arena::intern()), or into any other storage
+    // which outlives the person
+    std::string_view name;
+    std::optional<std::string_view> email;
+    // IDs of the people this person may not give a gift to (might contain
+    // duplicates)
+    std::vector<PersonId> blocked;
+    PersonId id{0};
+    // giftees this person should rather not give a gift to
+    std::vector<Penalty> penalties{};
+};
+
+// an independent set of participants (IDs and blocked names refer to the
+// group only)
+struct Group {
+    // empty for a configuration without groups
     std::string name;
-    std::optional<std::string> email;
-    std::unordered_set<std::string> blockedNames;
+    std::vector<Person> people;
 };
@@ -0,0 +1,562 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "server.h"
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "log.h"
+#include "mappedfile.h"
+#include "parser.h"
+#include "person.h"
+#include "solver.h"
+#include "threadpool.h"
+
+namespace
+{
+// connections served at the same time (further ones wait to be accepted)
+constexpr unsigned int maxConnections{16};
+
+// connections without a request for this long are closed
+constexpr time_t idleTimeoutSec{60};
+
+// longest request line accepted
+constexpr std::size_t maxRequestLength{4096};
+
+// attempts to find a list different from the last one when re-solving
+constexpr unsigned int maxResolveAttempts{20};
+
+// how often the accept loop checks for a stop request
+constexpr int stopPollMs{500};
+
+// set by the signal handler
+volatile std::sig_atomic_t stopRequested{0};
+
+// identifies the version of a file on disk (an editor replacing the file gives
+// it a new inode)
+struct FileStamp {
+    dev_t device{0};
+    ino_t inode{0};
+    off_t size{0};
+    std::int64_t mtimeNs{0};
+
+    bool operator==(const FileStamp& other) const
+    {
+        return device == other.device && inode == other.inode &&
+               size == other.size && mtimeNs == other.mtimeNs;
+    }
+};
+
+// a compiled group of a configuration file
+struct Roster {
+    Roster(std::string n, const std::vector<Person>& people)
+        : name(std::move(n)), problem(people)
+    {
+    }
+
+    std::string name;
+    const solver::Problem problem;
+    // serializes the requests on this group, guards cycle
+    std::mutex mtx{};
+    // the list handed out last ("solve" returns it again)
+    std::vector<PersonId> cycle{};
+};
+
+// a compiled configuration file
+struct LoadedConfig {
+    FileStamp stamp{};
+    // the parser's warnings
+    std::string diagnostics{};
+    std::vector<std::unique_ptr<Roster>> rosters{};
+};
+
+// the configuration files compiled so far, by path
+class Store
+{
+public:
+    // only the files inside root (a canonical path) are served
+    explicit Store(std::filesystem::path root) : m_root(std::move(root)) {}
+
+    // the compiled configuration file (relative to the root), (re)loaded if
+    // it isn't known yet or it changed on disk. Throws std::runtime_error if
+    // it can't be read or it's outside of the root.
+    std::shared_ptr<LoadedConfig> get(const std::string& filename);
+
+private:
+    // the canonical path of the file, throws std::runtime_error if it's
+    // missing or outside of the root
+    std::string resolve(const std::string& filename) const;
+
+    const std::filesystem::path m_root;
+    std::mutex m_mtx{};
+    std::map<std::string, std::shared_ptr<LoadedConfig>> m_configs{};
+};
+
+// the current version of the file, throws std::runtime_error if there's none
+FileStamp fileStamp(const std::string& filename);
+
+// parses and compiles the configuration file
+std::shared_ptr<LoadedConfig> load(const std::string& filename,
+                                   const FileStamp& stamp);
+
+// ignores SIGPIPE and requests a stop on SIGINT and SIGTERM
+void installSignalHandlers();
+
+// creates the listening socket, returns -1 on failure
+int listenOn(const std::string& path);
+
+// answers the requests of a client until it disconnects
+void serveConnection(int fd, Store& store, const config::Config& cfg);
+
+// answers a single request line
+std::string handleRequest(const std::string& line, Store& store,
+                          const config::Config& cfg);
+
+// the answer for one group
+std::string solveRoster(Roster& roster, const solver::Options& options,
+                        bool resolve);
+
+// the problems found by the quick checks, on one line
+std::string findingsLine(const solver::Problem& problem,
+                         const std::vector<analysis::Finding>& findings);
+
+// the group's name in the answers
+std::string groupLabel(const Roster& roster);
+
+// sends all of the data, returns false if the client is gone
+bool sendAll(int fd, const std::string& data);
+
+extern "C" void onStopSignal(int) { stopRequested = 1; }
+
+std::shared_ptr<LoadedConfig> Store::get(const std::string& name)
+{
+    const auto filename = resolve(name);
+    const auto stamp = fileStamp(filename);
+    bool reload = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        const auto it = m_configs.find(filename);
+        if (it != m_configs.end()) {
+            if (it->second->stamp == stamp) {
+                return it->second;
+            }
+            reload = true;
+        }
+    }
+
+    // parsing doesn't block the requests on other files. If the file changes
+    // while it's read, the stamp is outdated and it's loaded again next time.
+    auto config = load(filename, stamp);
+    LOG(info) << (reload ? "reloaded " : "loaded ") << filename << " ("
+              << config->rosters.size() << " groups)";
+
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_configs[filename] = config;
+    return config;
+}
+
+std::string Store::resolve(const std::string& filename) const
+{
+    // symbolic links are followed before checking, such that they can't lead
+    // out of the root either
+    std::error_code ec;
+    const auto path = std::filesystem::canonical(m_root / filename, ec);
+    if (ec) {
+        throw std::runtime_error("could not read " + filename + ": " +
+                                 ec.message());
+    }
+
+    const auto relative = path.lexically_relative(m_root);
+    if (relative.empty() || *relative.begin() == "..") {
+        throw std::runtime_error(filename + " is outside of " +
+                                 m_root.string());
+    }
+    return path.string();
+}
+
+FileStamp fileStamp(const std::string& filename)
+{
+    struct stat st {
+    };
+    if (stat(filename.c_str(), &st) != 0) {
+        throw std::runtime_error("could not read " + filename + ": " +
+                                 std::strerror(errno));
+    }
+    if (!S_ISREG(st.st_mode)) {
+        throw std::runtime_error(filename + " is not a file");
+    }
+
+    return {st.st_dev, st.st_ino, st.st_size,
+            static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+                st.st_mtim.tv_nsec};
+}
+
+std::shared_ptr<LoadedConfig> load(const std::string& filename,
+                                   const FileStamp& stamp)
+{
+    const io::MappedFile file(filename);
+    if (!file.ok()) {
+        throw std::runtime_error("could not read " + filename);
+    }
+
+    std::ostringstream diag;
+    auto groups = parseGroups(file.data(), false, diag);
+
+    auto config = std::make_shared<LoadedConfig>();
+    config->stamp = stamp;
+    config->diagnostics = diag.str();
+    for (auto& group : groups) {
+        config->rosters.push_back(
+            std::make_unique<Roster>(std::move(group.name), group.people));
+    }
+    return config;
+}
+
+void installSignalHandlers()
+{
+    std::signal(SIGPIPE, SIG_IGN);
+    std::signal(SIGINT, onStopSignal);
+    std::signal(SIGTERM, onStopSignal);
+}
+
+int listenOn(const std::string& path)
+{
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Socket path " << path << " is too long" << std::endl;
+        return -1;
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::cerr << "Could not create socket: " << std::strerror(errno)
+                  << std::endl;
+        return -1;
+    }
+
+    // a socket left behind by a daemon which wasn't shut down cleanly is
+    // replaced, one which is still served isn't
+    struct stat st {
+    };
+    if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+        const int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        const bool inUse =
+            connect(probe, reinterpret_cast<const sockaddr*>(&addr),
+                    sizeof(addr)) == 0;
+        ::close(probe);
+        if (inUse) {
+            std::cerr << "Another daemon is serving " << path << std::endl;
+            ::close(fd);
+            return -1;
+        }
+        unlink(path.c_str());
+    }
+
+    // only the daemon's user may connect (the socket's permissions are
+    // taken from the umask)
+    const auto oldMask = umask(077);
+    const bool bound =
+        bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0;
+    umask(oldMask);
+
+    if (!bound || listen(fd, SOMAXCONN) != 0) {
+        std::cerr << "Could not listen on " << path << ": "
+                  << std::strerror(errno) << std::endl;
+        ::close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+void serveConnection(int fd, Store& store, const config::Config& cfg)
+{
+    timeval tv{idleTimeoutSec, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    std::string buffer;
+    char chunk[4096];
+    while (true) {
+        const auto end = buffer.find('\n');
+        if (end == std::string::npos) {
+            if (buffer.size() > maxRequestLength) {
+                sendAll(fd, "error request too long\n\n");
+                break;
+            }
+
+            // the client closed the connection, was idle for too long or the
+            // daemon is shutting down
+            const auto len = recv(fd, chunk, sizeof(chunk), 0);
+            if (len <= 0) {
+                break;
+            }
+            buffer.append(chunk, static_cast<std::size_t>(len));
+            continue;
+        }
+
+        auto line = buffer.substr(0, end);
+        buffer.erase(0, end + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            continue;
+        }
+
+        if (!sendAll(fd, handleRequest(line, store, cfg))) {
+            break;
+        }
+    }
+}
+
+std::string handleRequest(const std::string& line, Store& store,
+                          const config::Config& cfg)
+{
+    std::istringstream request(line);
+    std::string command;
+    std::string filename;
+    request >> command >> filename;
+
+    solver::Options options;
+    options.algorithm = cfg.getAlgorithm();
+    options.numThreads = cfg.getNumThreads();
+    options.timeBudgetSec = cfg.getTimeBudget();
+    std::string algorithm;
+    if (request >> algorithm) {
+        options.algorithm = algorithm;
+    }
+
+    LOG(debug) << "request: " << line;
+
+    std::string response;
+    try {
+        if (command != "validate" && command != "solve" &&
+            command != "resolve") {
+            throw std::runtime_error("unknown command " + command);
+        }
+        if (filename.empty()) {
+            throw std::runtime_error("no configuration file given");
+        }
+        if (!solver::singleCircle(options)) {
+            // the responses list the people in the order of the circle
+            throw std::runtime_error("algorithm " + options.algorithm +
+                                     " isn't supported by the daemon");
+        }
+
+        const auto config = store.get(filename);
+        if (command == "validate") {
+            std::istringstream diag(config->diagnostics);
+            for (std::string warning; std::getline(diag, warning);) {
+                response += "warning " + warning + "\n";
+            }
+        }
+
+        for (const auto& roster : config->rosters) {
+            if (command != "validate") {
+                response += solveRoster(*roster, options, command == "resolve");
+            } else if (roster->problem.findings().empty()) {
+                response += "ok " + groupLabel(*roster) + "\n";
+            } else {
+                response += "infeasible " + groupLabel(*roster) + " " +
+                            findingsLine(roster->problem,
+                                         roster->problem.findings()) +
+                            "\n";
+            }
+        }
+    } catch (const std::exception& e) {
+        response = std::string("error ") + e.what() + "\n";
+    }
+
+    return response + "\n";
+}
+
+std::string solveRoster(Roster& roster, const solver::Options& options,
+                        bool resolve)
+{
+    // concurrent requests for the same group get the same list
+    std::lock_guard<std::mutex> lock(roster.mtx);
+
+    if (resolve || roster.cycle.empty()) {
+        const auto previous = solver::canonicalCycle(roster.cycle);
+
+        solver::Assignment assignment;
+        for (unsigned int attempt = 0; attempt < maxResolveAttempts;
+             ++attempt) {
+            assignment = roster.problem.solve(options);
+            if (!assignment.found() || !resolve ||
+                solver::canonicalCycle(assignment.cycle) != previous) {
+                break;
+            }
+            LOG(debug) << "list found before already, trying again";
+        }
+
+        switch (assignment.outcome) {
+            case solver::Outcome::found:
+                roster.cycle = std::move(assignment.cycle);
+                break;
+            case solver::Outcome::infeasible:
+                return "infeasible " + groupLabel(roster) +
+                       (assignment.findings.empty()
+                            ? ""
+                            : " " + findingsLine(roster.problem,
+                                                 assignment.findings)) +
+                       "\n";
+            case solver::Outcome::notFound:
+                return "notfound " + groupLabel(roster) + "\n";
+            case solver::Outcome::invalidOptions:
+                throw std::runtime_error(assignment.error);
+        }
+    }
+
+    const auto& model = roster.problem.model();
+    std::string line = "found " + groupLabel(roster);
+    for (const auto id : roster.cycle) {
+        line += " ";
+        line += model.name(id);
+    }
+    return line + "\n";
+}
+
+std::string findingsLine(const solver::Problem& problem,
+                         const std::vector<analysis::Finding>& findings)
+{
+    std::ostringstream os;
+    analysis::printFindings(problem.model(), findings, os);
+
+    // one finding per line, each one indented by a space
+    std::istringstream lines(os.str());
+    std::string joined;
+    for (std::string finding; std::getline(lines, finding);) {
+        joined += (joined.empty() ? "" : "; ") + finding.substr(1);
+    }
+    return joined;
+}
+
+std::string groupLabel(const Roster& roster)
+{
+    return roster.name.empty() ? "-" : roster.name;
+}
+
+bool sendAll(int fd, const std::string& data)
+{
+    std::size_t sent{0};
+    while (sent < data.size()) {
+        const auto len =
+            ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (len <= 0) {
+            return false;
+        }
+        sent += static_cast<std::size_t>(len);
+    }
+    return true;
+}
+}  // namespace
+
+namespace server
+{
+bool run(const config::Config& cfg)
+{
+    std::error_code ec;
+    const auto root = std::filesystem::canonical(
+        cfg.getConfigDir().empty() ? std::filesystem::current_path(ec)
+                                   : std::filesystem::path(cfg.getConfigDir()),
+        ec);
+    if (ec || !std::filesystem::is_directory(root, ec)) {
+        std::cerr << "Configuration directory " << cfg.getConfigDir()
+                  << " not found" << std::endl;
+        return false;
+    }
+
+    const auto& path = cfg.getSocketPath();
+    const int listenFd = listenOn(path);
+    if (listenFd < 0) {
+        return false;
+    }
+    installSignalHandlers();
+    LOG(info) << "serving requests on " << path << " for the files in "
+              << root.string();
+
+    Store store(root);
+
+    // the open connections, shut down when stopping such that their workers
+    // don't wait for idle clients
+    std::mutex clientsMtx;
+    std::set<int> clients;
+
+    {
+        threadpool::ThreadPool pool(maxConnections);
+        while (!stopRequested) {
+            pollfd pfd{listenFd, POLLIN, 0};
+            if (poll(&pfd, 1, stopPollMs) <= 0) {
+                continue;
+            }
+
+            const int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                continue;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(clientsMtx);
+                clients.insert(fd);
+            }
+            pool.submit([fd, &store, &cfg, &clientsMtx, &clients]() {
+                try {
+                    serveConnection(fd, store, cfg);
+                } catch (const std::exception& e) {
+                    LOG(error) << "connection failed: " << e.what();
+                }
+
+                std::lock_guard<std::mutex> lock(clientsMtx);
+                clients.erase(fd);
+                ::close(fd);
+            });
+        }
+
+        LOG(info) << "shutting down";
+        ::close(listenFd);
+        unlink(path.c_str());
+
+        std::lock_guard<std::mutex> lock(clientsMtx);
+        for (const auto fd : clients) {
+            shutdown(fd, SHUT_RDWR);
+        }
+    }
+
+    return true;
+}
+}  // namespace server
@@ -0,0 +1,47 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include "config.h"
+
+// a long-running solver answering requests on a UNIX domain socket. The
+// configuration files are compiled once and kept in memory, such that a
+// request only costs the search itself. Every request is a line
+//   <command> <configuration file> [<algorithm>]
+// with the commands
+//   validate  parse the file and run the quick checks
+//   solve     the list of every group (the same one again for repeated
+//             requests, as long as the file doesn't change)
+//   resolve   a new list for every group, different from the last one if
+//             possible
+// and is answered by one line per group, followed by an empty line:
+//   found <group> <name> <name> ...   (everyone gives to the next one, the
+//                                      last one to the first one)
+//   ok <group>                        (validate only)
+//   infeasible <group> [<problems>]
+//   notfound <group>
+// The group is "-" for a file without groups. Parser warnings are sent as
+// "warning <text>" lines (validate only), unusable requests are answered with
+// "error <text>". Only the configuration files inside cfg.getConfigDir() (the
+// working directory if empty) are served, the socket is only accessible by
+// the daemon's user.
+namespace server
+{
+// serves the requests on cfg.getSocketPath() until SIGINT or SIGTERM, returns
+// false if the socket couldn't be set up
+bool run(const config::Config& cfg);
+}  // namespace server
@@ -17,28 +17,87 @@
 #include "shuffle.h"
 
 #include <algorithm>
-#include <iostream>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <optional>
 #include <random>
 
-#include "output.h"
+#include "log.h"
+#include "stats.h"
+#include "threadpool.h"
 
 namespace
 {
+using constraints::ConstraintModel;
+using Clock = std::chrono::steady_clock;
+
+// probability to keep a random swap which increases the number of donors
+// without a valid giftee
+constexpr double uphillProbability{0.01};
+
+// the random search looks at the clock every this many swaps only
+constexpr std::size_t deadlineCheckInterval{1024};
+
+// parameters of the local search: maximum segment lengths of the moves,
+// probability of an or-opt move (vs. a segment reversal), probability of
+// moving an invalid giftee (vs. a random person), number of insertion points
+// evaluated per or-opt move
+constexpr std::size_t maxOrOptLength{3};
+constexpr std::size_t maxReversalLength{8};
+constexpr double orOptProbability{0.7};
+constexpr double guidedMoveProbability{0.9};
+constexpr unsigned int insertionCandidates{8};
+
+// annealing schedule: the temperature is lowered every few iterations and
+// reset once it's gotten too low
+constexpr double annealingStartTemp{1.0};
+constexpr double annealingMinTemp{0.05};
+constexpr double annealingCooling{0.99};
+constexpr std::size_t annealingStepIterations{1000};
+
+// the local search gives up after this many iterations per person
+constexpr std::size_t annealingIterationsPerPerson{2000};
+
+// number of tasks per thread for the parallel search (more tasks balance the
+// load better, but take longer to split)
+constexpr std::size_t tasksPerThread{16};
+
+using Order = std::vector<PersonId>;
+
 // randomizes the entries in the giftList
-void shuffleList(std::vector<Person> &giftList, std::mt19937 &randGen);
+void shuffleList(Order &giftList, std::mt19937 &randGen);
+
+// counts the donors in the list which don't have a valid giftee
+std::size_t countViolations(const ConstraintModel &model,
+                            const Order &giftList);
 
-// checks if the list is ok, i.e. all donors have a valid giftee
-bool checkList(const std::vector<Person> &giftList);
+// swaps the entries at positions ix1 and ix2 and returns the resulting change
+// of the number of donors without a valid giftee. Only the (up to) four
+// donor->giftee pairs around the two positions are affected by a swap, so
+// this is O(1).
+int swapDelta(const ConstraintModel &model, Order &giftList, std::size_t ix1,
+              std::size_t ix2);
 
 // debug prints the list
-void debugList(const std::vector<Person> &list);
+void debugList(const ConstraintModel &model, const Order &list);
 
 // recursivley tries to swap elements in the people list to find a valid
-// sequence
-bool addGiftees(std::vector<Person> &giftList,
-                std::vector<Person>::iterator itDonor);
+// sequence (gives up as soon as cancel is set)
+bool addGiftees(const ConstraintModel &model, Order &giftList,
+                Order::iterator itDonor, stats::SolverStats &stats,
+                const std::atomic<bool> *cancel = nullptr);
+
+// like addGiftees(), but the top levels of the search tree are split into
+// independent tasks which are searched in parallel
+bool addGifteesParallel(const ConstraintModel &model, Order &giftList,
+                        unsigned int numThreads, stats::SolverStats &stats);
 
-void shuffleList(std::vector<Person> &giftList, std::mt19937 &randGen)
+void shuffleList(Order &giftList, std::mt19937 &randGen)
 {
     // swap two random elements in the list
     std::uniform_int_distribution<unsigned int> idist(0, giftList.size() - 1);
@@ -47,44 +106,88 @@ void shuffleList(std::vector<Person> &giftList, std::mt19937 &randGen)
     std::swap(giftList[ix1], giftList[ix2]);
 }
 
-bool checkList(const std::vector<Person> &giftList)
+std::size_t countViolations(const ConstraintModel &model,
+                            const Order &giftList)
 {
-    bool listOk = true;
+    std::size_t violations{0};
 
-    if (giftList.size() > 1) {
-        // giftee iterator points one ahead
-        auto itGiftee = ++(giftList.cbegin());
+    // giftee iterator points one ahead
+    auto itGiftee = ++(giftList.cbegin());
 
-        for (auto itDonor = giftList.cbegin();
-             listOk && itDonor != giftList.cend(); ++itDonor) {
-            // wrap around the giftee (which always points one ahead)
-            if (itGiftee == giftList.cend()) {
-                itGiftee = giftList.cbegin();
-            }
+    for (auto itDonor = giftList.cbegin(); itDonor != giftList.cend();
+         ++itDonor) {
+        // wrap around the giftee (which always points one ahead)
+        if (itGiftee == giftList.cend()) {
+            itGiftee = giftList.cbegin();
+        }
 
-            listOk &= (itDonor->blockedNames.find(itGiftee->name) ==
-                       itDonor->blockedNames.end());
+        if (!model.allowed(*itDonor, *itGiftee)) {
+            ++violations;
+        }
+
+        ++itGiftee;
+    }
 
-            ++itGiftee;
+    return violations;
+}
+
+int swapDelta(const ConstraintModel &model, Order &giftList, std::size_t ix1,
+              std::size_t ix2)
+{
+    const auto n = giftList.size();
+
+    // the donor positions whose giftee changes (without duplicates, e.g. when
+    // the two positions are neighbours)
+    std::array<std::size_t, 4> donors{};
+    std::size_t numDonors{0};
+    for (auto d : {(ix1 + n - 1) % n, ix1, (ix2 + n - 1) % n, ix2}) {
+        if (std::find(donors.begin(), donors.begin() + numDonors, d) ==
+            donors.begin() + numDonors) {
+            donors[numDonors++] = d;
         }
     }
 
-    return listOk;
+    auto violations = [&]() {
+        int v{0};
+        for (std::size_t k = 0; k < numDonors; ++k) {
+            const auto d = donors[k];
+            v += model.allowed(giftList[d], giftList[(d + 1) % n]) ? 0 : 1;
+        }
+        return v;
+    };
+
+    const int before = violations();
+    std::swap(giftList[ix1], giftList[ix2]);
+    return violations() - before;
 }
 
-void debugList(const std::vector<Person> &list)
+void debugList(const ConstraintModel &model, const Order &list)
 {
-    for (const auto &p : list) {
-        dbg << p.name << " -> ";
+    if (!logging::enabled(logging::Level::debug)) {
+        return;
+    }
+
+    std::string line;
+    for (const auto id : list) {
+        line += model.name(id);
+        line += " -> ";
     }
-    dbg << list.cbegin()->name << std::endl;
+    LOG(debug) << line << model.name(list.front());
 }
 
-bool addGiftees(std::vector<Person> &giftList,
-                std::vector<Person>::iterator itDonor)
+bool addGiftees(const ConstraintModel &model, Order &giftList,
+                Order::iterator itDonor, stats::SolverStats &stats,
+                const std::atomic<bool> *cancel)
 {
     bool success = false;
 
+    if (cancel && cancel->load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    ++stats.nodes;
+    stats.depth(static_cast<std::size_t>(itDonor - giftList.begin()) + 1);
+
     // giftee is pointing one ahead of donor
     auto itGiftee = itDonor + 1;
     if (itGiftee == giftList.end()) {
@@ -92,8 +195,7 @@ bool addGiftees(std::vector<Person> &giftList,
         // wrap-around, i.e. the first person in the list has to be a valid
         // giftee for the last person in the list
         itGiftee = giftList.begin();
-        if (itDonor->blockedNames.find(itGiftee->name) ==
-            itDonor->blockedNames.end()) {
+        if (model.allowed(*itDonor, *itGiftee)) {
             // last element is valid, we've got a valid sequence!
             success = true;
         }
@@ -104,20 +206,21 @@ bool addGiftees(std::vector<Person> &giftList,
         // to undo the swapping if it wasn't successful
         for (auto itNewGiftee = itGiftee; itNewGiftee != giftList.end();
              ++itNewGiftee) {
-            if (itDonor->blockedNames.find(itNewGiftee->name) ==
-                itDonor->blockedNames.end()) {
+            if (model.allowed(*itDonor, *itNewGiftee)) {
                 // itGiftee might point to the same element as itNewGiftee does.
                 // We don't need to worry about that, the library
                 // swap()-function takes care of it
                 std::swap(*itGiftee, *itNewGiftee);
 
-                if (addGiftees(giftList, itGiftee)) {
+                if (addGiftees(model, giftList, itGiftee, stats, cancel)) {
                     success = true;
                     break;
                 } else {
                     // undo the swapping (recover the original state of
                     // the list)
                     std::swap(*itGiftee, *itNewGiftee);
+                    ++stats.backtracks;
+                    stats.reject(*itDonor);
                 }
             }
         }
@@ -125,13 +228,376 @@ bool addGiftees(std::vector<Person> &giftList,
 
     return success;
 }
+
+bool addGifteesParallel(const ConstraintModel &model, Order &giftList,
+                        unsigned int numThreads, stats::SolverStats &stats)
+{
+    // a task is the beginning of the list which is fixed already (the last
+    // entry is the donor where the search continues). Starting from the
+    // first person we expand the top levels of the search tree (breadth
+    // first) until there are enough tasks to keep all threads busy.
+    const std::size_t minTasks = numThreads * tasksPerThread;
+    std::vector<Order> tasks{{giftList.front()}};
+    while (!tasks.empty() && tasks.size() < minTasks &&
+           tasks.front().size() + 1 < giftList.size()) {
+        std::vector<Order> expanded;
+        for (const auto &prefix : tasks) {
+            std::vector<bool> fixed(giftList.size(), false);
+            for (const auto id : prefix) {
+                fixed[id] = true;
+            }
+            for (const auto id : giftList) {
+                if (!fixed[id] && model.allowed(prefix.back(), id)) {
+                    expanded.emplace_back(prefix);
+                    expanded.back().push_back(id);
+                }
+            }
+        }
+        tasks = std::move(expanded);
+    }
+
+    LOG(debug) << "searching " << tasks.size() << " subtrees on "
+               << numThreads << " threads";
+
+    // the workers complete their lists from this copy (giftList itself is
+    // overwritten by the first one finding a valid list)
+    const Order base(giftList);
+    std::atomic<bool> found{false};
+    std::mutex resultMtx;
+
+    {
+        threadpool::ThreadPool pool(numThreads);
+        for (const auto &prefix : tasks) {
+            pool.submit([&model, &prefix, &base, &found, &resultMtx,
+                         &giftList, &stats] {
+                if (found.load(std::memory_order_relaxed)) {
+                    return;
+                }
+
+                // the fixed beginning followed by all remaining people
+                Order list(prefix);
+                std::vector<bool> fixed(base.size(), false);
+                for (const auto id : prefix) {
+                    fixed[id] = true;
+                }
+                for (const auto id : base) {
+                    if (!fixed[id]) {
+                        list.push_back(id);
+                    }
+                }
+
+                // every task counts on its own, the counters are added up
+                // at the end of the task
+                stats::SolverStats taskStats(base.size());
+                const bool success =
+                    addGiftees(model, list, list.begin() + prefix.size() - 1,
+                               taskStats, &found);
+
+                std::lock_guard<std::mutex> lock(resultMtx);
+                stats.merge(taskStats);
+                if (success && !found.exchange(true)) {
+                    stats.solutionFound();
+                    giftList = std::move(list);
+                }
+            });
+        }
+        pool.wait();
+    }
+
+    // all subtrees were searched exhaustively if nothing was found
+    return found.load();
+}
+
+// local search on the circle of people, stored as a doubly linked list (the
+// giftee and the donor of every person) such that moving people around is
+// O(1). The objective is the number of donors without a valid giftee.
+class LocalSearch
+{
+public:
+    LocalSearch(const ConstraintModel &model, std::mt19937 &gen)
+        : m_model(model),
+          m_gen(gen),
+          m_giftee(model.size()),
+          m_donor(model.size()),
+          m_violatedPos(model.size(), noPos)
+    {
+    }
+
+    // builds the initial circle by a random walk which takes an allowed (not
+    // yet used) giftee whenever there is one
+    void init()
+    {
+        const auto n = m_model.size();
+        const auto words = m_model.numWords();
+        std::vector<bitset::Word> unused(words, 0);
+        for (PersonId i = 0; i < n; ++i) {
+            bitset::set(unused.data(), i);
+        }
+
+        std::uniform_int_distribution<std::size_t> idist(0, n - 1);
+        const auto first = static_cast<PersonId>(idist(m_gen));
+        bitset::reset(unused.data(), first);
+        PersonId last = first;
+        for (std::size_t k = 1; k < n; ++k) {
+            // start looking at a random position for some randomization
+            const auto from = idist(m_gen);
+            auto next = bitset::findNextAnd(m_model.gifteesOf(last),
+                                            unused.data(), words, from);
+            if (next == bitset::npos) {
+                next = bitset::findNextAnd(m_model.gifteesOf(last),
+                                           unused.data(), words, 0);
+            }
+            if (next == bitset::npos) {
+                next = bitset::findNext(unused.data(), words, from);
+            }
+            if (next == bitset::npos) {
+                next = bitset::findNext(unused.data(), words, 0);
+            }
+            bitset::reset(unused.data(), next);
+            link(last, static_cast<PersonId>(next));
+            last = static_cast<PersonId>(next);
+        }
+        link(last, first);
+
+        for (PersonId i = 0; i < n; ++i) {
+            update(i);
+        }
+    }
+
+    // simulated annealing until no violations are left or the number of
+    // iterations is exhausted
+    bool run(std::size_t maxIterations, stats::SolverStats &stats)
+    {
+        std::uniform_real_distribution<double> pdist(0.0, 1.0);
+        double temperature{annealingStartTemp};
+
+        for (std::size_t it = 0; it < maxIterations && !m_violated.empty();
+             ++it) {
+            const bool useOrOpt = pdist(m_gen) < orOptProbability;
+            const int delta = useOrOpt ? proposeOrOpt() : proposeReversal();
+            ++stats.swapsTried;
+            if (delta <= 0 ||
+                pdist(m_gen) < std::exp(-delta / temperature)) {
+                useOrOpt ? applyOrOpt() : applyReversal();
+                ++stats.swapsAccepted;
+            } else {
+                stats.reject(m_segStart);
+            }
+
+            if (it % annealingStepIterations == 0) {
+                temperature *= annealingCooling;
+                if (temperature < annealingMinTemp) {
+                    // reheat to get out of the local minimum
+                    temperature = annealingStartTemp;
+                }
+            }
+            ++m_iterations;
+        }
+
+        return m_violated.empty();
+    }
+
+    Order order() const
+    {
+        Order list;
+        list.reserve(m_giftee.size());
+        PersonId p{0};
+        do {
+            list.push_back(p);
+            p = m_giftee[p];
+        } while (p != 0);
+        return list;
+    }
+
+    std::size_t iterations() const { return m_iterations; }
+
+private:
+    static constexpr std::size_t noPos{~std::size_t{0}};
+
+    bool bad(PersonId donor, PersonId giftee) const
+    {
+        return !m_model.allowed(donor, giftee);
+    }
+
+    void link(PersonId donor, PersonId giftee)
+    {
+        m_giftee[donor] = giftee;
+        m_donor[giftee] = donor;
+    }
+
+    // updates the set of donors without a valid giftee for one donor
+    void update(PersonId donor)
+    {
+        const bool isBad = bad(donor, m_giftee[donor]);
+        auto &pos = m_violatedPos[donor];
+        if (isBad && pos == noPos) {
+            pos = m_violated.size();
+            m_violated.push_back(donor);
+        } else if (!isBad && pos != noPos) {
+            m_violatedPos[m_violated.back()] = pos;
+            m_violated[pos] = m_violated.back();
+            m_violated.pop_back();
+            pos = noPos;
+        }
+    }
+
+    // the first person of a segment to be moved: mostly the invalid giftee of
+    // a donor (moving it elsewhere fixes that donor), sometimes a random one
+    PersonId pickSegmentStart()
+    {
+        std::uniform_real_distribution<double> pdist(0.0, 1.0);
+        if (!m_violated.empty() && pdist(m_gen) < guidedMoveProbability) {
+            std::uniform_int_distribution<std::size_t> vdist(
+                0, m_violated.size() - 1);
+            return m_giftee[m_violated[vdist(m_gen)]];
+        }
+
+        std::uniform_int_distribution<PersonId> idist(0, m_giftee.size() - 1);
+        return idist(m_gen);
+    }
+
+    // or-opt: move a segment of 1 to 3 people (keeping their order) between
+    // two other people. Of a few random insertion points the best one is
+    // taken. Returns the change of the number of violations.
+    int proposeOrOpt()
+    {
+        const auto n = m_giftee.size();
+        std::uniform_int_distribution<std::size_t> ldist(
+            1, std::min<std::size_t>(maxOrOptLength, n - 3));
+        m_segLength = ldist(m_gen);
+        m_segStart = pickSegmentStart();
+        m_segEnd = m_segStart;
+        for (std::size_t k = 1; k < m_segLength; ++k) {
+            m_segEnd = m_giftee[m_segEnd];
+        }
+
+        const PersonId before = m_donor[m_segStart];
+        const PersonId after = m_giftee[m_segEnd];
+        const int removed = bad(before, m_segStart) + bad(m_segEnd, after) -
+                            bad(before, after);
+
+        std::uniform_int_distribution<PersonId> idist(0, n - 1);
+        int bestDelta{std::numeric_limits<int>::max()};
+        for (unsigned int k = 0; k < insertionCandidates; ++k) {
+            // a must neither be part of the segment nor its donor
+            const PersonId a = idist(m_gen);
+            if (a == before || inSegment(a)) {
+                continue;
+            }
+
+            const PersonId b = m_giftee[a];
+            const int delta = bad(a, m_segStart) + bad(m_segEnd, b) -
+                              bad(a, b) - removed;
+            if (delta < bestDelta) {
+                bestDelta = delta;
+                m_insertAfter = a;
+            }
+        }
+
+        return bestDelta;
+    }
+
+    void applyOrOpt()
+    {
+        const PersonId before = m_donor[m_segStart];
+        const PersonId after = m_giftee[m_segEnd];
+        const PersonId a = m_insertAfter;
+        const PersonId b = m_giftee[a];
+
+        link(before, after);
+        link(a, m_segStart);
+        link(m_segEnd, b);
+
+        update(before);
+        update(a);
+        update(m_segEnd);
+    }
+
+    // 2-opt: reverse the direction of a (short) segment. Returns the change
+    // of the number of violations.
+    int proposeReversal()
+    {
+        const auto n = m_giftee.size();
+        std::uniform_int_distribution<std::size_t> ldist(
+            2, std::min<std::size_t>(maxReversalLength, n - 1));
+        m_segLength = ldist(m_gen);
+        m_segStart = pickSegmentStart();
+
+        const PersonId before = m_donor[m_segStart];
+        int delta{0};
+        PersonId p = m_segStart;
+        for (std::size_t k = 1; k < m_segLength; ++k) {
+            const PersonId q = m_giftee[p];
+            delta += bad(q, p) - bad(p, q);
+            p = q;
+        }
+        m_segEnd = p;
+        const PersonId after = m_giftee[m_segEnd];
+
+        return delta + bad(before, m_segEnd) + bad(m_segStart, after) -
+               bad(before, m_segStart) - bad(m_segEnd, after);
+    }
+
+    void applyReversal()
+    {
+        const PersonId before = m_donor[m_segStart];
+        const PersonId after = m_giftee[m_segEnd];
+
+        m_segment.clear();
+        for (PersonId p = m_segStart;; p = m_giftee[p]) {
+            m_segment.push_back(p);
+            if (p == m_segEnd) {
+                break;
+            }
+        }
+
+        link(before, m_segEnd);
+        for (std::size_t k = m_segment.size() - 1; k > 0; --k) {
+            link(m_segment[k], m_segment[k - 1]);
+        }
+        link(m_segStart, after);
+
+        update(before);
+        for (const auto p : m_segment) {
+            update(p);
+        }
+    }
+
+    bool inSegment(PersonId p) const
+    {
+        PersonId q = m_segStart;
+        for (std::size_t k = 0; k < m_segLength; ++k, q = m_giftee[q]) {
+            if (q == p) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const ConstraintModel &m_model;
+    std::mt19937 &m_gen;
+    std::vector<PersonId> m_giftee;
+    std::vector<PersonId> m_donor;
+    // donors without a valid giftee (and their position in that list)
+    std::vector<PersonId> m_violated{};
+    std::vector<std::size_t> m_violatedPos;
+    // the move proposed last
+    PersonId m_segStart{0};
+    PersonId m_segEnd{0};
+    std::size_t m_segLength{0};
+    PersonId m_insertAfter{0};
+    std::vector<PersonId> m_segment{};
+    std::size_t m_iterations{0};
+};
 }  // namespace
 
-bool findValidListRand(std::vector<Person> &giftList)
+bool findValidListRand(std::vector<PersonId> &cycle,
+                       const constraints::ConstraintModel &model,
+                       double timeBudgetSec, stats::SolverStats *stats)
 {
-    // this is the most stupid way to find a valid list. Whenever we
-    // detect that the current list is not ok, swap two randomly chosen
-    // entries in the list. In this way we're somewhat guaranteed that
+    // this is the most stupid way to find a valid list. As long as the
+    // current list is not ok, swap two randomly chosen entries in the
+    // list. In this way we're somewhat guaranteed that
     // after inifinite runtime we find the solution. However, for
     // configurations which have many constraints, this might take
     // aaaaaages. Therefore it's considered to be the most stupid
@@ -144,20 +610,76 @@ bool findValidListRand(std::vector<Person> &giftList)
     std::mt19937 gen(
         rd());  // Standard mersenne_twister_engine seeded with rd()
 
-    debugList(giftList);
+    auto order = constraints::identityOrder(model);
+    if (order.size() < 2) {
+        // no circle possible
+        return false;
+    }
 
-    while (!checkList(giftList)) {
-        shuffleList(giftList, gen);
-        debugList(giftList);
+    std::shuffle(order.begin(), order.end(), gen);
+    debugList(model, order);
+
+    // instead of checking the whole list after every swap we keep track of
+    // the number of donors without a valid giftee. A swap which doesn't
+    // increase that number is kept, a swap which does is undone (apart from a
+    // few random exceptions which allow to leave local minima).
+    std::uniform_int_distribution<std::size_t> idist(0, order.size() - 1);
+    std::uniform_real_distribution<double> pdist(0.0, 1.0);
+    stats::SolverStats localStats;
+    auto &st = stats ? *stats : localStats;
+    auto violations = countViolations(model, order);
+
+    // there might be no valid list at all (not every impossible
+    // configuration is caught by the quick checks), the search therefore
+    // gives up after the time budget
+    std::optional<Clock::time_point> deadline;
+    if (timeBudgetSec > 0) {
+        deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                      std::chrono::duration<double>(
+                                          timeBudgetSec));
     }
 
-    dbg << std::endl;
+    while (violations > 0) {
+        if (deadline && st.swapsTried % deadlineCheckInterval == 0 &&
+            Clock::now() > *deadline) {
+            LOG(info) << "time budget used up, giving up the random search";
+            return false;
+        }
+
+        const auto ix1 = idist(gen);
+        const auto ix2 = idist(gen);
+        if (ix1 == ix2) {
+            continue;
+        }
 
-    // we're not reaching this point if the list is not valid
+        const int delta = swapDelta(model, order, ix1, ix2);
+        if (delta <= 0 || pdist(gen) < uphillProbability) {
+            violations = static_cast<std::size_t>(
+                static_cast<int>(violations) + delta);
+            ++st.swapsAccepted;
+        } else {
+            // reject the swap
+            std::swap(order[ix1], order[ix2]);
+            st.reject(order[ix1]);
+            st.reject(order[ix2]);
+        }
+
+        ++st.swapsTried;
+        LOG(trace) << "swap " << st.swapsTried << ": " << violations
+                   << " donors without a valid giftee";
+    }
+    st.solutionFound();
+
+    LOG(debug) << st.swapsTried << " swaps tried";
+    debugList(model, order);
+
+    cycle = std::move(order);
     return true;
 }
 
-bool findValidListRecursive(std::vector<Person> &giftList)
+bool findValidListRecursive(std::vector<PersonId> &cycle,
+                            const constraints::ConstraintModel &model,
+                            unsigned int numThreads, stats::SolverStats *stats)
 {
     // This implementation is more smart than shuffle1(). In here we're trying
     // to recursively construct a valid list. So in the end we're scanning
@@ -173,48 +695,77 @@ bool findValidListRecursive(std::vector<Person> &giftList)
         rd;  // Will be used to obtain a seed for the random number engine
     std::mt19937 gen(
         rd());  // Standard mersenne_twister_engine seeded with rd()
-    for (decltype(giftList.size()) i = 0; i < giftList.size(); ++i) {
-        shuffleList(giftList, gen);
+    auto order = constraints::identityOrder(model);
+    for (decltype(order.size()) i = 0; i < order.size(); ++i) {
+        shuffleList(order, gen);
     }
 
-    if (addGiftees(giftList, giftList.begin())) {
+    stats::SolverStats localStats;
+    auto &st = stats ? *stats : localStats;
+
+    numThreads = threadpool::effectiveNumThreads(numThreads);
+    const bool found =
+        (numThreads > 1 && order.size() > 2)
+            ? addGifteesParallel(model, order, numThreads, st)
+            : (!order.empty() && addGiftees(model, order, order.begin(), st));
+
+    if (found) {
         success = true;
-        debugList(giftList);
-        dbg << std::endl;
-    } else {
-        std::cout << "No circular donor/giftee assignment possible"
-                  << std::endl;
+        st.solutionFound();
+        debugList(model, order);
+        cycle = std::move(order);
     }
 
     return success;
 }
 
-std::map<unsigned int, std::string> randomizePersonNumbers(
-    std::vector<Person> &people)
+bool findValidListAnneal(std::vector<PersonId> &cycle,
+                         const constraints::ConstraintModel &model,
+                         stats::SolverStats *stats)
 {
-    std::map<unsigned int, std::string> persNum;
+    // Constraint guided local search: start with a mostly valid circle and
+    // keep moving the invalid giftees to other places in the circle (or
+    // reverse short pieces of it). Moves which make things worse are accepted
+    // with a probability decreasing over time (simulated annealing), such
+    // that the search doesn't get stuck. This finds valid lists for very
+    // large numbers of people quickly, but it can't prove that there's none.
+    std::random_device rd;
+    std::mt19937 gen(rd());
 
-    // code below copied from
-    // https://en.cppreference.com/w/cpp/numeric/random/uniform_int_distribution
-    std::random_device
-        rd;  // Will be used to obtain a seed for the random number engine
-    std::mt19937 gen(
-        rd());  // Standard mersenne_twister_engine seeded with rd()
-    std::uniform_int_distribution<unsigned int> idist(0, people.size() - 1);
-
-    std::vector<bool> ids(people.size(), false);
-
-    for (const auto &p : people) {
-        // find a not yet used id for this person
-        unsigned int id = idist(gen);
-        while (ids[id]) {
-            if (++id == ids.size()) {
-                id = 0;
-            }
+    bool success = false;
+    const auto n = model.size();
+    if (n > 3) {
+        stats::SolverStats localStats;
+        auto &st = stats ? *stats : localStats;
+
+        LocalSearch search(model, gen);
+        search.init();
+        success = search.run(n * annealingIterationsPerPerson, st);
+        LOG(debug) << search.iterations() << " local search iterations";
+        if (success) {
+            st.solutionFound();
+            cycle = search.order();
+            debugList(model, cycle);
         }
-        ids[id] = true;
-        persNum.emplace(make_pair(id, p.name));
+    } else {
+        // too small for the moves, but small enough to search systematically
+        success = findValidListRecursive(cycle, model, 1, stats);
     }
 
-    return persNum;
+    return success;
+}
+
+std::vector<unsigned int> randomizePersonNumbers(
+    const std::vector<Person> &people)
+{
+    std::random_device rd;
+    std::mt19937 gen(rd());
+
+    // Fisher-Yates shuffle of the numbers (std::shuffle), i.e. O(n) no matter
+    // how many people there are
+    std::vector<unsigned int> numbers(people.size());
+    std::iota(numbers.begin(), numbers.end(), 0U);
+    std::shuffle(numbers.begin(), numbers.end(), gen);
+
+    return numbers;
 }
@@ -16,18 +16,40 @@
 
 #pragma once
 
-#include <map>
 #include <vector>
 
+#include "constraints.h"
 #include "person.h"
+#include "stats.h"
+
+// The solvers return the found donor->giftee list as the people's IDs in the
+// order of the circle (every person gives a gift to the next one, the last one
+// to the first one). They print nothing, false means there's no valid list (or
+// none was found by the incomplete searches).
 
 // find a valid donor->giftee list by randomly shuffling it (stupid but random
-// solution)
-bool findValidListRand(std::vector<Person>& giftList);
+// solution). It gives up after timeBudgetSec seconds (0: never, it doesn't
+// end then if there's no valid list). The search statistics are added to
+// stats if given.
+bool findValidListRand(std::vector<PersonId>& cycle,
+                       const constraints::ConstraintModel& model,
+                       double timeBudgetSec,
+                       stats::SolverStats* stats = nullptr);
+
+// find a valid donor->giftee list by constructing it recursively (the search
+// is split among numThreads threads, 0 uses all hardware threads)
+bool findValidListRecursive(std::vector<PersonId>& cycle,
+                            const constraints::ConstraintModel& model,
+                            unsigned int numThreads = 1,
+                            stats::SolverStats* stats = nullptr);
 
-// find a valid donor->giftee list by constructing it recursively
-bool findValidListRecursive(std::vector<Person>& giftList);
+// find a valid donor->giftee list by a local search (simulated annealing),
+// suitable for very large numbers of people
+bool findValidListAnneal(std::vector<PersonId>& cycle,
+                         const constraints::ConstraintModel& model,
+                         stats::SolverStats* stats = nullptr);
 
-// rotates the beginning of the vector randomly
-std::map<unsigned int, std::string> randomizePersonNumbers(
-    std::vector<Person>& people);
+// assigns every person a random number (a random permutation of 0..n-1),
+// the result is indexed by Person::id
+std::vector<unsigned int> randomizePersonNumbers(
+    const std::vector<Person>& people);
@@ -0,0 +1,625 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "smtp.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <csignal>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include "log.h"
+#include "threadpool.h"
+
+namespace
+{
+// time limit for every read or write on the connection
+constexpr time_t ioTimeoutSec{30};
+
+// reply codes
+constexpr int codeReady{220};
+constexpr int codeOk{250};
+constexpr int codeAuthOk{235};
+constexpr int codeAuthContinue{334};
+constexpr int codeStartData{354};
+
+// one connection to the server, used for several messages
+struct Connection {
+    explicit Connection(const smtp::Server& server) : session(server) {}
+
+    smtp::Session session;
+    unsigned int numSent{0};
+};
+
+// encodes the data in base64 (for the authentication)
+std::string base64(std::string_view data);
+
+// the parameters of an extension listed in the reply to EHLO (e.g. the
+// mechanisms of "AUTH"), nothing if the server doesn't offer it
+std::optional<std::string_view> extension(std::string_view reply,
+                                          std::string_view keyword);
+
+// true for an IPv4 or IPv6 address (the certificate has to name the address
+// then, not a host name)
+bool isIpAddress(const std::string& host);
+
+// OpenSSL's most recent error
+std::string tlsError();
+
+// opens a TCP connection, returns the socket or -1
+int connectTo(const std::string& host, unsigned int port, std::string& error);
+
+// a (4xx) transient or (5xx) permanent failure
+smtp::Result failure(int code);
+
+// the message with "\r\n" line endings and dot-stuffing for the DATA command
+// (lines starting with a dot get another one), terminated by "\r\n.\r\n"
+std::string dataBlock(std::string_view message);
+
+// tries to deliver the message (with retries), reconnects if necessary.
+// Returns false if no connection to the server could be opened.
+bool deliverOne(Connection& connection, smtp::Message& message,
+                const smtp::DeliveryOptions& options);
+
+std::string base64(std::string_view data)
+{
+    constexpr char digits[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    std::string encoded;
+    std::size_t i{0};
+    for (; i + 2 < data.size(); i += 3) {
+        const auto v = static_cast<unsigned char>(data[i]) << 16 |
+                       static_cast<unsigned char>(data[i + 1]) << 8 |
+                       static_cast<unsigned char>(data[i + 2]);
+        encoded += digits[(v >> 18) & 63];
+        encoded += digits[(v >> 12) & 63];
+        encoded += digits[(v >> 6) & 63];
+        encoded += digits[v & 63];
+    }
+    if (i < data.size()) {
+        const bool two = i + 1 < data.size();
+        const auto v = static_cast<unsigned char>(data[i]) << 16 |
+                       (two ? static_cast<unsigned char>(data[i + 1]) << 8 : 0);
+        encoded += digits[(v >> 18) & 63];
+        encoded += digits[(v >> 12) & 63];
+        encoded += two ? digits[(v >> 6) & 63] : '=';
+        encoded += '=';
+    }
+    return encoded;
+}
+
+std::optional<std::string_view> extension(std::string_view reply,
+                                          std::string_view keyword)
+{
+    // the first line is the greeting, every further one names an extension
+    // followed by its parameters, e.g. "250-AUTH PLAIN LOGIN"
+    auto eol = reply.find('\n');
+    while (eol != std::string_view::npos) {
+        reply.remove_prefix(eol + 1);
+        eol = reply.find('\n');
+        auto line = reply.substr(0, eol);
+        if (line.size() < 4) {
+            continue;
+        }
+        line.remove_prefix(4);
+
+        if (line.size() >= keyword.size() &&
+            std::equal(keyword.begin(), keyword.end(), line.begin(),
+                       [](char a, char b) {
+                           return a == std::toupper(static_cast<unsigned char>(
+                                           b));
+                       }) &&
+            (line.size() == keyword.size() || line[keyword.size()] == ' ')) {
+            line.remove_prefix(std::min(line.size(), keyword.size() + 1));
+            return line;
+        }
+    }
+    return std::nullopt;
+}
+
+bool isIpAddress(const std::string& host)
+{
+    unsigned char addr[sizeof(in6_addr)];
+    return inet_pton(AF_INET, host.c_str(), addr) == 1 ||
+           inet_pton(AF_INET6, host.c_str(), addr) == 1;
+}
+
+std::string tlsError()
+{
+    char buf[256];
+    ERR_error_string_n(ERR_get_error(), buf, sizeof(buf));
+    return buf;
+}
+
+int connectTo(const std::string& host, unsigned int port, std::string& error)
+{
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* addrs{nullptr};
+    const int rc = getaddrinfo(host.c_str(), std::to_string(port).c_str(),
+                               &hints, &addrs);
+    if (rc != 0) {
+        error = std::string("could not resolve ") + host + ": " +
+                gai_strerror(rc);
+        return -1;
+    }
+
+    int fd{-1};
+    for (auto* a = addrs; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+
+        timeval tv{ioTimeoutSec, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        if (connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+            error = std::string("could not connect to ") + host + ": " +
+                    std::strerror(errno);
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addrs);
+
+    return fd;
+}
+
+smtp::Result failure(int code)
+{
+    return code >= 500 ? smtp::Result::permanent : smtp::Result::transient;
+}
+
+std::string dataBlock(std::string_view message)
+{
+    std::string block;
+    block.reserve(message.size() + message.size() / 32 + 5);
+
+    bool lineStart = true;
+    for (const char c : message) {
+        if (c == '\r') {
+            continue;
+        }
+        if (lineStart && c == '.') {
+            block += '.';
+        }
+        if (c == '\n') {
+            block += "\r\n";
+        } else {
+            block += c;
+        }
+        lineStart = c == '\n';
+    }
+
+    if (!lineStart) {
+        block += "\r\n";
+    }
+    block += ".\r\n";
+    return block;
+}
+
+bool deliverOne(Connection& connection, smtp::Message& message,
+                const smtp::DeliveryOptions& options)
+{
+    auto& session = connection.session;
+    std::string error;
+    auto delay = options.firstRetryDelay;
+    bool connected = session.isOpen();
+    bool wait = false;
+
+    for (unsigned int attempt = 1; attempt <= options.maxAttempts; ++attempt) {
+        if (wait) {
+            LOG(debug) << "Retrying the email to " << message.recipient << " ("
+                       << error << ")";
+            std::this_thread::sleep_for(delay);
+            delay *= 2;
+        }
+        wait = true;
+
+        if (session.isOpen() &&
+            connection.numSent >= options.maxMessagesPerSession) {
+            session.close();
+        }
+        if (not session.isOpen()) {
+            connection.numSent = 0;
+            const auto result = session.open(error);
+            if (result == smtp::Result::permanent) {
+                break;
+            } else if (result != smtp::Result::ok) {
+                continue;
+            }
+            connected = true;
+        }
+
+        const bool reused = connection.numSent > 0;
+        const auto result = session.send(message.sender, message.recipient,
+                                         message.data, error);
+        if (result == smtp::Result::ok) {
+            ++connection.numSent;
+            return true;
+        } else if (result == smtp::Result::permanent) {
+            break;
+        }
+
+        // the server may have closed a reused connection in the meantime,
+        // no need to wait before trying again with a new one
+        wait = not(reused && not session.isOpen());
+    }
+
+    message.error = error;
+    return connected;
+}
+}  // namespace
+
+namespace smtp
+{
+Session::~Session()
+{
+    close();
+    SSL_CTX_free(m_ctx);
+}
+
+Result Session::open(std::string& error)
+{
+    close();
+
+    m_fd = connectTo(m_server.host, m_server.port, error);
+    if (m_fd < 0) {
+        return Result::transient;
+    }
+
+    if (m_server.implicitTls) {
+        const auto result = startTls(error);
+        if (result != Result::ok) {
+            disconnect();
+            return result;
+        }
+    }
+
+    std::string reply;
+    int code = readReply(reply);
+    if (code != codeReady) {
+        error = "unexpected greeting: " + reply;
+        disconnect();
+        return failure(code);
+    }
+
+    code = command("EHLO " + m_server.domain, reply);
+    if (code != codeOk) {
+        error = "EHLO failed: " + reply;
+        disconnect();
+        return failure(code);
+    }
+
+    // the connection is encrypted whenever the server offers it, the
+    // extensions are announced again over the encrypted connection
+    if (not isEncrypted() && extension(reply, "STARTTLS")) {
+        code = command("STARTTLS", reply);
+        if (code != codeReady) {
+            error = "STARTTLS failed: " + reply;
+            disconnect();
+            return failure(code);
+        }
+
+        const auto result = startTls(error);
+        if (result != Result::ok) {
+            disconnect();
+            return result;
+        }
+
+        code = command("EHLO " + m_server.domain, reply);
+        if (code != codeOk) {
+            error = "EHLO failed: " + reply;
+            disconnect();
+            return failure(code);
+        }
+    }
+
+    if (m_server.username.empty()) {
+        return Result::ok;
+    }
+
+    // the supported mechanisms are listed by the AUTH extension, without it
+    // the server doesn't want any authentication
+    const auto mechanisms = extension(reply, "AUTH");
+    if (not mechanisms) {
+        return Result::ok;
+    }
+
+    if (not isEncrypted() && not m_server.allowPlaintextAuth) {
+        error = "the server doesn't offer an encrypted connection, the "
+                "password isn't sent in the clear";
+        close();
+        return Result::permanent;
+    }
+
+    if (mechanisms->find("PLAIN") != std::string_view::npos) {
+        std::string credentials;
+        credentials += '\0';
+        credentials += m_server.username;
+        credentials += '\0';
+        credentials += m_server.password;
+        code = command("AUTH PLAIN " + base64(credentials), reply);
+    } else {
+        code = command("AUTH LOGIN", reply);
+        if (code == codeAuthContinue) {
+            code = command(base64(m_server.username), reply);
+        }
+        if (code == codeAuthContinue) {
+            code = command(base64(m_server.password), reply);
+        }
+    }
+
+    if (code != codeAuthOk) {
+        error = "authentication failed: " + reply;
+        disconnect();
+        return failure(code);
+    }
+
+    return Result::ok;
+}
+
+Result Session::send(std::string_view from, std::string_view to,
+                     std::string_view message, std::string& error)
+{
+    if (!isOpen()) {
+        error = "not connected";
+        return Result::transient;
+    }
+
+    std::string reply;
+    auto refused = [&](const std::string& what, int code) {
+        error = what + " failed: " + reply;
+        if (code != 0) {
+            // reset the transaction such that the session can be used for
+            // the next message
+            std::string ignored;
+            command("RSET", ignored);
+        }
+        return code == 0 ? Result::transient : failure(code);
+    };
+
+    int code = command("MAIL FROM:<" + std::string(from) + ">", reply);
+    if (code != codeOk) {
+        return refused("MAIL FROM", code);
+    }
+
+    code = command("RCPT TO:<" + std::string(to) + ">", reply);
+    if (code != codeOk && code != codeOk + 1) {
+        return refused("RCPT TO", code);
+    }
+
+    code = command("DATA", reply);
+    if (code != codeStartData) {
+        return refused("DATA", code);
+    }
+
+    if (!writeAll(dataBlock(message))) {
+        error = "connection lost";
+        disconnect();
+        return Result::transient;
+    }
+
+    code = readReply(reply);
+    if (code != codeOk) {
+        return refused("message", code);
+    }
+
+    return Result::ok;
+}
+
+void Session::close()
+{
+    if (isOpen()) {
+        std::string ignored;
+        command("QUIT", ignored);
+        disconnect();
+    }
+}
+
+int Session::command(std::string_view cmd, std::string& reply)
+{
+    std::string line(cmd);
+    line += "\r\n";
+    if (!writeAll(line)) {
+        reply = "connection lost";
+        disconnect();
+        return 0;
+    }
+    return readReply(reply);
+}
+
+int Session::readReply(std::string& reply)
+{
+    // every line starts with the code, followed by '-' on all but the last
+    // line of the reply
+    reply.clear();
+    while (isOpen()) {
+        const auto eol = m_buffer.find("\r\n");
+        if (eol == std::string::npos) {
+            char buf[4096];
+            const auto len =
+                m_ssl ? static_cast<ssize_t>(SSL_read(m_ssl, buf, sizeof(buf)))
+                      : recv(m_fd, buf, sizeof(buf), 0);
+            if (len <= 0) {
+                reply = "connection lost";
+                disconnect();
+                return 0;
+            }
+            m_buffer.append(buf, static_cast<std::size_t>(len));
+            continue;
+        }
+
+        const auto line = m_buffer.substr(0, eol);
+        m_buffer.erase(0, eol + 2);
+        if (!reply.empty()) {
+            reply += '\n';
+        }
+        reply += line;
+
+        if (line.size() < 4 || line[3] != '-') {
+            return std::atoi(line.c_str());
+        }
+    }
+    return 0;
+}
+
+bool Session::writeAll(std::string_view data)
+{
+    while (!data.empty()) {
+        const auto len =
+            m_ssl ? static_cast<ssize_t>(SSL_write(
+                        m_ssl, data.data(), static_cast<int>(data.size())))
+                  : ::send(m_fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (len <= 0) {
+            return false;
+        }
+        data.remove_prefix(static_cast<std::size_t>(len));
+    }
+    return true;
+}
+
+Result Session::startTls(std::string& error)
+{
+    // anything the server sent ahead of the handshake would be taken as
+    // encrypted later on (command injection)
+    if (!m_buffer.empty()) {
+        error = "unexpected data before the TLS handshake";
+        return Result::permanent;
+    }
+
+    // OpenSSL writes with write(), a connection closed by the server mustn't
+    // kill the process
+    std::signal(SIGPIPE, SIG_IGN);
+
+    if (!m_ctx) {
+        m_ctx = SSL_CTX_new(TLS_client_method());
+        if (!m_ctx) {
+            error = "could not set up TLS: " + tlsError();
+            return Result::permanent;
+        }
+        SSL_CTX_set_min_proto_version(m_ctx, TLS1_2_VERSION);
+        SSL_CTX_set_verify(m_ctx, SSL_VERIFY_PEER, nullptr);
+        SSL_CTX_set_default_verify_paths(m_ctx);
+    }
+
+    m_ssl = SSL_new(m_ctx);
+    if (!m_ssl) {
+        error = "could not set up TLS: " + tlsError();
+        return Result::permanent;
+    }
+    SSL_set_fd(m_ssl, m_fd);
+
+    // the certificate has to be issued for the server's name
+    const auto& host = m_server.host;
+    if (isIpAddress(host)) {
+        X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(m_ssl), host.c_str());
+    } else {
+        SSL_set_tlsext_host_name(m_ssl, host.c_str());
+        SSL_set1_host(m_ssl, host.c_str());
+    }
+
+    if (SSL_connect(m_ssl) != 1) {
+        const auto verified = SSL_get_verify_result(m_ssl);
+        if (verified != X509_V_OK) {
+            error = std::string("certificate not trusted: ") +
+                    X509_verify_cert_error_string(verified);
+            return Result::permanent;
+        }
+        error = "TLS handshake failed: " + tlsError();
+        return Result::transient;
+    }
+
+    return Result::ok;
+}
+
+void Session::disconnect()
+{
+    if (m_ssl) {
+        SSL_free(m_ssl);
+        m_ssl = nullptr;
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_buffer.clear();
+}
+
+void deliver(const Server& server, std::vector<Message>& messages,
+             const DeliveryOptions& options,
+             const std::function<void(std::size_t)>& done)
+{
+    if (messages.empty()) {
+        return;
+    }
+
+    const auto numConnections = static_cast<unsigned int>(std::max<std::size_t>(
+        1, std::min<std::size_t>(options.numConnections, messages.size())));
+
+    // every connection takes the next not yet sent message until all are
+    // gone
+    std::atomic<std::size_t> next{0};
+    std::mutex doneMtx;
+    {
+        threadpool::ThreadPool pool(numConnections);
+        for (unsigned int c = 0; c < numConnections; ++c) {
+            pool.submit([&]() {
+                Connection connection(server);
+                for (auto i = next++; i < messages.size(); i = next++) {
+                    auto& message = messages[i];
+                    const bool connected =
+                        message.error ||
+                        deliverOne(connection, message, options);
+
+                    {
+                        std::lock_guard<std::mutex> lock(doneMtx);
+                        done(i);
+                    }
+                    if (not connected) {
+                        // leave the rest to the other connections
+                        break;
+                    }
+                }
+                connection.session.close();
+            });
+        }
+        pool.wait();
+    }
+
+    // all connections gave up
+    for (auto i = next.load(); i < messages.size(); ++i) {
+        messages[i].error = "not sent, no connection to the server";
+        done(i);
+    }
+}
+}  // namespace smtp
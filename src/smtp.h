@@ -0,0 +1,150 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// OpenSSL's types (see <openssl/ssl.h>)
+struct ssl_st;
+struct ssl_ctx_st;
+
+// minimal SMTP client (AUTH PLAIN/LOGIN, encrypted with STARTTLS or from the
+// start) which can send several messages over one connection, and the
+// delivery of many messages over a pool of such connections
+namespace smtp
+{
+struct Server {
+    std::string host{};
+    unsigned int port{25};
+    // no authentication if empty
+    std::string username{};
+    std::string password{};
+    // domain announced in the greeting (EHLO)
+    std::string domain{"localhost"};
+    // the connection is encrypted from the start (SMTPS, usually port 465),
+    // otherwise it's upgraded with STARTTLS whenever the server offers it.
+    // The server's certificate has to be trusted by the system (or by the
+    // file named by the SSL_CERT_FILE environment variable).
+    bool implicitTls{false};
+    // log in even if the server doesn't offer an encrypted connection (the
+    // password is sent in the clear), otherwise such a server is refused
+    bool allowPlaintextAuth{false};
+};
+
+enum class Result {
+    ok,
+    // worth another attempt (4xx replies, connection problems)
+    transient,
+    // the server refused the message for good (5xx replies, untrusted
+    // certificate, no encryption for the login)
+    permanent
+};
+
+// one session with the server, messages are sent one after the other
+class Session
+{
+public:
+    explicit Session(const Server& server) : m_server(server) {}
+    ~Session();
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+    // connects, greets, encrypts the connection (if possible) and
+    // authenticates
+    Result open(std::string& error);
+
+    // sends one message (header and body, lines separated by "\n" or "\r\n")
+    // to one recipient. After a refused message the session can be used for
+    // the next one, after a connection problem it's closed.
+    Result send(std::string_view from, std::string_view to,
+                std::string_view message, std::string& error);
+
+    // says goodbye and closes the connection
+    void close();
+
+    bool isOpen() const { return m_fd >= 0; }
+
+    // the connection is encrypted (TLS)
+    bool isEncrypted() const { return m_ssl != nullptr; }
+
+private:
+    // sends a command and reads the reply, returns the reply code (0 if the
+    // connection failed, in which case it's closed)
+    int command(std::string_view cmd, std::string& reply);
+
+    // reads a (possibly multiline) reply
+    int readReply(std::string& reply);
+
+    bool writeAll(std::string_view data);
+
+    // TLS handshake on the open connection, checks the server's certificate
+    Result startTls(std::string& error);
+
+    // closes the socket without saying goodbye
+    void disconnect();
+
+    const Server& m_server;
+    int m_fd{-1};
+    // set while the connection is encrypted
+    ssl_st* m_ssl{nullptr};
+    // created for the first encrypted connection, used for the following
+    // ones as well
+    ssl_ctx_st* m_ctx{nullptr};
+    // received but not yet consumed data
+    std::string m_buffer{};
+};
+
+// how deliver() hands the messages to the server
+struct DeliveryOptions {
+    // simultaneous connections to the server
+    unsigned int numConnections{4};
+    // a connection is closed (and a new one opened) after this many
+    // messages, servers tend to limit the number of messages per session
+    unsigned int maxMessagesPerSession{50};
+    // attempts per message, failed attempts are retried after a delay which
+    // doubles with every attempt
+    unsigned int maxAttempts{4};
+    std::chrono::milliseconds firstRetryDelay{1000};
+};
+
+struct Message {
+    std::string sender{};
+    std::string recipient{};
+    // header and body
+    std::string data{};
+    // set if the message couldn't be delivered (a message with an error
+    // isn't sent at all)
+    std::optional<std::string> error{};
+};
+
+// delivers the messages over a pool of connections: every connection takes
+// the next message not yet sent until all are gone. A reused connection the
+// server closed in the meantime is reopened right away, a connection which
+// can't be opened at all leaves the rest to the other ones (the messages
+// left over when all of them gave up get an error). done(i) is called once
+// the message i is done with (delivered or not), from the thread of its
+// connection but never concurrently.
+void deliver(const Server& server, std::vector<Message>& messages,
+             const DeliveryOptions& options,
+             const std::function<void(std::size_t)>& done);
+}  // namespace smtp
@@ -0,0 +1,414 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "solver.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <optional>
+#include <random>
+#include <set>
+
+#include "branchbound.h"
+#include "derangement.h"
+#include "disjoint.h"
+#include "hamilton.h"
+#include "heldkarp.h"
+#include "log.h"
+#include "shuffle.h"
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+// the randomized searches are run at most this many times per assignment
+// asked for by Problem::solveDistinct()
+constexpr unsigned int maxAttemptsPerList{20};
+
+// the pruned search of "auto" hands over to another algorithm after this many
+// nodes (a fraction of a second)
+constexpr std::uint64_t autoMaxNodes{1U << 17};
+}  // namespace
+
+namespace solver
+{
+bool singleCircle(const Options& options)
+{
+    return options.algorithm != "derange";
+}
+
+std::vector<PersonId> Assignment::giftees() const
+{
+    std::vector<PersonId> giftees;
+    for (const auto& g : gifteeLists()) {
+        giftees.push_back(g.front());
+    }
+    return giftees;
+}
+
+std::vector<std::vector<PersonId>> Assignment::gifteeLists() const
+{
+    std::vector<std::vector<PersonId>> giftees(cycle.size());
+    for (const auto& c : cycles) {
+        for (std::size_t i = 0; i < c.size(); ++i) {
+            giftees[c[i]].push_back(c[(i + 1) % c.size()]);
+        }
+    }
+    return giftees;
+}
+
+Problem::Problem(const std::vector<Person>& roster)
+    : Problem(constraints::ConstraintModel(roster))
+{
+}
+
+Problem::Problem(constraints::ConstraintModel model)
+    : m_model(std::move(model)),
+      m_findings(analysis::checkFeasibility(m_model))
+{
+}
+
+Assignment Problem::solve(const Options& options,
+                          stats::SolverStats* stats) const
+{
+    if (options.algorithm == "derange" && options.numGifts == 1) {
+        return solveDerangement(options, stats);
+    }
+
+    Assignment result;
+
+    // don't even start searching if it's obvious there's no solution
+    if (!m_findings.empty()) {
+        result.outcome = Outcome::infeasible;
+        result.findings = m_findings;
+        return result;
+    }
+
+    if (options.numGifts != 1 || options.algorithm == "disjoint") {
+        return solveDisjoint(options, stats);
+    }
+
+    const auto algorithm = selectAlgorithm(options);
+    if (stats) {
+        stats->algorithm = algorithm;
+    }
+
+    // the systematic searches prove that there's no valid list if they fail
+    bool success = false;
+    bool exhaustive = true;
+    if (algorithm == "random") {
+        success = findValidListRand(result.cycle, m_model,
+                                    options.timeBudgetSec, stats);
+        exhaustive = m_model.size() < 2;
+    } else if (algorithm == "pruned") {
+        success = findValidListPruned(result.cycle, m_model, stats);
+    } else if (algorithm == "anneal") {
+        success = findValidListAnneal(result.cycle, m_model, stats);
+        exhaustive = m_model.size() <= 3;
+    } else if (algorithm == "auto") {
+        // most rosters are solved by the pruned search right away. Only the
+        // hard ones, on which it might take very long, are handed over to
+        // the exact algorithm (bounded time) or, for larger groups, to the
+        // recursive search.
+        if (stats) {
+            stats->algorithm = "pruned";
+        }
+        const auto pruned = hamilton::findValidList(result.cycle, m_model,
+                                                    autoMaxNodes, stats);
+        success = pruned.found;
+        if (!pruned.complete) {
+            const bool exact = m_model.size() <= heldkarp::maxPeople;
+            LOG(debug) << "pruned search gave up after " << autoMaxNodes
+                       << " nodes, going on with "
+                       << (exact ? "exact" : "recursive");
+            if (stats) {
+                stats->algorithm = exact ? "exact" : "recursive";
+            }
+            success = exact ? findValidListExact(result.cycle, m_model, stats)
+                            : findValidListRecursive(result.cycle, m_model,
+                                                     options.numThreads,
+                                                     stats);
+        }
+    } else if (algorithm == "exact" && m_model.size() > heldkarp::maxPeople) {
+        result.outcome = Outcome::invalidOptions;
+        result.error = "Too many people for the exact algorithm (at most " +
+                       std::to_string(heldkarp::maxPeople) + ")";
+        return result;
+    } else if (algorithm == "exact") {
+        success = findValidListExact(result.cycle, m_model, stats);
+    } else if (algorithm == "recursive") {
+        success = findValidListRecursive(result.cycle, m_model,
+                                         options.numThreads, stats);
+    } else if (algorithm == "uniform") {
+        success = findUniformList(result.cycle, m_model, options.numThreads,
+                                  options.timeBudgetSec, stats);
+    } else if (algorithm == "optimize" &&
+               m_model.size() > branchbound::maxPeople) {
+        result.outcome = Outcome::invalidOptions;
+        result.error =
+            "Too many people for the optimize algorithm (at most " +
+            std::to_string(branchbound::maxPeople) + ")";
+        return result;
+    } else if (algorithm == "optimize") {
+        const auto best = findBestList(result.cycle, m_model,
+                                       options.timeBudgetSec, stats);
+        success = best.found;
+        exhaustive = best.complete;
+        result.optimal = best.found && best.complete;
+    } else {
+        result.outcome = Outcome::invalidOptions;
+        result.error = "Unknown algorithm " + algorithm;
+        return result;
+    }
+
+    if (success) {
+        result.outcome = Outcome::found;
+        result.cycles.assign(1, result.cycle);
+        result.penalty = constraints::totalPenalty(m_model, result.cycle);
+    } else {
+        result.outcome = exhaustive ? Outcome::infeasible : Outcome::notFound;
+        result.cycle.clear();
+    }
+    LOG(debug) << "solved with " << algorithm << ": "
+               << (success ? "list found" : "no list found");
+
+    return result;
+}
+
+DistinctAssignments Problem::solveDistinct(const Options& options,
+                                           unsigned int numLists,
+                                           stats::SolverStats* stats) const
+{
+    DistinctAssignments result;
+    result.last.outcome = Outcome::found;
+    if (numLists == 0) {
+        return result;
+    }
+
+    // with several lists or circles, the order of them doesn't matter
+    auto key = [](const Assignment& assignment) {
+        std::vector<std::vector<PersonId>> cycles;
+        for (const auto& cycle : assignment.cycles) {
+            cycles.push_back(canonicalCycle(cycle));
+        }
+        std::sort(cycles.begin(), cycles.end());
+        return cycles;
+    };
+
+    // the time budget is shared by all lists
+    std::optional<Clock::time_point> deadline;
+    if (options.timeBudgetSec > 0) {
+        deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                      std::chrono::duration<double>(
+                                          options.timeBudgetSec));
+    }
+
+    auto first = solve(options, stats);
+    if (!first.found()) {
+        result.last = std::move(first);
+        return result;
+    }
+    result.lists.push_back(std::move(first));
+    if (result.lists.size() == numLists) {
+        return result;
+    }
+
+    const auto algorithm = selectAlgorithm(options);
+    const bool systematic =
+        singleCircle(options) && options.numGifts == 1 &&
+        (algorithm == "auto" || algorithm == "exact" ||
+         algorithm == "recursive" || algorithm == "pruned");
+
+    if (systematic) {
+        // every cycle is found once by the search, only the first list
+        // (found by another algorithm) may come up again
+        const auto firstKey = key(result.lists.front());
+        std::random_device rd;
+        std::mt19937 gen(rd());
+        hamilton::Search search(m_model, gen());
+        if (deadline) {
+            search.limitTime(*deadline);
+        }
+        const auto start = hamilton::mostConstrainedPerson(m_model, gen);
+        for (bool more = search.start(start) && search.run(nullptr, stats);
+             more; more = search.next(nullptr, stats)) {
+            Assignment next;
+            next.outcome = Outcome::found;
+            next.cycle = search.path();
+            next.cycles.assign(1, next.cycle);
+            next.penalty = constraints::totalPenalty(m_model, next.cycle);
+            if (key(next) != firstKey) {
+                result.lists.push_back(std::move(next));
+                if (result.lists.size() == numLists) {
+                    return result;
+                }
+            }
+        }
+        // without the time budget, the search has found all lists
+        result.last.outcome =
+            search.stopped() ? Outcome::notFound : Outcome::infeasible;
+        return result;
+    }
+
+    // the randomized searches may find the same assignment again, they're
+    // given up after a while if there aren't as many as asked for
+    std::set<std::vector<std::vector<PersonId>>> found{
+        key(result.lists.front())};
+    const auto maxAttempts = numLists * maxAttemptsPerList;
+    for (unsigned int attempt = 1;
+         attempt < maxAttempts && result.lists.size() < numLists; ++attempt) {
+        auto attemptOptions = options;
+        if (deadline) {
+            const std::chrono::duration<double> left =
+                *deadline - Clock::now();
+            if (left.count() <= 0) {
+                LOG(info) << "time budget used up, " << result.lists.size()
+                          << " distinct assignments found";
+                break;
+            }
+            attemptOptions.timeBudgetSec = left.count();
+        }
+        auto assignment = solve(attemptOptions, stats);
+        if (!assignment.found()) {
+            result.last = std::move(assignment);
+            return result;
+        }
+        if (found.insert(key(assignment)).second) {
+            result.lists.push_back(std::move(assignment));
+        } else {
+            LOG(debug) << "assignment found before already, trying again";
+        }
+    }
+    if (result.lists.size() < numLists) {
+        result.last.outcome = Outcome::notFound;
+    }
+    return result;
+}
+
+counting::Count Problem::count(const Options& options) const
+{
+    if (!m_findings.empty()) {
+        counting::Count none;
+        none.exact = true;
+        none.log10Count = -std::numeric_limits<double>::infinity();
+        none.log10Fraction = none.log10Count;
+        return none;
+    }
+    return counting::countLists(m_model, options.numThreads,
+                                options.timeBudgetSec);
+}
+
+Assignment Problem::solveDisjoint(const Options& options,
+                                  stats::SolverStats* stats) const
+{
+    Assignment result;
+    if (options.numGifts == 0) {
+        result.outcome = Outcome::invalidOptions;
+        result.error = "At least one gift per person is required";
+        return result;
+    } else if (options.algorithm != "auto" &&
+               options.algorithm != "disjoint") {
+        result.outcome = Outcome::invalidOptions;
+        result.error = "Several gifts per person aren't supported by the " +
+                       options.algorithm + " algorithm";
+        return result;
+    }
+
+    result.findings = analysis::checkGiftCounts(m_model, options.numGifts);
+    if (!result.findings.empty()) {
+        result.outcome = Outcome::infeasible;
+        return result;
+    }
+
+    if (stats) {
+        stats->algorithm = "disjoint";
+    }
+    const auto joint = findDisjointLists(result.cycles, m_model,
+                                         options.numGifts,
+                                         options.timeBudgetSec, stats);
+    if (joint.found) {
+        result.outcome = Outcome::found;
+        result.cycle = result.cycles.front();
+        for (const auto& c : result.cycles) {
+            result.penalty += constraints::totalPenalty(m_model, c);
+        }
+    } else {
+        result.outcome =
+            joint.complete ? Outcome::infeasible : Outcome::notFound;
+        result.cycles.clear();
+    }
+    LOG(debug) << "solved with disjoint: "
+               << (joint.found ? "lists found" : "no lists found");
+
+    return result;
+}
+
+Assignment Problem::solveDerangement(const Options& options,
+                                     stats::SolverStats* stats) const
+{
+    // the checks for a single circle don't apply
+    Assignment result;
+    result.findings = analysis::checkDerangement(m_model);
+    if (!result.findings.empty()) {
+        result.outcome = Outcome::infeasible;
+        return result;
+    }
+
+    if (stats) {
+        stats->algorithm = "derange";
+    }
+    if (findDerangement(result.cycles, m_model, options.minCycleLength,
+                        stats)) {
+        result.outcome = Outcome::found;
+        for (const auto& c : result.cycles) {
+            result.cycle.insert(result.cycle.end(), c.begin(), c.end());
+            result.penalty += constraints::totalPenalty(m_model, c);
+        }
+    } else {
+        result.outcome = Outcome::notFound;
+        result.cycles.clear();
+    }
+    LOG(debug) << "solved with derange: "
+               << (result.found() ? "assignment found"
+                                  : "no assignment found");
+
+    return result;
+}
+
+std::string Problem::selectAlgorithm(const Options& options) const
+{
+    // soft constraints are optimized, otherwise "auto" is a pruned search
+    // followed by another algorithm if it takes too long (see solve())
+    if (options.algorithm == "auto" && m_model.hasPenalties() &&
+        m_model.size() <= branchbound::maxPeople) {
+        return "optimize";
+    }
+    return options.algorithm;
+}
+
+std::vector<PersonId> canonicalCycle(std::vector<PersonId> cycle)
+{
+    std::rotate(cycle.begin(), std::min_element(cycle.begin(), cycle.end()),
+                cycle.end());
+    return cycle;
+}
+
+Assignment solve(const std::vector<Person>& roster, const Options& options)
+{
+    return Problem(roster).solve(options);
+}
+}  // namespace solver
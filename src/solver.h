@@ -0,0 +1,177 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "analysis.h"
+#include "constraints.h"
+#include "counting.h"
+#include "person.h"
+#include "stats.h"
+
+// the library's entry point: constructs a donor->giftee list for a roster held
+// in memory (no files are read or written and nothing is printed)
+namespace solver
+{
+struct Options {
+    // "auto", "exact", "recursive", "random", "pruned", "anneal", "optimize",
+    // "uniform" (every valid list equally likely), "disjoint" (the only one
+    // for several gifts per person) or "derange" (several smaller circles
+    // allowed)
+    std::string algorithm{"auto"};
+    // threads of the recursive search and the counting (0 uses one per CPU
+    // core)
+    unsigned int numThreads{1};
+    // the optimization stops after this many seconds with the best list found
+    // so far, the random search and the search for disjoint lists give up and
+    // the estimation of the number of lists and the Markov chain of "uniform"
+    // stop (0: no limit)
+    double timeBudgetSec{10.0};
+    // the gifts every person gives and receives: that many lists, no two of
+    // them with the same donor->giftee pair
+    unsigned int numGifts{1};
+    // the smallest circle allowed by "derange" (e.g. 3: no two people give
+    // gifts to each other)
+    unsigned int minCycleLength{2};
+};
+
+// true unless the options allow several smaller circles ("derange"), the
+// quick checks of Problem::findings() are about a single circle
+bool singleCircle(const Options& options);
+
+enum class Outcome {
+    // a valid list was found
+    found,
+    // it's proven that there's no valid list
+    infeasible,
+    // the (incomplete) search gave up without finding a valid list
+    notFound,
+    // unknown algorithm, or the algorithm can't be used for the roster
+    invalidOptions,
+};
+
+struct Assignment {
+    Outcome outcome{Outcome::notFound};
+    // the people's IDs in the order of the circle (every person gives a gift
+    // to the next one, the last one to the first one), empty unless found.
+    // With several smaller circles, all of them one after the other.
+    std::vector<PersonId> cycle{};
+    // the lists with several gifts per person (the first one is cycle), or
+    // the smaller circles
+    std::vector<std::vector<PersonId>> cycles{};
+    // the problems proving that there's no valid list (if found by the quick
+    // checks before searching)
+    std::vector<analysis::Finding> findings{};
+    // why the options were rejected
+    std::string error{};
+    // the sum of the penalties (soft constraints) of the list(s)
+    std::uint64_t penalty{0};
+    // the list has the smallest possible penalty (only known if it was
+    // optimized completely)
+    bool optimal{false};
+
+    bool found() const { return outcome == Outcome::found; }
+
+    // the giftee of every person (in the first list), indexed by ID (empty
+    // unless found)
+    std::vector<PersonId> giftees() const;
+
+    // the giftees of every person in all lists, indexed by ID (empty unless
+    // found)
+    std::vector<std::vector<PersonId>> gifteeLists() const;
+};
+
+// several distinct assignments, see Problem::solveDistinct()
+struct DistinctAssignments {
+    // the assignments found, no two of them alike
+    std::vector<Assignment> lists{};
+    // the outcome of the attempt which ended the search: found if all lists
+    // asked for were found, infeasible if there are no (more) valid lists,
+    // notFound if the search gave up or ran out of time
+    Assignment last{};
+};
+
+// a roster compiled once, to be solved as often as needed
+class Problem
+{
+public:
+    // the people's IDs have to be 0..n-1 (as assigned by the parser) and the
+    // blocked and penalized IDs among them, otherwise std::invalid_argument
+    // is thrown. The names are only used for log messages and statistics.
+    explicit Problem(const std::vector<Person>& roster);
+
+    // a compiled model, e.g. with additional pairs blocked (see
+    // constraints::ConstraintModel::block())
+    explicit Problem(constraints::ConstraintModel model);
+
+    // runs the quick checks and then the selected algorithm. The search
+    // statistics are added to stats if given.
+    Assignment solve(const Options& options = {},
+                     stats::SolverStats* stats = nullptr) const;
+
+    // constructs numLists distinct assignments. The first one is found by
+    // solve(), the systematic algorithms then continue a pruned depth-first
+    // search (see hamilton::Search::next()) after every list instead of
+    // starting over, so they find as many lists as there are. The others
+    // (randomized, optimizing or with several lists per assignment) are
+    // simply run again until they found enough distinct assignments or found
+    // the same ones too often. All lists share the time budget, the lists
+    // found until it's used up are kept.
+    DistinctAssignments solveDistinct(
+        const Options& options, unsigned int numLists,
+        stats::SolverStats* stats = nullptr) const;
+
+    // counts (or estimates) the number of valid lists, see
+    // counting::countLists()
+    counting::Count count(const Options& options = {}) const;
+
+    const constraints::ConstraintModel& model() const { return m_model; }
+
+    // the problems found by the quick checks, empty if none
+    const std::vector<analysis::Finding>& findings() const
+    {
+        return m_findings;
+    }
+
+private:
+    // the algorithm for the options ("auto" becomes "optimize" if there are
+    // soft constraints)
+    std::string selectAlgorithm(const Options& options) const;
+
+    // the lists for several gifts per person
+    Assignment solveDisjoint(const Options& options,
+                             stats::SolverStats* stats) const;
+
+    // the assignment with several smaller circles
+    Assignment solveDerangement(const Options& options,
+                                stats::SolverStats* stats) const;
+
+    constraints::ConstraintModel m_model;
+    std::vector<analysis::Finding> m_findings;
+};
+
+// the cycle rotated such that it starts with the person with ID 0 (two cycles
+// describe the same assignments if their canonical forms are equal)
+std::vector<PersonId> canonicalCycle(std::vector<PersonId> cycle);
+
+// compiles the roster and solves it once
+Assignment solve(const std::vector<Person>& roster,
+                 const Options& options = {});
+}  // namespace solver
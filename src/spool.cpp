@@ -0,0 +1,236 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "spool.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+
+#include "log.h"
+
+namespace
+{
+// suffix of delivered messages in cur/ (Maildir info "seen")
+constexpr std::string_view deliveredSuffix{":2,S"};
+
+// writes the data into a new file and syncs it to disk
+bool writeSynced(const std::string& filename, std::string_view data,
+                 std::string& error);
+
+// syncs a directory to disk such that renames in it are durable
+void syncDir(const std::string& dirname);
+
+// a unique Maildir name "<time>.<pid>_<num>.<host>", sorting by name keeps
+// the order of writing
+std::string uniqueName(std::size_t num);
+
+// the messages in the directory, as "<prefix><name>"
+void listMessages(const std::string& dirname, const std::string& prefix,
+                  std::vector<std::string>& names);
+
+bool writeSynced(const std::string& filename, std::string_view data,
+                 std::string& error)
+{
+    const int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        error = "Could not create " + filename + ": " + std::strerror(errno);
+        return false;
+    }
+
+    while (!data.empty()) {
+        const auto len = ::write(fd, data.data(), data.size());
+        if (len < 0) {
+            error = "Could not write " + filename + ": " + std::strerror(errno);
+            ::close(fd);
+            std::remove(filename.c_str());
+            return false;
+        }
+        data.remove_prefix(static_cast<std::size_t>(len));
+    }
+
+    if (::fsync(fd) != 0 || ::close(fd) != 0) {
+        error = "Could not write " + filename + ": " + std::strerror(errno);
+        std::remove(filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+void syncDir(const std::string& dirname)
+{
+    const int fd = ::open(dirname.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+std::string uniqueName(std::size_t num)
+{
+    char host[256]{};
+    if (gethostname(host, sizeof(host) - 1) != 0) {
+        std::strcpy(host, "localhost");
+    }
+
+    // Maildir names must not contain '/' or ':'
+    std::string hostname(host);
+    std::replace(hostname.begin(), hostname.end(), '/', '_');
+    std::replace(hostname.begin(), hostname.end(), ':', '_');
+
+    char counter[16];
+    std::snprintf(counter, sizeof(counter), "%06zu", num);
+
+    return std::to_string(std::time(nullptr)) + "." +
+           std::to_string(getpid()) + "_" + counter + "." + hostname;
+}
+
+void listMessages(const std::string& dirname, const std::string& prefix,
+                  std::vector<std::string>& names)
+{
+    std::error_code ec;
+    for (const auto& entry :
+         std::filesystem::directory_iterator(dirname, ec)) {
+        if (entry.is_regular_file(ec)) {
+            names.push_back(prefix + entry.path().filename().string());
+        }
+    }
+}
+}  // namespace
+
+namespace spool
+{
+std::string spoolDirname(const std::string& inFilename)
+{
+    // next to the configuration, also if it's a directory
+    auto dirname = inFilename;
+    while (dirname.size() > 1 && dirname.back() == '/') {
+        dirname.pop_back();
+    }
+    return dirname + ".spool";
+}
+
+Spool::Spool(std::string dir) : m_dir(std::move(dir)) {}
+
+bool Spool::open(std::string& error)
+{
+    std::error_code ec;
+    for (const auto* sub : {"tmp", "new", "cur"}) {
+        std::filesystem::create_directories(m_dir + "/" + sub, ec);
+        if (ec) {
+            error = "Could not create " + m_dir + "/" + sub + ": " +
+                    ec.message();
+            return false;
+        }
+    }
+
+    for (const auto& entry :
+         std::filesystem::directory_iterator(m_dir + "/tmp", ec)) {
+        LOG(debug) << "removing unfinished " << entry.path();
+        std::filesystem::remove_all(entry.path(), ec);
+    }
+
+    // the run's messages are collected in a directory of their own (named
+    // like its first message)
+    m_run = uniqueName(0);
+    m_written.clear();
+    std::filesystem::create_directory(m_dir + "/tmp/" + m_run, ec);
+    if (ec) {
+        error = "Could not create " + m_dir + "/tmp/" + m_run + ": " +
+                ec.message();
+        return false;
+    }
+    return true;
+}
+
+bool Spool::write(std::string_view message, std::string& error)
+{
+    auto name = uniqueName(m_written.size());
+    if (!writeSynced(m_dir + "/tmp/" + m_run + "/" + name, message, error)) {
+        return false;
+    }
+    m_written.push_back(std::move(name));
+    return true;
+}
+
+bool Spool::publish(std::string& error)
+{
+    // a single rename makes all messages of the run pending at once
+    const auto from = m_dir + "/tmp/" + m_run;
+    const auto to = m_dir + "/new/" + m_run;
+    syncDir(from);
+    if (std::rename(from.c_str(), to.c_str()) != 0) {
+        error = "Could not move " + from + ": " + std::strerror(errno);
+        return false;
+    }
+    syncDir(m_dir + "/new");
+    syncDir(m_dir + "/tmp");
+    m_written.clear();
+    return true;
+}
+
+std::vector<std::string> Spool::pending() const
+{
+    // the published runs, and messages put into new/ directly (e.g. by
+    // other Maildir tools)
+    std::vector<std::string> names;
+    listMessages(m_dir + "/new", "", names);
+    std::error_code ec;
+    for (const auto& entry :
+         std::filesystem::directory_iterator(m_dir + "/new", ec)) {
+        if (entry.is_directory(ec)) {
+            const auto run = entry.path().filename().string();
+            listMessages(entry.path().string(), run + "/", names);
+        }
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+std::string Spool::path(const std::string& name) const
+{
+    return m_dir + "/new/" + name;
+}
+
+bool Spool::markDelivered(const std::string& name, std::string& error)
+{
+    // the names of the messages are unique across the runs
+    const auto slash = name.find('/');
+    const auto from = path(name);
+    const auto to = m_dir + "/cur/" +
+                    name.substr(slash == std::string::npos ? 0 : slash + 1) +
+                    std::string(deliveredSuffix);
+    if (std::rename(from.c_str(), to.c_str()) != 0) {
+        error = "Could not move " + from + ": " + std::strerror(errno);
+        return false;
+    }
+
+    if (slash != std::string::npos) {
+        // the run's directory is removed with its last message (rmdir()
+        // fails as long as there are others)
+        const auto run = m_dir + "/new/" + name.substr(0, slash);
+        syncDir(run);
+        ::rmdir(run.c_str());
+    }
+    syncDir(m_dir + "/new");
+    return true;
+}
+}  // namespace spool
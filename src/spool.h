@@ -0,0 +1,71 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// durable on-disk queue of rendered emails, laid out like a Maildir: the
+// messages of a run are written into a directory of their own in tmp/, which
+// is moved into new/ once all of them are complete, and every message is
+// moved into cur/ once it's delivered. Every step is a rename, so a crash
+// leaves either all messages of a run pending or none of them, and delivered
+// messages are never sent again.
+namespace spool
+{
+// the spool directory belonging to a configuration file
+std::string spoolDirname(const std::string& inFilename);
+
+class Spool
+{
+public:
+    explicit Spool(std::string dir);
+
+    // creates the directories (if necessary) and the run's directory in
+    // tmp/, removes leftovers of interrupted runs from tmp/
+    bool open(std::string& error);
+
+    // writes a message into the run's directory (synced to disk), it's not
+    // pending until it's published
+    bool write(std::string_view message, std::string& error);
+
+    // moves the run's directory into new/, which makes all written messages
+    // pending at once (atomically)
+    bool publish(std::string& error);
+
+    // the names of the messages waiting for delivery (in new/, "<run>/<name>"
+    // for the messages of a run), in the order of writing
+    std::vector<std::string> pending() const;
+
+    // the path of a pending message
+    std::string path(const std::string& name) const;
+
+    // moves a pending message into cur/ (and removes the directory of its
+    // run after the last one)
+    bool markDelivered(const std::string& name, std::string& error);
+
+    const std::string& dir() const { return m_dir; }
+
+private:
+    std::string m_dir;
+    // the directory of this run's messages in tmp/ (and in new/ once
+    // they're published)
+    std::string m_run{};
+    // written (but not yet published) messages
+    std::vector<std::string> m_written{};
+};
+}  // namespace spool
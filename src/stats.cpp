@@ -0,0 +1,175 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "stats.h"
+
+#include <algorithm>
+#include <numeric>
+#include <string_view>
+
+namespace
+{
+// number of people listed with the most rejections
+constexpr std::size_t numTopRejected{10};
+
+// the people with the most rejections (most first), without the ones which
+// have none
+std::vector<PersonId> topRejected(const stats::SolverStats& stats);
+
+// escapes a string for a JSON string literal
+std::string jsonEscape(std::string_view s);
+
+std::vector<PersonId> topRejected(const stats::SolverStats& stats)
+{
+    std::vector<PersonId> ids(stats.rejected.size());
+    std::iota(ids.begin(), ids.end(), PersonId{0});
+
+    const auto num = std::min(numTopRejected, ids.size());
+    std::partial_sort(ids.begin(), ids.begin() + num, ids.end(),
+                      [&stats](PersonId a, PersonId b) {
+                          return stats.rejected[a] > stats.rejected[b];
+                      });
+    ids.resize(num);
+
+    ids.erase(std::remove_if(ids.begin(), ids.end(),
+                             [&stats](PersonId p) {
+                                 return stats.rejected[p] == 0;
+                             }),
+              ids.end());
+    return ids;
+}
+
+std::string jsonEscape(std::string_view s)
+{
+    std::string escaped;
+    for (const char c : s) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            constexpr char hex[] = "0123456789abcdef";
+            escaped += "\\u00";
+            escaped += hex[(c >> 4) & 0xf];
+            escaped += hex[c & 0xf];
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+}  // namespace
+
+namespace stats
+{
+SolverStats::SolverStats(std::size_t numPeople)
+    : rejected(numPeople, 0), startTime(std::chrono::steady_clock::now())
+{
+}
+
+void SolverStats::solutionFound()
+{
+    if (!secondsToSolution) {
+        secondsToSolution = std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - startTime)
+                                .count();
+    }
+}
+
+void SolverStats::merge(const SolverStats& other)
+{
+    nodes += other.nodes;
+    backtracks += other.backtracks;
+    maxDepth = std::max(maxDepth, other.maxDepth);
+    swapsTried += other.swapsTried;
+    swapsAccepted += other.swapsAccepted;
+    for (std::size_t i = 0;
+         i < std::min(rejected.size(), other.rejected.size()); ++i) {
+        rejected[i] += other.rejected[i];
+    }
+}
+
+void printSummary(const SolverStats& stats,
+                  const constraints::ConstraintModel& model, std::ostream& os)
+{
+    const double elapsed = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() -
+                               stats.startTime)
+                               .count();
+
+    os << "Solver statistics (";
+    if (!stats.group.empty()) {
+        os << stats.group << ", ";
+    }
+    os << stats.algorithm << "):\n";
+    os << "  nodes expanded:       " << stats.nodes << "\n";
+    os << "  backtracks:           " << stats.backtracks << "\n";
+    os << "  maximum depth:        " << stats.maxDepth << "\n";
+    os << "  swaps tried/accepted: " << stats.swapsTried << "/"
+       << stats.swapsAccepted << "\n";
+    os << "  time to solution:     ";
+    if (stats.secondsToSolution) {
+        os << *stats.secondsToSolution << " s\n";
+    } else {
+        os << "- (no solution)\n";
+    }
+    os << "  total time:           " << elapsed << " s\n";
+
+    const auto top = topRejected(stats);
+    if (!top.empty()) {
+        os << "  most rejections:\n";
+        for (const auto p : top) {
+            os << "    " << model.name(p) << ": " << stats.rejected[p]
+               << "\n";
+        }
+    }
+    os.flush();
+}
+
+void printJson(const SolverStats& stats,
+               const constraints::ConstraintModel& model, std::ostream& os)
+{
+    const double elapsed = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() -
+                               stats.startTime)
+                               .count();
+
+    os << "{";
+    if (!stats.group.empty()) {
+        os << "\"group\":\"" << jsonEscape(stats.group) << "\",";
+    }
+    os << "\"algorithm\":\"" << jsonEscape(stats.algorithm) << "\""
+       << ",\"nodes\":" << stats.nodes
+       << ",\"backtracks\":" << stats.backtracks
+       << ",\"maxDepth\":" << stats.maxDepth
+       << ",\"swapsTried\":" << stats.swapsTried
+       << ",\"swapsAccepted\":" << stats.swapsAccepted
+       << ",\"secondsToSolution\":";
+    if (stats.secondsToSolution) {
+        os << *stats.secondsToSolution;
+    } else {
+        os << "null";
+    }
+    os << ",\"totalSeconds\":" << elapsed << ",\"mostRejected\":[";
+
+    const auto top = topRejected(stats);
+    for (auto it = top.cbegin(); it != top.cend(); ++it) {
+        os << (it == top.cbegin() ? "" : ",") << "{\"name\":\""
+           << jsonEscape(model.name(*it))
+           << "\",\"rejected\":" << stats.rejected[*it] << "}";
+    }
+    os << "]}" << std::endl;
+}
+}  // namespace stats
@@ -0,0 +1,85 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "constraints.h"
+#include "person.h"
+
+namespace stats
+{
+// counters collected by the solvers while searching. They're plain integer
+// increments, so they're always collected (solvers which aren't given a
+// SolverStats object use a local one).
+struct SolverStats {
+    explicit SolverStats(std::size_t numPeople = 0);
+
+    // partial lists extended (systematic searches)
+    std::uint64_t nodes{0};
+    // partial lists given up (systematic searches)
+    std::uint64_t backtracks{0};
+    // longest partial list
+    std::size_t maxDepth{0};
+    // moves proposed and kept (random and local search)
+    std::uint64_t swapsTried{0};
+    std::uint64_t swapsAccepted{0};
+    // per person: giftee candidates rejected for this donor (systematic
+    // searches) or moves of this person rejected (random and local search)
+    std::vector<std::uint64_t> rejected{};
+
+    std::string algorithm{};
+    // the group of participants (if the configuration has several)
+    std::string group{};
+    std::chrono::steady_clock::time_point startTime{};
+    std::optional<double> secondsToSolution{};
+
+    void reject(PersonId p)
+    {
+        if (p < rejected.size()) {
+            ++rejected[p];
+        }
+    }
+
+    void depth(std::size_t d)
+    {
+        if (d > maxDepth) {
+            maxDepth = d;
+        }
+    }
+
+    // records the time to the first solution
+    void solutionFound();
+
+    // adds the counters of another run (e.g. another thread)
+    void merge(const SolverStats& other);
+};
+
+// prints a human readable summary
+void printSummary(const SolverStats& stats,
+                  const constraints::ConstraintModel& model, std::ostream& os);
+
+// prints the statistics as JSON object
+void printJson(const SolverStats& stats,
+               const constraints::ConstraintModel& model, std::ostream& os);
+}  // namespace stats
@@ -0,0 +1,145 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "threadpool.h"
+
+namespace
+{
+// the pool and the index of the pool's worker running on this thread (if any)
+thread_local const void* workerPool{nullptr};
+thread_local unsigned int workerIndex{0};
+}  // namespace
+
+namespace threadpool
+{
+unsigned int effectiveNumThreads(unsigned int numThreads)
+{
+    if (numThreads == 0) {
+        numThreads = std::thread::hardware_concurrency();
+    }
+    return numThreads > 0 ? numThreads : 1;
+}
+
+ThreadPool::ThreadPool(unsigned int numThreads)
+{
+    numThreads = effectiveNumThreads(numThreads);
+
+    for (unsigned int i = 0; i < numThreads; ++i) {
+        m_queues.emplace_back(std::make_unique<Queue>());
+    }
+    for (unsigned int i = 0; i < numThreads; ++i) {
+        m_threads.emplace_back(&ThreadPool::worker, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    wait();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_stop = true;
+    }
+    m_taskCv.notify_all();
+
+    for (auto& t : m_threads) {
+        t.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    const unsigned int q =
+        workerPool == this
+            ? workerIndex
+            : m_nextQueue.fetch_add(1, std::memory_order_relaxed) %
+                  m_queues.size();
+
+    // the counters are updated first, such that they never drop below zero
+    // when a worker grabs the task right after it has been enqueued
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        ++m_queued;
+        ++m_pending;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_queues[q]->mtx);
+        m_queues[q]->tasks.emplace_back(std::move(task));
+    }
+    m_taskCv.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+    m_doneCv.wait(lock, [this] { return m_pending == 0; });
+}
+
+bool ThreadPool::popTask(unsigned int self, std::function<void()>& task)
+{
+    {
+        auto& own = *m_queues[self];
+        std::lock_guard<std::mutex> lock(own.mtx);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    for (std::size_t i = 1; i < m_queues.size(); ++i) {
+        auto& other = *m_queues[(self + i) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(other.mtx);
+        if (!other.tasks.empty()) {
+            task = std::move(other.tasks.front());
+            other.tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::worker(unsigned int self)
+{
+    workerPool = this;
+    workerIndex = self;
+
+    while (true) {
+        std::function<void()> task;
+        if (popTask(self, task)) {
+            {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                --m_queued;
+            }
+
+            task();
+
+            std::lock_guard<std::mutex> lock(m_mtx);
+            if (--m_pending == 0) {
+                m_doneCv.notify_all();
+            }
+        } else {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            m_taskCv.wait(lock, [this] { return m_stop || m_queued > 0; });
+            if (m_stop && m_queued == 0) {
+                return;
+            }
+        }
+    }
+}
+}  // namespace threadpool
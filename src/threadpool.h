@@ -0,0 +1,81 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace threadpool
+{
+// a fixed size pool of worker threads. Every worker has its own task queue,
+// it takes tasks from the back of its own queue and, if that one's empty,
+// steals tasks from the front of the other workers' queues.
+class ThreadPool
+{
+public:
+    // creates the pool, 0 threads means one per hardware thread
+    explicit ThreadPool(unsigned int numThreads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // enqueues a task. Tasks submitted from a worker go to its own queue,
+    // all others are distributed round-robin
+    void submit(std::function<void()> task);
+
+    // blocks until all submitted tasks have been executed
+    void wait();
+
+    unsigned int size() const
+    {
+        return static_cast<unsigned int>(m_threads.size());
+    }
+
+private:
+    struct Queue {
+        std::mutex mtx;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void worker(unsigned int self);
+
+    // takes a task from the own queue or steals one from another queue
+    bool popTask(unsigned int self, std::function<void()>& task);
+
+    std::vector<std::unique_ptr<Queue>> m_queues{};
+    std::vector<std::thread> m_threads{};
+    std::mutex m_mtx{};
+    std::condition_variable m_taskCv{};
+    std::condition_variable m_doneCv{};
+    std::size_t m_queued{0};   // tasks waiting in the queues
+    std::size_t m_pending{0};  // tasks not yet finished
+    bool m_stop{false};
+    std::atomic<unsigned int> m_nextQueue{0};
+};
+
+// the number of threads actually used for a requested thread count (0 means
+// one per hardware thread)
+unsigned int effectiveNumThreads(unsigned int numThreads);
+}  // namespace threadpool
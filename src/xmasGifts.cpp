@@ -15,16 +15,30 @@
 //
 
 #include <algorithm>
+#include <cmath>
 #include <cstdlib>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <sstream>
+#include <string_view>
 
+#include "analysis.h"
+#include "cache.h"
 #include "config.h"
+#include "constraints.h"
+#include "counting.h"
 #include "email.h"
-#include "output.h"
+#include "history.h"
+#include "log.h"
 #include "parser.h"
 #include "person.h"
+#include "server.h"
 #include "shuffle.h"
+#include "solver.h"
+#include "spool.h"
+#include "stats.h"
+#include "threadpool.h"
 
 namespace
 {
@@ -34,52 +48,198 @@ struct Config {
     bool sendEmails{false};
 };
 
+// one independent group of participants
+struct GroupJob {
+    // empty if the configuration consists of a single group
+    std::string name{};
+    // the output files are named after this file
+    std::string filename{};
+    std::vector<Person> people{};
+    // the giftees of every person by ID (once solved)
+    std::vector<std::vector<PersonId>> giftees{};
+    bool solved{false};
+    // the problems found and the solver statistics (when solving several
+    // groups, they're printed in the summary)
+    std::string report{};
+    std::string stats{};
+};
+
 // prints a little help text to the command line
 void printHelp();
 
 // parse the command line and return the file to be parsed
 void parseCmdLine(int argc, char **argv, config::Config &cfg);
 
-// prints the final resulting list of donors/giftees
-void printFoundList(const std::vector<Person> &giftList);
-
-// writes the found gift list into the two output files
-void genFiles(std::vector<Person> &giftList, const std::string &inFilename);
+// the solver options selected on the command line
+solver::Options solverOptions(const config::Config &cfg);
+
+// prints the penalty of the found list (if there are soft constraints)
+void printPenalty(const solver::Problem &problem,
+                  const solver::Assignment &assignment, std::ostream &report);
+
+// prints the number of valid lists and how constrained the group is
+void printCount(const counting::Count &count, std::ostream &report);
+
+// writes 10^log10Value with 3 significant digits, with a separate exponent
+// for small and large values (they may exceed the range of a double)
+void printPowerOfTen(double log10Value, std::ostream &os);
+
+// explains why no valid gift list was found
+void printFailure(const solver::Problem &problem,
+                  const solver::Assignment &assignment, std::ostream &report);
+
+// constructs numSolutions distinct valid gift lists and writes each of them
+// into its own (numbered) set of output files, returns the number of lists
+unsigned int findDistinctLists(std::vector<Person> &giftList,
+                               const solver::Problem &problem,
+                               const config::Config &cfg,
+                               const std::string &filename,
+                               stats::SolverStats &stats,
+                               std::ostream &report);
+
+// prints the solver statistics in the configured format (if any)
+void printStats(const stats::SolverStats &stats,
+                const constraints::ConstraintModel &model,
+                const config::Config &cfg, std::ostream &os);
+
+// loads the groups of the configuration file, or of all configuration files
+// in the directory
+std::vector<GroupJob> loadGroups(const config::Config &cfg);
+
+// the name the output files of a group are derived from, e.g. "cfg_<group>.txt"
+// for the group in "cfg.txt"
+std::string groupFilename(const std::string &inFilename,
+                          const std::string &group);
+
+// constructs the gift list(s) of a group and writes the output files. The
+// problems found are written to report and the statistics to statsOs.
+// Returns true if a list was found.
+bool solveGroup(GroupJob &job, const config::Config &cfg,
+                std::ostream &report, std::ostream &statsOs);
+
+// solves the groups in parallel (a failing group doesn't affect the others)
+// and prints a summary
+void solveGroups(std::vector<GroupJob> &jobs, const config::Config &cfg);
+
+// prints the final resulting list(s) of donors/giftees
+void printFoundLists(const constraints::ConstraintModel &model,
+                     const std::vector<std::vector<PersonId>> &cycles);
+
+// writes the found gift list (the people and the giftees of everyone by ID)
+// into the two output files (numbered if solutionNum isn't 0), their names
+// (or the failure to write them) go to report
+void genFiles(std::vector<Person> &giftList,
+              const std::vector<std::vector<PersonId>> &giftees,
+              const std::string &inFilename, std::ostream &report,
+              unsigned int solutionNum = 0);
 
 // generates the output filenames for the envelopes and cards
 std::pair<std::string, std::string> getOutFilenames(
-    const std::string &inFilename);
+    const std::string &inFilename, unsigned int solutionNum);
 
-// writes the file with the cards
-void writeCards(const std::map<unsigned int, std::string> &personIds,
+// writes the file with the cards (the people by their numbers), returns
+// false if it couldn't be written
+bool writeCards(const std::vector<unsigned int> &numbers,
+                const std::vector<Person> &giftList,
                 const std::string &filename);
 
-// writes the file with the cards
-void writeEnvelopes(const std::map<unsigned int, std::string> &personIds,
+// writes the file with the envelopes (which card(s) go into which envelope),
+// returns false if it couldn't be written
+bool writeEnvelopes(const std::vector<unsigned int> &numbers,
                     const std::vector<Person> &giftList,
+                    const std::vector<std::vector<PersonId>> &giftees,
                     const std::string &filename);
 
 void printHelp()
 {
 #ifdef WITH_EMAIL
     std::cout << R"(
-Usage: xmasGifts [-v] [-r] [-e] [-u <username>] [-p <pwd>] [-f <sender>]
-                 [-s <smtpserver>] <configuration file>)";
+Usage: xmasGifts [-v] [-l <logfile>] [-r] [-a <algorithm>] [-j <threads>]
+                 [-m <length>] [-t <seconds>] [-n <count>] [-k <count>]
+                 [-y <years>] [-w <years>] [-S <format>] [-N] [-C] [-e]
+                 [-u <username>] [-p <pwd>] [-P]
+                 [-f <sender>] [-s <smtpserver>] [-c <connections>] [-D]
+                 <configuration file>
+       xmasGifts [-v] [-l <logfile>] [-a <algorithm>] [-j <threads>]
+                 [-t <seconds>] [-R <directory>] -d <socket>)";
 #else   // WITH_EMAIL
     std::cout << R"(
-Usage: xmasGifts [-v] [-r] [-e] <configuration file>)";
+Usage: xmasGifts [-v] [-l <logfile>] [-r] [-a <algorithm>] [-j <threads>]
+                 [-m <length>] [-t <seconds>] [-n <count>] [-k <count>]
+                 [-y <years>] [-w <years>] [-S <format>] [-N] [-C] [-e]
+                 <configuration file>
+       xmasGifts [-v] [-l <logfile>] [-a <algorithm>] [-j <threads>]
+                 [-t <seconds>] [-R <directory>] -d <socket>)";
 #endif  // WITH_EMAIL
     std::cout << R"(
 
-    -v increases verbosity level
-    -r use purely random search for gift list (by default: systematic, recursive search))";
+    -v increases verbosity level (once: debug messages, twice: trace messages
+       if compiled in)
+    -l <logfile> append the log messages to <logfile> instead of stderr
+    -r use purely random search for gift list (same as -a random)
+    -a <algorithm> the algorithm used to construct the gift list:
+       auto       optimize if there are soft constraints, otherwise pruned,
+                  handing over to exact for up to 25 people and recursive
+                  for more if it takes long (default)
+       exact      dynamic programming, bounded time (up to 25 people)
+       recursive  systematic, recursive search
+       random     purely random search
+       pruned     systematic search with pruning of dead ends
+       anneal     local search (simulated annealing) for large groups
+       optimize   branch and bound, the list with the smallest penalty of
+                  the soft constraints
+       disjoint   joint search for the lists of -k (the only one with more
+                  than one gift per person)
+       derange    several smaller circles allowed (see -m), polynomial time
+                  even for huge groups
+       uniform    every valid list equally likely (exact up to 20 people,
+                  approximately by a random walk for more)
+    -j <threads> number of threads for the recursive search (0: one per CPU
+       core, default: 1)
+    -n <count> construct <count> distinct gift lists (written into numbered
+       output files)
+    -k <count> everyone gives <count> gifts and receives <count> gifts:
+       <count> lists at once, nobody gives two gifts to the same person (the
+       cards of all giftees go into a donor's envelope)
+    -y <years> exclude everyone's giftees of the last <years> years, as
+       recorded in <configuration file>.history (every found list is added
+       to it, except with -n, -k or several circles)
+    -w <years> penalize everyone's giftees of the last <years> years (the
+       more recent, the higher the penalty) instead of excluding them
+    -m <length> the smallest circle allowed by -a derange (e.g. 3: no two
+       people give gifts to each other, default: 2)
+    -t <seconds> time budget of the optimization, it stops with the best
+       list found so far, of the random search, of the search for the lists
+       of -k, of the random walk of -a uniform and of the estimate of -N (0:
+       no limit, default: 10)
+    -S <format> print the solver statistics (nodes, backtracks, swaps, time,
+       people with the most rejected candidates) to stderr, <format> is
+       text or json
+    -N only count the valid lists (exact up to 20 people, estimated by
+       random sampling for more) instead of constructing one
+    -C neither use nor write the compiled configuration file (<configuration
+       file>.cache, used instead of parsing as long as the file is unchanged)
+    -d <socket> run as daemon: keep the configuration files in memory and
+       answer "solve", "resolve" and "validate" requests on the UNIX domain
+       socket <socket> (until SIGINT or SIGTERM), only accessible by the
+       daemon's user
+    -R <directory> the daemon only serves the configuration files inside
+       <directory> (default: the working directory))";
 #ifdef WITH_EMAIL
     std::cout << R"(
     -e parse and send email addresses (2nd column in the input file)
     -u <username> the username for the STMP server
     -p <pwd> the password for the STMP server
-    -s <smtpserver> the STMP server address
-    -f <sender> the sender email address)";
+    -P log in even if the SMTP server doesn't offer an encrypted connection
+       (the password is sent in the clear)
+    -s <smtpserver> the STMP server address (host or host:port, default
+       port: 25). The connection is encrypted with STARTTLS if the server
+       offers it, or right from the start for port 465 (SMTPS)
+    -f <sender> the sender email address
+    -c <connections> number of simultaneous connections to the SMTP server
+       (default: 4)
+    -D only deliver the emails left in <configuration file>.spool by an
+       earlier run (e.g. interrupted or with failed emails))";
 #else   // WITH_EMAIL
     std::cout << R"(
     -e parse email addresses (2nd column in the input file))";
@@ -95,6 +255,10 @@ followed by a list of names which he shouldn't get assigned. E.g.
  Tom   Alice
  Peter Bob
 
+A name followed by a weight (e.g. Tom:2) is a soft constraint: the donor may
+give a gift to that person, but it costs the weight. The list with the
+smallest sum of these penalties is searched then.
+
 The software then tries to find a circular list including all participants
 having assigned another participant as giftee, such as for the above e.g.
 
@@ -107,6 +271,18 @@ the person in the first column's email address, e.g.
  Bob   bob@bell.com   Peter,Tom
  Tom   tom@ti.com     Alice
  Peter peter@pepsi.co Bob
+
+A configuration file may contain several independent groups, each one
+starting with a line "[<group name>]", e.g.
+ [Smiths]
+ Alice Bob
+ Bob   Tom
+ Tom
+ [Millers]
+ ...
+Instead of a file also a directory can be given, every configuration file in
+it is a group then. The groups are solved in parallel, each one into its own
+output files (e.g. cfg_Smiths_cards.txt), followed by a summary.
 )";
 
 #ifdef WITH_EMAIL
@@ -126,9 +302,65 @@ void parseCmdLine(int argc, char **argv, config::Config &cfg)
 {
     for (int n = 1; n < argc; ++n) {
         if (std::string("-v") == argv[n]) {
-            OutputCfg::increaseVerbosity();
+            logging::increaseVerbosity();
+        } else if (std::string("-l") == argv[n]) {
+            ++n;
+            if (!logging::setLogFile(argv[n])) {
+                std::cerr << "Could not open " << argv[n] << std::endl;
+            }
         } else if (std::string("-r") == argv[n]) {
-            cfg.setConfigValue("useRandomAlgo", true);
+            cfg.setConfigValue("algorithm", std::string{"random"});
+        } else if (std::string("-a") == argv[n]) {
+            ++n;
+            cfg.setConfigValue("algorithm", std::string{argv[n]});
+        } else if (std::string("-j") == argv[n]) {
+            ++n;
+            cfg.setConfigValue(
+                "numThreads",
+                static_cast<unsigned int>(std::strtoul(argv[n], nullptr, 10)));
+        } else if (std::string("-n") == argv[n]) {
+            ++n;
+            cfg.setConfigValue(
+                "numSolutions",
+                static_cast<unsigned int>(std::strtoul(argv[n], nullptr, 10)));
+        } else if (std::string("-y") == argv[n]) {
+            ++n;
+            cfg.setConfigValue(
+                "historyYears",
+                static_cast<unsigned int>(std::strtoul(argv[n], nullptr, 10)));
+        } else if (std::string("-w") == argv[n]) {
+            ++n;
+            cfg.setConfigValue(
+                "penaltyYears",
+                static_cast<unsigned int>(std::strtoul(argv[n], nullptr, 10)));
+        } else if (std::string("-k") == argv[n]) {
+            ++n;
+            cfg.setConfigValue(
+                "numGifts",
+                static_cast<unsigned int>(std::strtoul(argv[n], nullptr, 10)));
+        } else if (std::string("-m") == argv[n]) {
+            ++n;
+            cfg.setConfigValue(
+                "minCycleLength",
+                static_cast<unsigned int>(std::strtoul(argv[n], nullptr, 10)));
+        } else if (std::string("-t") == argv[n]) {
+            ++n;
+            cfg.setConfigValue(
+                "timeBudget",
+                static_cast<unsigned int>(std::strtoul(argv[n], nullptr, 10)));
+        } else if (std::string("-S") == argv[n]) {
+            ++n;
+            cfg.setConfigValue("statsFormat", std::string{argv[n]});
+        } else if (std::string("-d") == argv[n]) {
+            ++n;
+            cfg.setConfigValue("socketPath", std::string{argv[n]});
+        } else if (std::string("-R") == argv[n]) {
+            ++n;
+            cfg.setConfigValue("configDir", std::string{argv[n]});
+        } else if (std::string("-N") == argv[n]) {
+            cfg.setConfigValue("countOnly", true);
+        } else if (std::string("-C") == argv[n]) {
+            cfg.setConfigValue("useCache", false);
         } else if (std::string("-e") == argv[n]) {
             cfg.setConfigValue("useEmails", true);
         } else if (std::string("-u") == argv[n]) {
@@ -143,39 +375,382 @@ void parseCmdLine(int argc, char **argv, config::Config &cfg)
         } else if (std::string("-p") == argv[n]) {
             ++n;
             cfg.setConfigValue("emailPwd", std::string{argv[n]});
+        } else if (std::string("-P") == argv[n]) {
+            cfg.setConfigValue("allowPlaintextAuth", true);
+        } else if (std::string("-D") == argv[n]) {
+            cfg.setConfigValue("deliverOnly", true);
+        } else if (std::string("-c") == argv[n]) {
+            ++n;
+            cfg.setConfigValue(
+                "numSmtpConnections",
+                static_cast<unsigned int>(std::strtoul(argv[n], nullptr, 10)));
         } else {
             cfg.setConfigValue("inputFilename", std::string{argv[n]});
         }
     }
 }
 
-void printFoundList(const std::vector<Person> &giftList)
+solver::Options solverOptions(const config::Config &cfg)
+{
+    solver::Options options;
+    options.algorithm = cfg.getAlgorithm();
+    options.numThreads = cfg.getNumThreads();
+    options.timeBudgetSec = cfg.getTimeBudget();
+    options.numGifts = cfg.getNumGifts();
+    options.minCycleLength = cfg.getMinCycleLength();
+    return options;
+}
+
+void printPenalty(const solver::Problem &problem,
+                  const solver::Assignment &assignment, std::ostream &report)
+{
+    if (!problem.model().hasPenalties()) {
+        return;
+    }
+
+    report << "Penalty of the list: " << assignment.penalty;
+    if (assignment.optimal) {
+        report << " (the smallest possible)";
+    }
+    report << std::endl;
+}
+
+void printCount(const counting::Count &count, std::ostream &report)
 {
-    for (const auto &pList : giftList) {
-        dbg << pList.name << " -> ";
+    if (count.exact) {
+        report << "Number of valid lists: " << count.value << std::endl;
+    } else if (std::isinf(count.log10Count)) {
+        report << "Number of valid lists: none of " << count.samples
+               << " random lists was valid (there might be very few)"
+               << std::endl;
+        return;
+    } else {
+        report << "Number of valid lists: about ";
+        printPowerOfTen(count.log10Count, report);
+        report << " (+-" << std::round(count.relativeError * 1000) / 10
+               << "%, estimated from " << count.samples << " random lists)"
+               << std::endl;
+    }
+
+    if (!std::isinf(count.log10Fraction)) {
+        report << "Valid fraction of all lists: ";
+        printPowerOfTen(count.log10Fraction, report);
+        report << std::endl;
     }
-    dbg << giftList.cbegin()->name << std::endl;
 }
 
-void genFiles(std::vector<Person> &giftList, const std::string &inFilename)
+void printPowerOfTen(double log10Value, std::ostream &os)
+{
+    const auto flags = os.flags();
+    const auto precision = os.precision(3);
+    if (log10Value >= -3 && log10Value < 6) {
+        os << std::pow(10.0, log10Value);
+    } else {
+        const auto exponent = std::floor(log10Value);
+        os << std::pow(10.0, log10Value - exponent) << "e"
+           << static_cast<long long>(exponent);
+    }
+    os.precision(precision);
+    os.flags(flags);
+}
+
+void printFailure(const solver::Problem &problem,
+                  const solver::Assignment &assignment, std::ostream &report)
+{
+    switch (assignment.outcome) {
+        case solver::Outcome::infeasible:
+            report << "No circular donor/giftee assignment possible";
+            if (assignment.findings.empty()) {
+                report << std::endl;
+            } else {
+                report << ":" << std::endl;
+                analysis::printFindings(problem.model(), assignment.findings,
+                                        report);
+            }
+            break;
+        case solver::Outcome::notFound:
+            report << "No valid donor/giftee assignment found, the search gave "
+                      "up (try another algorithm or a larger time budget)"
+                   << std::endl;
+            break;
+        case solver::Outcome::invalidOptions:
+            std::cerr << assignment.error << std::endl;
+            break;
+        case solver::Outcome::found:
+            break;
+    }
+}
+
+unsigned int findDistinctLists(std::vector<Person> &giftList,
+                               const solver::Problem &problem,
+                               const config::Config &cfg,
+                               const std::string &filename,
+                               stats::SolverStats &stats,
+                               std::ostream &report)
+{
+    const auto numSolutions = cfg.getNumSolutions();
+    const auto distinct =
+        problem.solveDistinct(solverOptions(cfg), numSolutions, &stats);
+
+    unsigned int num{0};
+    for (const auto &assignment : distinct.lists) {
+        constraints::applyOrder(giftList, assignment.cycle);
+        printFoundLists(problem.model(), assignment.cycles);
+        genFiles(giftList, assignment.gifteeLists(), filename, report, ++num);
+    }
+
+    if (distinct.lists.empty()) {
+        printFailure(problem, distinct.last, report);
+    } else if (distinct.last.outcome == solver::Outcome::infeasible) {
+        report << "There are only " << num << " distinct lists" << std::endl;
+    } else if (num < numSolutions) {
+        report << "Only " << num << " distinct lists found" << std::endl;
+    }
+    return num;
+}
+
+void printStats(const stats::SolverStats &stats,
+                const constraints::ConstraintModel &model,
+                const config::Config &cfg, std::ostream &os)
+{
+    if (cfg.getStatsFormat() == "json") {
+        stats::printJson(stats, model, os);
+    } else if (cfg.getStatsFormat() == "text") {
+        stats::printSummary(stats, model, os);
+    } else if (!cfg.getStatsFormat().empty()) {
+        os << "Unknown statistics format " << cfg.getStatsFormat()
+           << std::endl;
+    }
+}
+
+std::vector<GroupJob> loadGroups(const config::Config &cfg)
+{
+    const auto &input = cfg.getInputFilename();
+
+    // the files in a directory, without the ones written by this tool
+    std::vector<std::string> files;
+    std::error_code ec;
+    const bool directory = std::filesystem::is_directory(input, ec);
+    if (directory) {
+        auto endsWith = [](const std::string &s, std::string_view suffix) {
+            return s.size() >= suffix.size() &&
+                   s.compare(s.size() - suffix.size(), suffix.size(),
+                             suffix) == 0;
+        };
+
+        for (const auto &entry :
+             std::filesystem::directory_iterator(input, ec)) {
+            const auto name = entry.path().filename().string();
+            if (entry.is_regular_file(ec) && name.front() != '.' &&
+                !endsWith(name, ".cache") && !endsWith(name, ".history") &&
+                !endsWith(name, "_cards.txt") &&
+                !endsWith(name, "_envelopes.txt")) {
+                files.push_back(entry.path().string());
+            }
+        }
+        std::sort(files.begin(), files.end());
+    } else {
+        files.push_back(input);
+    }
+
+    std::vector<GroupJob> jobs;
+    for (const auto &file : files) {
+        auto groups = cfg.useCache()
+                          ? cache::loadConfig(file, cfg.useEmails())
+                          : parseGroupFile(file, cfg.useEmails());
+
+        for (auto &group : groups) {
+            // the files in a directory are groups named after the files
+            GroupJob job;
+            if (directory) {
+                job.name = std::filesystem::path(file).stem().string();
+            }
+            if (!group.name.empty()) {
+                job.name += (job.name.empty() ? "" : "/") + group.name;
+            }
+            job.filename = group.name.empty()
+                               ? file
+                               : groupFilename(file, group.name);
+            job.people = std::move(group.people);
+            jobs.push_back(std::move(job));
+        }
+    }
+
+    // people listed before the first group line are named after the file
+    if (jobs.size() > 1) {
+        for (auto &job : jobs) {
+            if (job.name.empty()) {
+                job.name = std::filesystem::path(job.filename).stem().string();
+            }
+        }
+    }
+
+    return jobs;
+}
+
+std::string groupFilename(const std::string &inFilename,
+                          const std::string &group)
+{
+    std::filesystem::path path(inFilename);
+    const auto extension = path.extension().string();
+    path.replace_filename(path.stem().string() + "_" + group + extension);
+    return path.string();
+}
+
+bool solveGroup(GroupJob &job, const config::Config &cfg,
+                std::ostream &report, std::ostream &statsOs)
+{
+    // the giftees of the last years are blocked right in the compiled model
+    const auto year = history::currentYear();
+    history::History pastYears(history::historyFilename(job.filename));
+    constraints::ConstraintModel model(job.people);
+    const auto numExcluded =
+        pastYears.excludeRecent(model, year, cfg.getHistoryYears());
+    LOG(debug) << numExcluded << " giftees of the last "
+               << cfg.getHistoryYears() << " years excluded";
+    const auto numPenalized =
+        pastYears.penalizeRecent(model, year, cfg.getPenaltyYears());
+    LOG(debug) << numPenalized << " giftees of the last "
+               << cfg.getPenaltyYears() << " years penalized";
+    const solver::Problem problem(std::move(model));
+    const auto options = solverOptions(cfg);
+
+    if (cfg.countOnly()) {
+        analysis::printFindings(problem.model(), problem.findings(), report);
+        const auto count = problem.count(options);
+        printCount(count, report);
+        return count.exact ? count.value > 0 : !std::isinf(count.log10Count);
+    }
+
+    // don't even start searching if it's obvious there's no solution
+    if (!problem.findings().empty() && solver::singleCircle(options)) {
+        printFailure(problem, problem.solve(options), report);
+        return false;
+    }
+
+    stats::SolverStats solverStats(problem.model().size());
+    solverStats.group = job.name;
+
+    bool solved = false;
+    if (cfg.getNumSolutions() > 1) {
+        solved = findDistinctLists(job.people, problem, cfg, job.filename,
+                                   solverStats, report) > 0;
+    } else {
+        const auto assignment = problem.solve(options, &solverStats);
+        if (assignment.found()) {
+            constraints::applyOrder(job.people, assignment.cycle);
+            job.giftees = assignment.gifteeLists();
+            printFoundLists(problem.model(), assignment.cycles);
+            genFiles(job.people, job.giftees, job.filename, report);
+            printPenalty(problem, assignment, report);
+            solved = true;
+
+            // the history holds a single circle per year
+            if (assignment.cycles.size() == 1 &&
+                !pastYears.append(year, job.people)) {
+                report << "Could not update "
+                       << history::historyFilename(job.filename) << std::endl;
+            }
+        } else {
+            printFailure(problem, assignment, report);
+        }
+    }
+
+    printStats(solverStats, problem.model(), cfg, statsOs);
+    return solved;
+}
+
+void solveGroups(std::vector<GroupJob> &jobs, const config::Config &cfg)
+{
+    // one group per thread, the groups are independent
+    const auto numThreads = static_cast<unsigned int>(std::min<std::size_t>(
+        jobs.size(), threadpool::effectiveNumThreads(0)));
+    {
+        threadpool::ThreadPool pool(numThreads);
+        for (auto &job : jobs) {
+            pool.submit([&job, &cfg]() {
+                std::ostringstream report;
+                std::ostringstream statsOs;
+                try {
+                    job.solved = solveGroup(job, cfg, report, statsOs);
+                } catch (const std::exception &e) {
+                    report << "Failed: " << e.what() << std::endl;
+                }
+                job.report = report.str();
+                job.stats = statsOs.str();
+            });
+        }
+        pool.wait();
+    }
+
+    const auto numSolved =
+        std::count_if(jobs.cbegin(), jobs.cend(),
+                      [](const GroupJob &job) { return job.solved; });
+    std::cout << numSolved << " of " << jobs.size() << " groups solved:"
+              << std::endl;
+    for (const auto &job : jobs) {
+        std::cout << "  " << job.name << " (" << job.people.size()
+                  << " people): "
+                  << (job.solved ? "list found" : "no valid list found")
+                  << std::endl;
+
+        // the report's lines indented below the group
+        std::istringstream report(job.report);
+        for (std::string line; std::getline(report, line);) {
+            std::cout << "    " << line << std::endl;
+        }
+    }
+
+    for (const auto &job : jobs) {
+        std::cerr << job.stats;
+    }
+}
+
+void printFoundLists(const constraints::ConstraintModel &model,
+                     const std::vector<std::vector<PersonId>> &cycles)
+{
+    if (!logging::enabled(logging::Level::debug)) {
+        return;
+    }
+
+    for (const auto &cycle : cycles) {
+        std::string line;
+        for (const auto p : cycle) {
+            line += model.name(p);
+            line += " -> ";
+        }
+        LOG(debug) << line << model.name(cycle.front());
+    }
+}
+
+void genFiles(std::vector<Person> &giftList,
+              const std::vector<std::vector<PersonId>> &giftees,
+              const std::string &inFilename, std::ostream &report,
+              unsigned int solutionNum)
 {
     // now we'll have to produce envelopes and cards. We write two files
     // where we have a mapping number <-> person. Two people might read
     // the two files such that no one knows the actual found donor/giftee
     // assignments
-    auto nums = randomizePersonNumbers(giftList);
-
-    auto fn = getOutFilenames(inFilename);
+    const auto nums = randomizePersonNumbers(giftList);
 
-    writeCards(nums, fn.first);
-    writeEnvelopes(nums, giftList, fn.second);
+    auto fn = getOutFilenames(inFilename, solutionNum);
 
-    std::cout << "Info for cards written into " << fn.first << std::endl;
-    std::cout << "Info for envelopes written into " << fn.second << std::endl;
+    if (writeCards(nums, giftList, fn.first)) {
+        report << "Info for cards written into " << fn.first << std::endl;
+    } else {
+        report << "Could not write " << fn.first << std::endl;
+    }
+    if (writeEnvelopes(nums, giftList, giftees, fn.second)) {
+        report << "Info for envelopes written into " << fn.second
+               << std::endl;
+    } else {
+        report << "Could not write " << fn.second << std::endl;
+    }
 }
 
 std::pair<std::string, std::string> getOutFilenames(
-    const std::string &inFilename)
+    const std::string &inFilename, unsigned int solutionNum)
 {
     bool dotFound = false;
     auto itIn = inFilename.rbegin();
@@ -194,61 +769,58 @@ std::pair<std::string, std::string> getOutFilenames(
         outFilenameBase = inFilename;
     }
 
+    if (solutionNum > 0) {
+        outFilenameBase += "_" + std::to_string(solutionNum);
+    }
+
     return make_pair(outFilenameBase + "_cards.txt",
                      outFilenameBase + "_envelopes.txt");
 }
 
-void writeCards(const std::map<unsigned int, std::string> &personIds,
+bool writeCards(const std::vector<unsigned int> &numbers,
+                const std::vector<Person> &giftList,
                 const std::string &filename)
 {
-    std::ofstream outputFile(filename);
+    // the names ordered by their numbers
+    std::vector<std::string_view> names(giftList.size());
+    for (const auto &p : giftList) {
+        names[numbers[p.id]] = p.name;
+    }
 
-    for (auto &pn : personIds) {
-        outputFile << pn.first << " - " << pn.second << std::endl;
+    // the stream is buffered, it's flushed once when it's closed
+    std::ofstream outputFile(filename);
+    for (unsigned int num = 0; num < names.size(); ++num) {
+        outputFile << num << " - " << names[num] << '\n';
     }
+
+    outputFile.close();
+    return !outputFile.fail();
 }
 
-void writeEnvelopes(const std::map<unsigned int, std::string> &personIds,
+bool writeEnvelopes(const std::vector<unsigned int> &numbers,
                     const std::vector<Person> &giftList,
+                    const std::vector<std::vector<PersonId>> &giftees,
                     const std::string &filename)
 {
     std::ofstream outputFile(filename);
 
-    // giftee iterator points one ahead
-    auto itGiftee = ++(giftList.begin());
-
-    for (auto itDonor = giftList.begin(); itDonor != giftList.end();
-         ++itDonor) {
-        // wrap around the giftee (which always points one ahead)
-        if (itGiftee == giftList.end()) {
-            itGiftee = giftList.begin();
+    for (const auto &donor : giftList) {
+        // the order of the cards doesn't tell which list they're from
+        std::vector<unsigned int> cards;
+        for (const auto g : giftees[donor.id]) {
+            cards.push_back(numbers[g]);
         }
+        std::sort(cards.begin(), cards.end());
 
-        const std::string &donor = itDonor->name;
-        const std::string &giftee = itGiftee->name;
-
-        // extract the ID's for the two people (donor and giftee)
-        auto donorId =
-            find_if(personIds.begin(), personIds.end(),
-                    [&donor](std::pair<unsigned int, std::string> const &v) {
-                        return v.second == donor;
-                    });
-        auto gifteeId =
-            find_if(personIds.begin(), personIds.end(),
-                    [&giftee](std::pair<unsigned int, std::string> const &v) {
-                        return v.second == giftee;
-                    });
-
-        if (donorId == personIds.end() || gifteeId == personIds.end()) {
-            std::cerr << "Could not find numbers for " << donor << " and "
-                      << giftee << std::endl;
-        } else {
-            outputFile << "Card " << gifteeId->first << " into envelope "
-                       << donorId->first << std::endl;
+        outputFile << (cards.size() == 1 ? "Card " : "Cards ");
+        for (std::size_t i = 0; i < cards.size(); ++i) {
+            outputFile << (i == 0 ? "" : ", ") << cards[i];
         }
-
-        ++itGiftee;
+        outputFile << " into envelope " << numbers[donor.id] << '\n';
     }
+
+    outputFile.close();
+    return !outputFile.fail();
 }
 }  // namespace
 
@@ -260,20 +832,53 @@ int main(int argc, char **argv)
         config::Config cfg;
         parseCmdLine(argc, argv, cfg);
 
-        dbg << "parsed cmdline" << std::endl;
+        LOG(debug) << "parsed cmdline";
 
-        auto p = parseFile(cfg.getInputFilename(), cfg.useEmails());
+        if (!cfg.getSocketPath().empty()) {
+            return server::run(cfg) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
 
-        bool listConstructionSuccess =
-            (cfg.useRandomAlgo() ? findValidListRand(p)
-                                 : findValidListRecursive(p));
-        if (listConstructionSuccess) {
-            printFoundList(p);
-            genFiles(p, cfg.getInputFilename());
 #ifdef WITH_EMAIL
-            email::sendEmails(p, cfg);
+        if (cfg.deliverOnly()) {
+            email::deliverEmails(cfg);
+            return EXIT_SUCCESS;
+        } else if (cfg.useEmails() && email::hasPendingEmails(cfg)) {
+            // a new list would contradict the emails not yet delivered
+            std::cerr << "Emails of an earlier run are waiting for delivery "
+                         "in "
+                      << spool::spoolDirname(cfg.getInputFilename())
+                      << ", send them with -D first." << std::endl;
+            return EXIT_FAILURE;
+        }
 #endif
+
+        auto jobs = loadGroups(cfg);
+
+        if (jobs.empty()) {
+            // nothing could be read (reported already)
+        } else if (jobs.size() == 1 && jobs.front().name.empty()) {
+            // a plain configuration file
+            jobs.front().solved =
+                solveGroup(jobs.front(), cfg, std::cout, std::cerr);
+        } else {
+            solveGroups(jobs, cfg);
         }
+
+#ifdef WITH_EMAIL
+        // the emails can't disclose one of several lists
+        if (cfg.getNumSolutions() <= 1 && !cfg.countOnly()) {
+            std::vector<email::GiftList> giftLists;
+            for (auto &job : jobs) {
+                if (job.solved) {
+                    giftLists.push_back(
+                        {std::move(job.people), std::move(job.giftees)});
+                }
+            }
+            if (!giftLists.empty()) {
+                email::sendEmails(giftLists, cfg);
+            }
+        }
+#endif
     }
 
     return EXIT_SUCCESS;
@@ -0,0 +1,384 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "fakesmtp.h"
+
+#include <netinet/in.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <memory>
+
+namespace
+{
+// a stuck client doesn't block the test forever
+constexpr time_t ioTimeoutSec{10};
+
+// one accepted connection, plain or encrypted. It's shut down when the
+// conversation is over (the socket is closed by the server once the thread
+// is joined, such that its number isn't reused in the meantime).
+class Connection
+{
+public:
+    explicit Connection(int fd) : m_fd(fd) {}
+    ~Connection()
+    {
+        SSL_free(m_ssl);
+        shutdown(m_fd, SHUT_RDWR);
+    }
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    bool handshake(SSL_CTX* ctx);
+    bool encrypted() const { return m_ssl != nullptr; }
+
+    // reads a line without the "\r\n", false if the connection is closed
+    bool readLine(std::string& line);
+    void write(const std::string& data);
+
+private:
+    int m_fd;
+    SSL* m_ssl{nullptr};
+    std::string m_buffer{};
+};
+
+// the command in upper case (the parameters are left as they are)
+std::string upperCommand(const std::string& line);
+
+// the address between the angle brackets
+std::string address(const std::string& line);
+
+std::string base64Decode(const std::string& encoded);
+
+bool Connection::handshake(SSL_CTX* ctx)
+{
+    m_ssl = SSL_new(ctx);
+    SSL_set_fd(m_ssl, m_fd);
+    return SSL_accept(m_ssl) == 1;
+}
+
+bool Connection::readLine(std::string& line)
+{
+    while (true) {
+        const auto eol = m_buffer.find("\r\n");
+        if (eol != std::string::npos) {
+            line = m_buffer.substr(0, eol);
+            m_buffer.erase(0, eol + 2);
+            return true;
+        }
+
+        char buf[4096];
+        const auto len =
+            m_ssl ? static_cast<ssize_t>(SSL_read(m_ssl, buf, sizeof(buf)))
+                  : recv(m_fd, buf, sizeof(buf), 0);
+        if (len <= 0) {
+            return false;
+        }
+        m_buffer.append(buf, static_cast<std::size_t>(len));
+    }
+}
+
+void Connection::write(const std::string& data)
+{
+    if (m_ssl) {
+        SSL_write(m_ssl, data.data(), static_cast<int>(data.size()));
+    } else {
+        ::send(m_fd, data.data(), data.size(), MSG_NOSIGNAL);
+    }
+}
+
+std::string upperCommand(const std::string& line)
+{
+    auto cmd = line.substr(0, line.find_first_of(" :"));
+    std::transform(cmd.begin(), cmd.end(), cmd.begin(), [](unsigned char c) {
+        return static_cast<char>(std::toupper(c));
+    });
+    return cmd;
+}
+
+std::string address(const std::string& line)
+{
+    const auto open = line.find('<');
+    const auto close = line.rfind('>');
+    if (open == std::string::npos || close == std::string::npos ||
+        close < open) {
+        return {};
+    }
+    return line.substr(open + 1, close - open - 1);
+}
+
+std::string base64Decode(const std::string& encoded)
+{
+    std::string decoded(encoded.size(), '\0');
+    const auto len = EVP_DecodeBlock(
+        reinterpret_cast<unsigned char*>(decoded.data()),
+        reinterpret_cast<const unsigned char*>(encoded.data()),
+        static_cast<int>(encoded.size()));
+    if (len < 0) {
+        return {};
+    }
+
+    // the padding is decoded as zeros
+    const auto padding = static_cast<std::size_t>(
+        std::count(encoded.begin(), encoded.end(), '='));
+    decoded.resize(static_cast<std::size_t>(len) - padding);
+    return decoded;
+}
+}  // namespace
+
+namespace fakesmtp
+{
+Server::Server(Behavior behavior) : m_behavior(std::move(behavior))
+{
+    if (m_behavior.startTls || m_behavior.implicitTls) {
+        m_ctx = SSL_CTX_new(TLS_server_method());
+        SSL_CTX_use_certificate_file(m_ctx, m_behavior.certFile.c_str(),
+                                     SSL_FILETYPE_PEM);
+        SSL_CTX_use_PrivateKey_file(m_ctx, m_behavior.keyFile.c_str(),
+                                    SSL_FILETYPE_PEM);
+    }
+
+    m_listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof(addr);
+    if (bind(m_listenFd, reinterpret_cast<sockaddr*>(&addr), len) == 0 &&
+        listen(m_listenFd, 16) == 0 &&
+        getsockname(m_listenFd, reinterpret_cast<sockaddr*>(&addr), &len) ==
+            0) {
+        m_port = ntohs(addr.sin_port);
+    }
+
+    m_acceptThread = std::thread([this]() { acceptLoop(); });
+}
+
+Server::~Server()
+{
+    m_stop = true;
+    shutdown(m_listenFd, SHUT_RDWR);
+    m_acceptThread.join();
+    ::close(m_listenFd);
+
+    // wakes up the connections still waiting for the client
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        for (const auto fd : m_fds) {
+            shutdown(fd, SHUT_RDWR);
+        }
+    }
+    for (auto& t : m_threads) {
+        t.join();
+    }
+    for (const auto fd : m_fds) {
+        ::close(fd);
+    }
+    SSL_CTX_free(m_ctx);
+}
+
+std::vector<Session> Server::sessions() const
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_sessions;
+}
+
+std::vector<Received> Server::received() const
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_received;
+}
+
+unsigned int Server::numAttempts(const std::string& recipient) const
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    const auto it = m_attempts.find(recipient);
+    return it == m_attempts.end() ? 0 : it->second;
+}
+
+void Server::acceptLoop()
+{
+    while (not m_stop) {
+        const int fd = accept(m_listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            break;
+        }
+
+        timeval tv{ioTimeoutSec, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_fds.push_back(fd);
+        m_sessions.emplace_back();
+        const auto index = m_sessions.size() - 1;
+        m_threads.emplace_back([this, fd, index]() { serve(fd, index); });
+    }
+}
+
+void Server::serve(int fd, std::size_t sessionIndex)
+{
+    Connection connection(fd);
+    auto record = [&](const std::string& command) {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_sessions[sessionIndex].commands.push_back(command);
+    };
+
+    if (m_behavior.implicitTls) {
+        if (not connection.handshake(m_ctx)) {
+            return;
+        }
+        record("<TLS>");
+    }
+    connection.write("220 fake ESMTP\r\n");
+
+    Received message;
+    unsigned int numMessages{0};
+    std::string line;
+    while (connection.readLine(line)) {
+        record(line);
+        const auto cmd = upperCommand(line);
+
+        if (cmd == "EHLO") {
+            std::string reply = "250-fake\r\n";
+            if (m_behavior.startTls && not connection.encrypted()) {
+                reply += "250-STARTTLS\r\n";
+            }
+            if (not m_behavior.username.empty()) {
+                reply += "250-AUTH PLAIN\r\n";
+            }
+            reply += "250 8BITMIME\r\n";
+            connection.write(reply);
+        } else if (cmd == "STARTTLS" && m_behavior.startTls &&
+                   not connection.encrypted()) {
+            connection.write("220 go ahead\r\n");
+            if (not connection.handshake(m_ctx)) {
+                return;
+            }
+            record("<TLS>");
+        } else if (cmd == "AUTH" && not m_behavior.username.empty()) {
+            const std::string expected = std::string(1, '\0') +
+                                         m_behavior.username + '\0' +
+                                         m_behavior.password;
+            const auto pos = line.rfind(' ');
+            connection.write(base64Decode(line.substr(pos + 1)) == expected
+                                 ? "235 welcome\r\n"
+                                 : "535 invalid credentials\r\n");
+        } else if (cmd == "MAIL") {
+            message = Received{address(line), {}, {}};
+            connection.write("250 OK\r\n");
+        } else if (cmd == "RCPT") {
+            const auto recipient = address(line);
+            unsigned int attempt{0};
+            {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                attempt = ++m_attempts[recipient];
+            }
+            const auto reply = m_behavior.rcptReply
+                                   ? m_behavior.rcptReply(recipient, attempt)
+                                   : std::string{};
+            if (reply.empty()) {
+                message.recipient = recipient;
+                connection.write("250 OK\r\n");
+            } else {
+                connection.write(reply + "\r\n");
+            }
+        } else if (cmd == "DATA" && not message.recipient.empty()) {
+            connection.write("354 go ahead\r\n");
+            while (connection.readLine(line) && line != ".") {
+                message.data += line + "\r\n";
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                m_received.push_back(message);
+                ++m_sessions[sessionIndex].numMessages;
+            }
+            message = Received{};
+            connection.write("250 queued\r\n");
+
+            if (++numMessages == m_behavior.dropAfter) {
+                return;
+            }
+        } else if (cmd == "RSET") {
+            message = Received{};
+            connection.write("250 OK\r\n");
+        } else if (cmd == "QUIT") {
+            connection.write("221 bye\r\n");
+            return;
+        } else {
+            connection.write("502 not implemented\r\n");
+        }
+    }
+}
+
+bool writeCertificate(const std::string& certFile, const std::string& keyFile)
+{
+    std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)> key(
+        EVP_EC_gen("P-256"), &EVP_PKEY_free);
+    std::unique_ptr<X509, decltype(&X509_free)> cert(X509_new(), &X509_free);
+    if (not key || not cert) {
+        return false;
+    }
+
+    X509_set_version(cert.get(), 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert.get()), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert.get()), -3600);
+    X509_gmtime_adj(X509_getm_notAfter(cert.get()), 24 * 3600);
+    X509_set_pubkey(cert.get(), key.get());
+
+    auto* name = X509_get_subject_name(cert.get());
+    X509_NAME_add_entry_by_txt(
+        name, "CN", MBSTRING_ASC,
+        reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(cert.get(), name);
+
+    X509V3_CTX ctx;
+    X509V3_set_ctx_nodb(&ctx);
+    X509V3_set_ctx(&ctx, cert.get(), cert.get(), nullptr, nullptr, 0);
+    auto* altName = X509V3_EXT_conf_nid(nullptr, &ctx, NID_subject_alt_name,
+                                        "DNS:localhost");
+    if (not altName) {
+        return false;
+    }
+    X509_add_ext(cert.get(), altName, -1);
+    X509_EXTENSION_free(altName);
+
+    if (X509_sign(cert.get(), key.get(), EVP_sha256()) == 0) {
+        return false;
+    }
+
+    FILE* f = std::fopen(certFile.c_str(), "w");
+    const bool certOk = f && PEM_write_X509(f, cert.get()) == 1;
+    if (f) {
+        std::fclose(f);
+    }
+    f = std::fopen(keyFile.c_str(), "w");
+    const bool keyOk = f && PEM_write_PrivateKey(f, key.get(), nullptr,
+                                                 nullptr, 0, nullptr,
+                                                 nullptr) == 1;
+    if (f) {
+        std::fclose(f);
+    }
+    return certOk && keyOk;
+}
+}  // namespace fakesmtp
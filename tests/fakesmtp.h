@@ -0,0 +1,110 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// OpenSSL's types (see <openssl/ssl.h>)
+struct ssl_st;
+struct ssl_ctx_st;
+
+// SMTP server stand-in for the tests: listens on the loopback interface,
+// records every command and message and misbehaves as configured
+namespace fakesmtp
+{
+struct Behavior {
+    // offer STARTTLS, or encrypt right from the start (both need the
+    // certificate and its key, PEM files)
+    bool startTls{false};
+    bool implicitTls{false};
+    std::string certFile{};
+    std::string keyFile{};
+    // offer AUTH PLAIN (accepting these credentials only) if not empty
+    std::string username{};
+    std::string password{};
+    // the reply to RCPT TO for the recipient's attempt (counted from 1),
+    // empty for "250 OK"
+    std::function<std::string(const std::string& recipient,
+                              unsigned int attempt)>
+        rcptReply{};
+    // the connection is closed right after accepting this many messages of a
+    // session, like servers do after some idle time (0: never)
+    unsigned int dropAfter{0};
+};
+
+// one connection, as seen by the server
+struct Session {
+    // the commands in the order received (the message data excluded),
+    // "<TLS>" marks the handshake
+    std::vector<std::string> commands{};
+    unsigned int numMessages{0};
+};
+
+struct Received {
+    std::string sender{};
+    std::string recipient{};
+    // the data as sent (dot-stuffed, with "\r\n"), without the final dot
+    std::string data{};
+};
+
+class Server
+{
+public:
+    // listens on an ephemeral port of 127.0.0.1
+    explicit Server(Behavior behavior);
+    ~Server();
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    unsigned int port() const { return m_port; }
+
+    std::vector<Session> sessions() const;
+    std::vector<Received> received() const;
+
+    // how often RCPT TO named the recipient
+    unsigned int numAttempts(const std::string& recipient) const;
+
+private:
+    void acceptLoop();
+    void serve(int fd, std::size_t sessionIndex);
+
+    Behavior m_behavior;
+    int m_listenFd{-1};
+    unsigned int m_port{0};
+    ssl_ctx_st* m_ctx{nullptr};
+    std::atomic<bool> m_stop{false};
+    std::thread m_acceptThread{};
+
+    mutable std::mutex m_mtx{};
+    std::vector<std::thread> m_threads{};
+    std::vector<int> m_fds{};
+    std::vector<Session> m_sessions{};
+    std::vector<Received> m_received{};
+    std::map<std::string, unsigned int> m_attempts{};
+};
+
+// writes a self-signed certificate for "localhost" and its key into the
+// files, returns false if that failed
+bool writeCertificate(const std::string& certFile, const std::string& keyFile);
+}  // namespace fakesmtp
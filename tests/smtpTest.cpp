@@ -0,0 +1,486 @@
+// This file is part of xmasGifts.
+//
+// xmasGifts is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// xmasGifts is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with xmasGifts.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// the SMTP client and the delivery engine against a local stand-in server
+// (see fakesmtp.h), no network access needed
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "fakesmtp.h"
+#include "smtp.h"
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+int numFailures{0};
+
+// reports a failed expectation (the tests go on)
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+void check(bool ok, const char* what, const char* file, int line);
+
+// the client's settings for the stand-in server
+smtp::Server clientFor(const fakesmtp::Server& fake,
+                       const std::string& host = "127.0.0.1");
+
+// n messages to p0@example.org, p1@example.org, ...
+std::vector<smtp::Message> makeMessages(std::size_t n);
+
+// delivery over one connection with short delays
+smtp::DeliveryOptions quickOptions();
+
+// delivers the messages, checks that done() is called once for every one,
+// returns the number delivered
+std::size_t deliverAll(const smtp::Server& server,
+                       std::vector<smtp::Message>& messages,
+                       const smtp::DeliveryOptions& options);
+
+bool contains(const std::string& s, const std::string& part);
+
+// the position of the first command starting with prefix (the number of
+// commands if there's none)
+std::size_t find(const std::vector<std::string>& commands,
+                 const std::string& prefix);
+
+void testDotStuffing();
+void testReconnectAfterMaxMessages();
+void testSeveralConnections();
+void testPermanentFailure();
+void testTransientFailureRetried();
+void testTransientFailureGivesUp();
+void testDroppedConnectionReopened();
+void testUnreachableServer();
+void testPlaintextAuthRefused();
+void testPlaintextAuthAllowed();
+void testUntrustedCertificate(const std::string& certFile,
+                              const std::string& keyFile);
+void testStartTls(const std::string& certFile, const std::string& keyFile);
+void testImplicitTls(const std::string& certFile, const std::string& keyFile);
+
+void check(bool ok, const char* what, const char* file, int line)
+{
+    if (not ok) {
+        std::cerr << file << ":" << line << ": check failed: " << what
+                  << std::endl;
+        ++numFailures;
+    }
+}
+
+smtp::Server clientFor(const fakesmtp::Server& fake, const std::string& host)
+{
+    smtp::Server server;
+    server.host = host;
+    server.port = fake.port();
+    return server;
+}
+
+std::vector<smtp::Message> makeMessages(std::size_t n)
+{
+    std::vector<smtp::Message> messages(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        messages[i].sender = "santa@example.org";
+        messages[i].recipient = "p" + std::to_string(i) + "@example.org";
+        messages[i].data = "Subject: Ho Ho Ho!\n\nHello " + std::to_string(i) +
+                           "\n";
+    }
+    return messages;
+}
+
+smtp::DeliveryOptions quickOptions()
+{
+    smtp::DeliveryOptions options;
+    options.numConnections = 1;
+    options.firstRetryDelay = std::chrono::milliseconds(10);
+    return options;
+}
+
+std::size_t deliverAll(const smtp::Server& server,
+                       std::vector<smtp::Message>& messages,
+                       const smtp::DeliveryOptions& options)
+{
+    std::vector<unsigned int> numDone(messages.size(), 0);
+    smtp::deliver(server, messages, options,
+                  [&numDone](std::size_t i) { ++numDone[i]; });
+    CHECK(std::all_of(numDone.begin(), numDone.end(),
+                      [](unsigned int n) { return n == 1; }));
+
+    return static_cast<std::size_t>(
+        std::count_if(messages.begin(), messages.end(),
+                      [](const smtp::Message& m) { return not m.error; }));
+}
+
+bool contains(const std::string& s, const std::string& part)
+{
+    return s.find(part) != std::string::npos;
+}
+
+std::size_t find(const std::vector<std::string>& commands,
+                 const std::string& prefix)
+{
+    std::size_t i{0};
+    while (i < commands.size() && commands[i].rfind(prefix, 0) != 0) {
+        ++i;
+    }
+    return i;
+}
+
+void testDotStuffing()
+{
+    fakesmtp::Server fake({});
+    auto messages = makeMessages(1);
+    messages[0].data =
+        "Subject: dots\n\n.starts with a dot\n..two dots\n.\nmid.dle\r\nend";
+
+    CHECK(deliverAll(clientFor(fake), messages, quickOptions()) == 1);
+    const auto received = fake.received();
+    CHECK(received.size() == 1);
+    if (not received.empty()) {
+        CHECK(received[0].data ==
+              "Subject: dots\r\n\r\n..starts with a dot\r\n...two dots\r\n"
+              "..\r\nmid.dle\r\nend\r\n");
+    }
+}
+
+void testReconnectAfterMaxMessages()
+{
+    fakesmtp::Server fake({});
+    auto messages = makeMessages(120);
+
+    CHECK(deliverAll(clientFor(fake), messages, quickOptions()) == 120);
+
+    const auto sessions = fake.sessions();
+    CHECK(sessions.size() == 3);
+    if (sessions.size() == 3) {
+        CHECK(sessions[0].numMessages == 50);
+        CHECK(sessions[1].numMessages == 50);
+        CHECK(sessions[2].numMessages == 20);
+    }
+    for (const auto& s : sessions) {
+        CHECK(not s.commands.empty() && s.commands.back() == "QUIT");
+    }
+
+    const auto received = fake.received();
+    CHECK(received.size() == 120);
+    for (std::size_t i = 0; i < received.size(); ++i) {
+        CHECK(received[i].recipient == messages[i].recipient);
+    }
+}
+
+void testSeveralConnections()
+{
+    fakesmtp::Server fake({});
+    auto messages = makeMessages(40);
+    auto options = quickOptions();
+    options.numConnections = 4;
+
+    CHECK(deliverAll(clientFor(fake), messages, options) == 40);
+    CHECK(fake.sessions().size() <= 4);
+
+    // every message arrived exactly once
+    std::vector<std::string> recipients;
+    for (const auto& r : fake.received()) {
+        recipients.push_back(r.recipient);
+    }
+    std::sort(recipients.begin(), recipients.end());
+    CHECK(recipients.size() == 40);
+    CHECK(std::adjacent_find(recipients.begin(), recipients.end()) ==
+          recipients.end());
+}
+
+void testPermanentFailure()
+{
+    fakesmtp::Behavior behavior;
+    behavior.rcptReply = [](const std::string& recipient, unsigned int) {
+        return recipient == "p1@example.org" ? "550 no such user"
+                                             : std::string{};
+    };
+    fakesmtp::Server fake(behavior);
+    auto messages = makeMessages(3);
+
+    CHECK(deliverAll(clientFor(fake), messages, quickOptions()) == 2);
+    CHECK(messages[1].error && contains(*messages[1].error, "550"));
+    CHECK(fake.numAttempts("p1@example.org") == 1);
+
+    // the transaction is reset and the session used for the next message
+    const auto sessions = fake.sessions();
+    CHECK(sessions.size() == 1);
+    if (sessions.size() == 1) {
+        const auto& commands = sessions[0].commands;
+        const auto rcpt = find(commands, "RCPT TO:<p1@");
+        CHECK(rcpt + 1 < commands.size() && commands[rcpt + 1] == "RSET");
+        CHECK(sessions[0].numMessages == 2);
+    }
+}
+
+void testTransientFailureRetried()
+{
+    fakesmtp::Behavior behavior;
+    behavior.rcptReply = [](const std::string& recipient,
+                            unsigned int attempt) {
+        return recipient == "p0@example.org" && attempt <= 2 ? "451 try later"
+                                                             : std::string{};
+    };
+    fakesmtp::Server fake(behavior);
+    auto messages = makeMessages(2);
+    const auto options = quickOptions();
+
+    const auto t0 = Clock::now();
+    CHECK(deliverAll(clientFor(fake), messages, options) == 2);
+    const auto elapsed = Clock::now() - t0;
+
+    CHECK(fake.numAttempts("p0@example.org") == 3);
+    // the delay doubles with every attempt
+    CHECK(elapsed >= 3 * options.firstRetryDelay);
+    CHECK(fake.sessions().size() == 1);
+}
+
+void testTransientFailureGivesUp()
+{
+    fakesmtp::Behavior behavior;
+    behavior.rcptReply = [](const std::string& recipient, unsigned int) {
+        return recipient == "p0@example.org" ? "451 try later"
+                                             : std::string{};
+    };
+    fakesmtp::Server fake(behavior);
+    auto messages = makeMessages(2);
+    auto options = quickOptions();
+    options.maxAttempts = 3;
+
+    CHECK(deliverAll(clientFor(fake), messages, options) == 1);
+    CHECK(messages[0].error && contains(*messages[0].error, "451"));
+    CHECK(fake.numAttempts("p0@example.org") == 3);
+    CHECK(not messages[1].error);
+}
+
+void testDroppedConnectionReopened()
+{
+    fakesmtp::Behavior behavior;
+    behavior.dropAfter = 2;
+    fakesmtp::Server fake(behavior);
+    auto messages = makeMessages(6);
+    auto options = quickOptions();
+    options.firstRetryDelay = std::chrono::seconds(5);
+
+    // the closed connection is noticed when it's reused and reopened
+    // without waiting
+    const auto t0 = Clock::now();
+    CHECK(deliverAll(clientFor(fake), messages, options) == 6);
+    CHECK(Clock::now() - t0 < options.firstRetryDelay);
+    CHECK(fake.sessions().size() == 3);
+    CHECK(fake.received().size() == 6);
+}
+
+void testUnreachableServer()
+{
+    unsigned int port{0};
+    {
+        fakesmtp::Server fake({});
+        port = fake.port();
+    }
+
+    smtp::Server server;
+    server.host = "127.0.0.1";
+    server.port = port;
+    auto messages = makeMessages(3);
+
+    CHECK(deliverAll(server, messages, quickOptions()) == 0);
+    CHECK(messages[0].error && contains(*messages[0].error, "connect"));
+    CHECK(messages[2].error &&
+          contains(*messages[2].error, "no connection to the server"));
+}
+
+void testPlaintextAuthRefused()
+{
+    fakesmtp::Behavior behavior;
+    behavior.username = "santa";
+    behavior.password = "secret";
+    fakesmtp::Server fake(behavior);
+    auto server = clientFor(fake);
+    server.username = "santa";
+    server.password = "secret";
+    auto messages = makeMessages(2);
+
+    CHECK(deliverAll(server, messages, quickOptions()) == 0);
+    CHECK(messages[0].error && contains(*messages[0].error, "encrypted"));
+    CHECK(fake.received().empty());
+
+    // not retried, and the password never left the client
+    const auto sessions = fake.sessions();
+    CHECK(sessions.size() == 1);
+    for (const auto& s : sessions) {
+        CHECK(find(s.commands, "AUTH") == s.commands.size());
+    }
+}
+
+void testPlaintextAuthAllowed()
+{
+    fakesmtp::Behavior behavior;
+    behavior.username = "santa";
+    behavior.password = "secret";
+    fakesmtp::Server fake(behavior);
+    auto server = clientFor(fake);
+    server.username = "santa";
+    server.password = "secret";
+    server.allowPlaintextAuth = true;
+    auto messages = makeMessages(2);
+
+    CHECK(deliverAll(server, messages, quickOptions()) == 2);
+    const auto sessions = fake.sessions();
+    CHECK(sessions.size() == 1);
+    if (sessions.size() == 1) {
+        CHECK(find(sessions[0].commands, "AUTH PLAIN") <
+              sessions[0].commands.size());
+    }
+}
+
+void testUntrustedCertificate(const std::string& certFile,
+                              const std::string& keyFile)
+{
+    // only the system's certificates are trusted
+    unsetenv("SSL_CERT_FILE");
+
+    fakesmtp::Behavior behavior;
+    behavior.startTls = true;
+    behavior.certFile = certFile;
+    behavior.keyFile = keyFile;
+    behavior.username = "santa";
+    behavior.password = "secret";
+    fakesmtp::Server fake(behavior);
+    auto server = clientFor(fake, "localhost");
+    server.username = "santa";
+    server.password = "secret";
+    // the connection isn't downgraded to the plain one either
+    server.allowPlaintextAuth = true;
+    auto messages = makeMessages(1);
+
+    CHECK(deliverAll(server, messages, quickOptions()) == 0);
+    CHECK(messages[0].error && contains(*messages[0].error, "certificate"));
+    CHECK(fake.received().empty());
+    CHECK(fake.sessions().size() == 1);
+    for (const auto& s : fake.sessions()) {
+        CHECK(find(s.commands, "AUTH") == s.commands.size());
+    }
+}
+
+void testStartTls(const std::string& certFile, const std::string& keyFile)
+{
+    setenv("SSL_CERT_FILE", certFile.c_str(), 1);
+
+    fakesmtp::Behavior behavior;
+    behavior.startTls = true;
+    behavior.certFile = certFile;
+    behavior.keyFile = keyFile;
+    behavior.username = "santa";
+    behavior.password = "secret";
+    fakesmtp::Server fake(behavior);
+    auto server = clientFor(fake, "localhost");
+    server.username = "santa";
+    server.password = "secret";
+    auto messages = makeMessages(3);
+    messages[1].data = "Subject: dots\n\n.\n";
+
+    CHECK(deliverAll(server, messages, quickOptions()) == 3);
+
+    // encrypted before the login, the extensions asked for again
+    const auto sessions = fake.sessions();
+    CHECK(sessions.size() == 1);
+    if (sessions.size() == 1) {
+        const auto& commands = sessions[0].commands;
+        const auto tls = find(commands, "<TLS>");
+        CHECK(find(commands, "STARTTLS") + 1 == tls);
+        CHECK(tls + 1 < commands.size() &&
+              commands[tls + 1].rfind("EHLO", 0) == 0);
+        CHECK(find(commands, "AUTH PLAIN") > tls);
+        CHECK(find(commands, "AUTH PLAIN") < commands.size());
+    }
+    const auto received = fake.received();
+    CHECK(received.size() == 3);
+    if (received.size() == 3) {
+        CHECK(received[1].data == "Subject: dots\r\n\r\n..\r\n");
+    }
+}
+
+void testImplicitTls(const std::string& certFile, const std::string& keyFile)
+{
+    setenv("SSL_CERT_FILE", certFile.c_str(), 1);
+
+    fakesmtp::Behavior behavior;
+    behavior.implicitTls = true;
+    behavior.certFile = certFile;
+    behavior.keyFile = keyFile;
+    fakesmtp::Server fake(behavior);
+    auto server = clientFor(fake, "localhost");
+    server.implicitTls = true;
+    auto messages = makeMessages(2);
+
+    CHECK(deliverAll(server, messages, quickOptions()) == 2);
+    const auto sessions = fake.sessions();
+    CHECK(sessions.size() == 1);
+    if (sessions.size() == 1) {
+        CHECK(not sessions[0].commands.empty() &&
+              sessions[0].commands.front() == "<TLS>");
+        CHECK(find(sessions[0].commands, "STARTTLS") ==
+              sessions[0].commands.size());
+    }
+}
+}  // namespace
+
+int main()
+{
+    testDotStuffing();
+    testReconnectAfterMaxMessages();
+    testSeveralConnections();
+    testPermanentFailure();
+    testTransientFailureRetried();
+    testTransientFailureGivesUp();
+    testDroppedConnectionReopened();
+    testUnreachableServer();
+    testPlaintextAuthRefused();
+    testPlaintextAuthAllowed();
+
+    char dirTemplate[] = "/tmp/smtpTestXXXXXX";
+    if (mkdtemp(dirTemplate) == nullptr) {
+        std::cerr << "Could not create a temporary directory" << std::endl;
+        return EXIT_FAILURE;
+    }
+    const std::filesystem::path dir(dirTemplate);
+    const auto certFile = (dir / "cert.pem").string();
+    const auto keyFile = (dir / "key.pem").string();
+    if (fakesmtp::writeCertificate(certFile, keyFile)) {
+        testUntrustedCertificate(certFile, keyFile);
+        testStartTls(certFile, keyFile);
+        testImplicitTls(certFile, keyFile);
+    } else {
+        std::cerr << "Could not write a certificate" << std::endl;
+        ++numFailures;
+    }
+    std::filesystem::remove_all(dir);
+
+    if (numFailures > 0) {
+        std::cerr << numFailures << " checks failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return EXIT_SUCCESS;
+}